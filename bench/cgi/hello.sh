@@ -0,0 +1,3 @@
+#!/bin/sh
+# CGI mínimo para el escenario "cgi" de bench/run.sh
+printf 'Content-Type: text/plain\r\n\r\nhello from %s\n' "$REQUEST_METHOD"
@@ -0,0 +1,401 @@
+/*
+ * Generador de carga HTTP/1.1 con epoll: N conexiones concurrentes que
+ * repiten peticiones durante D segundos (keep-alive o una conexión por
+ * petición) y miden la latencia de cada una.
+ *
+ * Uso: loadgen [-c conns] [-d segundos] [-k] [-m método] [-b fichero_cuerpo]
+ *              [-T content-type] [-H "Cabecera: valor"] [-n escenario]
+ *              [-o resultados.jsonl] host:puerto ruta [ruta...]
+ *
+ * Con varias rutas se alternan en orden. Imprime RPS y percentiles de
+ * latencia y, con -o, añade una línea JSON por escenario.
+ */
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+# define LG_MAX_EVENTS 256
+# define LG_READ_SIZE 65536
+
+enum e_conn_state {
+	LG_CONNECTING,
+	LG_WRITING,
+	LG_READING
+};
+
+struct Conn {
+	int				fd;
+	e_conn_state	state;
+	size_t			req;            // índice de la petición en curso
+	size_t			sent;
+	std::string		head;           // cabeceras de la respuesta hasta "\r\n\r\n"
+	bool			head_done;
+	long			content_length; // -1: hasta que cierre el servidor
+	long			body_read;
+	int				status;
+	bool			server_close;
+	double			start;
+
+	Conn() : fd(-1), state(LG_CONNECTING), req(0), sent(0), head_done(false),
+		content_length(-1), body_read(0), status(0), server_close(false), start(0) {}
+};
+
+struct Options {
+	int							conns;
+	double						duration;
+	bool						keep_alive;
+	std::string					method;
+	std::string					body;
+	std::string					content_type;
+	std::vector<std::string>	headers;
+	std::string					name;
+	std::string					out;
+	std::string					host;
+	int							port;
+	std::vector<std::string>	paths;
+
+	Options() : conns(16), duration(5), keep_alive(false), method("GET"),
+		name("default"), port(80) {}
+};
+
+struct Stats {
+	std::vector<unsigned int>	latency_us;
+	std::map<int, long>			status;
+	long						errors;
+	double						bytes;
+
+	Stats() : errors(0), bytes(0) {}
+};
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage() {
+	fprintf(stderr, "Usage: loadgen [-c conns] [-d secs] [-k] [-m method] [-b body_file] "
+		"[-T content-type] [-H header] [-n name] [-o out.jsonl] host:port path [path...]\n");
+	exit(1);
+}
+
+static std::string read_file(const std::string &path) {
+	std::ifstream in(path.c_str(), std::ios::binary);
+	if (!in) {
+		fprintf(stderr, "loadgen: cannot read %s\n", path.c_str());
+		exit(1);
+	}
+	std::ostringstream ss;
+	ss << in.rdbuf();
+	return ss.str();
+}
+
+static void parse_args(int argc, char **argv, Options &opt) {
+	int c;
+	while ((c = getopt(argc, argv, "c:d:km:b:T:H:n:o:")) != -1) {
+		switch (c) {
+			case 'c': opt.conns = atoi(optarg); break;
+			case 'd': opt.duration = atof(optarg); break;
+			case 'k': opt.keep_alive = true; break;
+			case 'm': opt.method = optarg; break;
+			case 'b': opt.body = read_file(optarg); break;
+			case 'T': opt.content_type = optarg; break;
+			case 'H': opt.headers.push_back(optarg); break;
+			case 'n': opt.name = optarg; break;
+			case 'o': opt.out = optarg; break;
+			default: usage();
+		}
+	}
+	if (argc - optind < 2 || opt.conns <= 0 || opt.duration <= 0)
+		usage();
+	std::string target = argv[optind++];
+	size_t colon = target.rfind(':');
+	if (colon == std::string::npos)
+		usage();
+	opt.host = target.substr(0, colon);
+	opt.port = atoi(target.c_str() + colon + 1);
+	for (; optind < argc; ++optind)
+		opt.paths.push_back(argv[optind]);
+}
+
+static std::vector<std::string> build_requests(const Options &opt) {
+	std::vector<std::string> reqs;
+	for (size_t i = 0; i < opt.paths.size(); ++i) {
+		std::ostringstream r;
+		r << opt.method << " " << opt.paths[i] << " HTTP/1.1\r\n"
+		  << "Host: " << opt.host << ":" << opt.port << "\r\n"
+		  << "User-Agent: webserv-loadgen\r\n"
+		  << "Connection: " << (opt.keep_alive ? "keep-alive" : "close") << "\r\n";
+		for (size_t h = 0; h < opt.headers.size(); ++h)
+			r << opt.headers[h] << "\r\n";
+		if (!opt.content_type.empty())
+			r << "Content-Type: " << opt.content_type << "\r\n";
+		if (!opt.body.empty() || opt.method == "POST")
+			r << "Content-Length: " << opt.body.size() << "\r\n";
+		r << "\r\n" << opt.body;
+		reqs.push_back(r.str());
+	}
+	return reqs;
+}
+
+class LoadGen {
+	private:
+		const Options				&_opt;
+		std::vector<std::string>	_reqs;
+		sockaddr_in					_addr;
+		int							_epfd;
+		std::vector<Conn>			_conns;
+		size_t						_next_req;
+		Stats						_stats;
+
+		void _open(Conn &c) {
+			c = Conn();
+			c.req = _next_req++ % _reqs.size();
+			c.start = now();
+			c.fd = socket(AF_INET, SOCK_STREAM, 0);
+			if (c.fd < 0) {
+				perror("socket");
+				exit(1);
+			}
+			fcntl(c.fd, F_SETFL, O_NONBLOCK);
+			int one = 1;
+			setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+			if (connect(c.fd, reinterpret_cast<sockaddr*>(&_addr), sizeof(_addr)) < 0 && errno != EINPROGRESS) {
+				_fail(c);
+				return;
+			}
+			c.state = LG_CONNECTING;
+			_watch(c, EPOLL_CTL_ADD, EPOLLOUT);
+		}
+
+		void _watch(Conn &c, int op, unsigned int events) {
+			struct epoll_event ev;
+			ev.events = events;
+			ev.data.u32 = static_cast<unsigned int>(&c - &_conns[0]);
+			epoll_ctl(_epfd, op, c.fd, &ev);
+		}
+
+		void _close(Conn &c) {
+			if (c.fd >= 0) {
+				epoll_ctl(_epfd, EPOLL_CTL_DEL, c.fd, NULL);
+				close(c.fd);
+			}
+			c.fd = -1;
+		}
+
+		void _fail(Conn &c) {
+			_stats.errors++;
+			_close(c);
+		}
+
+		/** Siguiente petición por la misma conexión (keep-alive). */
+		void _next(Conn &c) {
+			int fd = c.fd;
+			c = Conn();
+			c.fd = fd;
+			c.req = _next_req++ % _reqs.size();
+			c.start = now();
+			c.state = LG_WRITING;
+			_watch(c, EPOLL_CTL_MOD, EPOLLOUT);
+		}
+
+		void _complete(Conn &c) {
+			double us = (now() - c.start) * 1e6;
+			_stats.latency_us.push_back(us > 4e9 ? 4000000000u : static_cast<unsigned int>(us));
+			_stats.status[c.status]++;
+			_stats.bytes += c.head.size() + c.body_read;
+			if (_opt.keep_alive && !c.server_close)
+				_next(c);
+			else
+				_close(c);
+		}
+
+		void _parse_head(Conn &c) {
+			c.status = atoi(c.head.c_str() + 9); // "HTTP/1.1 200"
+			std::string lower(c.head);
+			for (size_t i = 0; i < lower.size(); ++i)
+				lower[i] = static_cast<char>(tolower(static_cast<unsigned char>(lower[i])));
+			size_t cl = lower.find("\r\ncontent-length:");
+			if (cl != std::string::npos)
+				c.content_length = atol(lower.c_str() + cl + 17);
+			c.server_close = lower.find("\r\nconnection: close") != std::string::npos;
+		}
+
+		void _on_write(Conn &c) {
+			if (c.state == LG_CONNECTING) {
+				int err = 0;
+				socklen_t len = sizeof(err);
+				getsockopt(c.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+				if (err) {
+					_fail(c);
+					return;
+				}
+				c.state = LG_WRITING;
+			}
+			const std::string &req = _reqs[c.req];
+			ssize_t n = send(c.fd, req.data() + c.sent, req.size() - c.sent, MSG_NOSIGNAL);
+			if (n < 0) {
+				if (errno != EAGAIN)
+					_fail(c);
+				return;
+			}
+			c.sent += n;
+			if (c.sent == req.size()) {
+				c.state = LG_READING;
+				_watch(c, EPOLL_CTL_MOD, EPOLLIN);
+			}
+		}
+
+		void _on_read(Conn &c) {
+			char buf[LG_READ_SIZE];
+			for (;;) {
+				ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+				if (n < 0) {
+					if (errno != EAGAIN)
+						_fail(c);
+					return;
+				}
+				if (n == 0) {
+					// sin Content-Length el cuerpo acaba al cerrar
+					if (c.head_done && c.content_length < 0) {
+						c.server_close = true;
+						_complete(c);
+					} else
+						_fail(c);
+					return;
+				}
+				size_t off = 0;
+				if (!c.head_done) {
+					size_t old = c.head.size();
+					c.head.append(buf, n);
+					size_t end = c.head.find("\r\n\r\n", old >= 3 ? old - 3 : 0);
+					if (end == std::string::npos)
+						continue;
+					off = end + 4 - old;
+					c.head.erase(end + 4);
+					c.head_done = true;
+					_parse_head(c);
+				}
+				c.body_read += n - off;
+				if (c.content_length >= 0 && c.body_read >= c.content_length) {
+					_complete(c);
+					return;
+				}
+			}
+		}
+
+	public:
+		LoadGen(const Options &opt) : _opt(opt), _reqs(build_requests(opt)), _next_req(0) {
+			memset(&_addr, 0, sizeof(_addr));
+			_addr.sin_family = AF_INET;
+			_addr.sin_port = htons(opt.port);
+			if (inet_pton(AF_INET, opt.host.c_str(), &_addr.sin_addr) != 1) {
+				fprintf(stderr, "loadgen: invalid IPv4 address %s\n", opt.host.c_str());
+				exit(1);
+			}
+			_epfd = epoll_create(LG_MAX_EVENTS);
+			_conns.resize(opt.conns);
+		}
+
+		~LoadGen() {
+			for (size_t i = 0; i < _conns.size(); ++i)
+				_close(_conns[i]);
+			close(_epfd);
+		}
+
+		double run() {
+			double t0 = now();
+			double deadline = t0 + _opt.duration;
+			for (size_t i = 0; i < _conns.size(); ++i)
+				_open(_conns[i]);
+
+			struct epoll_event events[LG_MAX_EVENTS];
+			while (now() < deadline) {
+				int n = epoll_wait(_epfd, events, LG_MAX_EVENTS, 100);
+				for (int i = 0; i < n; ++i) {
+					Conn &c = _conns[events[i].data.u32];
+					if (c.fd < 0)
+						continue;
+					if (events[i].events & EPOLLOUT)
+						_on_write(c);
+					else if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+						_on_read(c);
+				}
+				// reabrir las que se cerraron (Connection: close o error)
+				for (size_t i = 0; i < _conns.size(); ++i) {
+					if (_conns[i].fd < 0)
+						_open(_conns[i]);
+				}
+			}
+			return now() - t0;
+		}
+
+		Stats &stats() { return _stats; }
+};
+
+static unsigned int percentile(const std::vector<unsigned int> &sorted, double p) {
+	if (sorted.empty())
+		return 0;
+	size_t idx = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+	return sorted[std::min(idx, sorted.size() - 1)];
+}
+
+static void report(const Options &opt, Stats &st, double elapsed) {
+	std::vector<unsigned int> &lat = st.latency_us;
+	std::sort(lat.begin(), lat.end());
+	double rps = lat.size() / elapsed;
+	double mbps = st.bytes / elapsed / (1024 * 1024);
+	unsigned int p50 = percentile(lat, 0.50);
+	unsigned int p99 = percentile(lat, 0.99);
+	unsigned int p999 = percentile(lat, 0.999);
+	unsigned int max = lat.empty() ? 0 : lat.back();
+
+	std::string codes;
+	for (std::map<int, long>::iterator it = st.status.begin(); it != st.status.end(); ++it) {
+		char tmp[64];
+		snprintf(tmp, sizeof(tmp), "%s\"%d\":%ld", codes.empty() ? "" : ",", it->first, it->second);
+		codes += tmp;
+	}
+	printf("%-16s %4d %-5s %9.0f req/s %8.1f MB/s  p50 %7.2f ms  p99 %7.2f ms  p999 %7.2f ms  errors %ld  {%s}\n",
+		opt.name.c_str(), opt.conns, opt.keep_alive ? "ka" : "close", rps, mbps,
+		p50 / 1000.0, p99 / 1000.0, p999 / 1000.0, st.errors, codes.c_str());
+
+	if (opt.out.empty())
+		return;
+	FILE *f = fopen(opt.out.c_str(), "a");
+	if (!f) {
+		perror(opt.out.c_str());
+		return;
+	}
+	fprintf(f, "{\"scenario\":\"%s\",\"connections\":%d,\"keep_alive\":%s,\"duration_s\":%.3f,"
+		"\"requests\":%lu,\"errors\":%ld,\"rps\":%.1f,\"mb_per_s\":%.2f,"
+		"\"latency_us\":{\"p50\":%u,\"p99\":%u,\"p999\":%u,\"max\":%u},\"status\":{%s}}\n",
+		opt.name.c_str(), opt.conns, opt.keep_alive ? "true" : "false", elapsed,
+		static_cast<unsigned long>(lat.size()), st.errors, rps, mbps, p50, p99, p999, max, codes.c_str());
+	fclose(f);
+}
+
+int main(int argc, char **argv) {
+	Options opt;
+	parse_args(argc, argv, opt);
+	LoadGen gen(opt);
+	double elapsed = gen.run();
+	report(opt, gen.stats(), elapsed);
+	return gen.stats().latency_us.empty() ? 1 : 0;
+}
@@ -0,0 +1,451 @@
+#include "../include/WebServ.hpp"
+
+/*
+ * Microbenchmarks de las rutas calientes: parser de peticiones, escáner de
+ * cabeceras, normalización de rutas, elección de location, tipo MIME y
+ * serialización de respuestas. Cada caso informa ns/op y asignaciones/op
+ * (operator new y malloc, contadas con -Wl,--wrap=malloc).
+ *
+ * Uso: micro_bench [--filter texto] [--save fichero] [--baseline fichero]
+ *   make bench-micro           compara con bench/results/micro-baseline.txt
+ *   make bench-micro-baseline  guarda esa línea base
+ */
+
+# define MICRO_ROUNDS 5          // se queda con la mejor ronda
+# define MICRO_ROUND_TIME 0.1    // segundos por ronda
+
+/*** CONTADOR DE ASIGNACIONES ***/
+
+static unsigned long g_allocs = 0;
+
+extern "C" void *__real_malloc(size_t size);
+extern "C" void *__real_calloc(size_t n, size_t size);
+extern "C" void *__real_realloc(void *ptr, size_t size);
+extern "C" void __real_free(void *ptr);
+
+extern "C" void *__wrap_malloc(size_t size) {
+    g_allocs++;
+    return __real_malloc(size);
+}
+
+extern "C" void *__wrap_calloc(size_t n, size_t size) {
+    g_allocs++;
+    return __real_calloc(n, size);
+}
+
+extern "C" void *__wrap_realloc(void *ptr, size_t size) {
+    g_allocs++;
+    return __real_realloc(ptr, size);
+}
+
+extern "C" void __wrap_free(void *ptr) {
+    __real_free(ptr);
+}
+
+void *operator new(size_t size) throw(std::bad_alloc) {
+    g_allocs++;
+    void *p = __real_malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) throw(std::bad_alloc) {
+    return operator new(size);
+}
+
+void operator delete(void *p) throw() {
+    __real_free(p);
+}
+
+void operator delete[](void *p) throw() {
+    __real_free(p);
+}
+
+/*** CORPUS ***/
+
+// cabeceras tal como las envían navegadores y curl
+static const char *g_request_corpus[] = {
+    "GET / HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+    "Accept-Language: es-ES,es;q=0.9,en;q=0.8\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Connection: keep-alive\r\n"
+    "Cookie: session=8f14e45fceea167a5a36dedd4bea2543; theme=dark; _ga=GA1.1.1234567890.1700000000\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-Site: none\r\n"
+    "\r\n",
+    "GET /css/templatemo-style.css HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "User-Agent: curl/7.88.1\r\n"
+    "Accept: */*\r\n"
+    "\r\n",
+    "POST /upload HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "Content-Type: application/x-www-form-urlencoded\r\n"
+    "Content-Length: 19\r\n"
+    "Origin: http://localhost:8080\r\n"
+    "Referer: http://localhost:8080/\r\n"
+    "\r\n"
+    "name=bench&value=42",
+    "GET /photo-detail.html?img=img-02.jpg HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "If-None-Match: \"5f2b-1700000000\"\r\n"
+    "If-Modified-Since: Tue, 14 Nov 2023 22:13:20 GMT\r\n"
+    "Range: bytes=0-1023\r\n"
+    "\r\n",
+};
+
+static const char *g_path_corpus[] = {
+    "/",
+    "/index.html",
+    "/css/templatemo-style.css",
+    "/webdev/imgs/0116-structure-of-url.png",
+    "//img///people-1.jpg",
+    "/a/./b/./c/index.html",
+    "/app/static/../../etc/../www/./index.html",
+    "/section42/sub/../sub/page.html",
+};
+
+static const char *g_file_corpus[] = {
+    "www/index.html",
+    "www/css/templatemo-style.css",
+    "www/js/plugins.js",
+    "www/img/hero.jpg",
+    "www/webdev/imgs/0116-structure-of-url.png",
+    "www/favicon.ico",
+    "www/file/report.pdf",
+    "www/file/archive.unknown",
+};
+
+# define COUNT(a) (sizeof(a) / sizeof(*(a)))
+
+static std::vector<std::string>     g_requests;
+static std::vector<std::string>     g_paths;
+static std::string                  g_hostile_path; // 4 KB de "/./", "//" y "/.." encadenados
+static std::vector<std::string>     g_files;
+static std::vector<Location>        g_locations[3]; // 10, 100 y 1000 locations
+static ConfigSnapshot               *g_snapshots[3]; // las mismas, compiladas
+static std::vector<std::string>     g_route_paths;
+static size_t                       g_request_bytes = 0;
+static volatile size_t              g_sink = 0;     // evita que el compilador elimine el trabajo
+
+/**
+ * Configuración sintética con n locations: prefijos "/appN" con una
+ * sublocation "/appN/static" cada diez, más "/" como en cualquier config.
+ */
+static std::vector<Location> make_locations(size_t n) {
+    std::vector<Location> locations;
+    Location root;
+    root.setPathLocation("/");
+    locations.push_back(root);
+    for (size_t i = 1; i < n; ++i) {
+        Location loc;
+        if (i % 10 == 0)
+            loc.setPathLocation("/app" + to_string(i - 1) + "/static");
+        else
+            loc.setPathLocation("/app" + to_string(i));
+        locations.push_back(loc);
+    }
+    return locations;
+}
+
+static void init_corpus() {
+    for (size_t i = 0; i < COUNT(g_request_corpus); ++i) {
+        g_requests.push_back(g_request_corpus[i]);
+        g_request_bytes += g_requests.back().size();
+    }
+    // cabeceras grandes (cookies de 4 KB)
+    std::string big = "GET / HTTP/1.1\r\nHost: localhost\r\nCookie: ";
+    big += std::string(4096, 'x') + "\r\nX-Trace: " + std::string(2048, 'y') + "\r\n\r\n";
+    g_requests.push_back(big);
+    g_request_bytes += big.size();
+
+    for (size_t i = 0; i < COUNT(g_path_corpus); ++i)
+        g_paths.push_back(g_path_corpus[i]);
+    while (g_hostile_path.size() < 4096)
+        g_hostile_path += "/a/.//b/%2e%2e/../";
+    for (size_t i = 0; i < COUNT(g_file_corpus); ++i)
+        g_files.push_back(g_file_corpus[i]);
+
+    g_locations[0] = make_locations(10);
+    g_locations[1] = make_locations(100);
+    g_locations[2] = make_locations(1000);
+    for (int i = 0; i < 3; ++i) {
+        std::vector<ServerUnit> servers(1);
+        for (size_t l = 0; l < g_locations[i].size(); ++l)
+            servers[0].setLocation(g_locations[i][l].getPathLocation(), std::vector<std::string>());
+        g_snapshots[i] = new ConfigSnapshot(servers, 1);
+    }
+    // aciertos al principio, en medio y al final de la lista, sublocations y fallos
+    const char *routes[] = {
+        "/app1/index.html", "/app5/a/b/c", "/app9/static/logo.png", "/app50/x",
+        "/app99/static/app.js", "/app500/y", "/app999/z", "/unknown/path", "/",
+    };
+    for (size_t i = 0; i < COUNT(routes); ++i)
+        g_route_paths.push_back(routes[i]);
+}
+
+/*** CASOS ***/
+
+static void bench_request_parse(size_t iters) {
+    Arena arena;
+    for (size_t i = 0; i < iters; ++i) {
+        Request req(g_requests[i % g_requests.size()], &arena);
+        g_sink += req.getHeaderCount();
+        arena.reset();
+    }
+}
+
+static void bench_scanner(size_t iters) {
+    for (size_t i = 0; i < iters; ++i) {
+        const std::string &r = g_requests[i % g_requests.size()];
+        size_t resume = 0;
+        g_sink += Scanner::findHeaderEnd(r.data(), r.size(), resume);
+    }
+}
+
+static void bench_scanner_scalar(size_t iters) { Scanner::force(SCAN_SCALAR); bench_scanner(iters); }
+static void bench_scanner_sse2(size_t iters) { Scanner::force(SCAN_SSE2); bench_scanner(iters); }
+static void bench_scanner_avx2(size_t iters) { Scanner::force(SCAN_AVX2); bench_scanner(iters); }
+
+static void bench_path_normalization(size_t iters) {
+    for (size_t i = 0; i < iters; ++i)
+        g_sink += path_normalization(g_paths[i % g_paths.size()]).size();
+}
+
+static void bench_normalize_uri(size_t iters) {
+    char buf[256];
+    for (size_t i = 0; i < iters; ++i) {
+        const std::string &p = g_paths[i % g_paths.size()];
+        g_sink += normalize_uri(p.data(), p.size(), buf);
+    }
+}
+
+static void bench_path_normalization_hostile(size_t iters) {
+    for (size_t i = 0; i < iters; ++i)
+        g_sink += path_normalization(g_hostile_path).size();
+}
+
+static void bench_normalize_uri_hostile(size_t iters) {
+    std::vector<char> buf(g_hostile_path.size());
+    for (size_t i = 0; i < iters; ++i)
+        g_sink += normalize_uri(g_hostile_path.data(), g_hostile_path.size(), &buf[0]);
+}
+
+static void bench_find_location(size_t iters, const std::vector<Location> &locations) {
+    for (size_t i = 0; i < iters; ++i)
+        g_sink += reinterpret_cast<size_t>(find_best_location(g_route_paths[i % g_route_paths.size()], locations));
+}
+
+static void bench_find_location_10(size_t iters) { bench_find_location(iters, g_locations[0]); }
+static void bench_find_location_100(size_t iters) { bench_find_location(iters, g_locations[1]); }
+static void bench_find_location_1000(size_t iters) { bench_find_location(iters, g_locations[2]); }
+
+static void bench_route(size_t iters, const ConfigSnapshot *snapshot) {
+    const ServerUnit *server = &snapshot->getServers()[0];
+    for (size_t i = 0; i < iters; ++i)
+        g_sink += reinterpret_cast<size_t>(snapshot->route(server, g_route_paths[i % g_route_paths.size()]));
+}
+
+static void bench_route_10(size_t iters) { bench_route(iters, g_snapshots[0]); }
+static void bench_route_100(size_t iters) { bench_route(iters, g_snapshots[1]); }
+static void bench_route_1000(size_t iters) { bench_route(iters, g_snapshots[2]); }
+
+static void bench_content_type(size_t iters) {
+    for (size_t i = 0; i < iters; ++i)
+        g_sink += discover_content_type(g_files[i % g_files.size()]).size();
+}
+
+static void bench_to_string_error(size_t iters) {
+    HttpResponse resp(HttpStatusCode::NotFound);
+    for (size_t i = 0; i < iters; ++i)
+        g_sink += resp.toString().size();
+}
+
+static void bench_to_string_redirect(size_t iters) {
+    HttpResponse resp(301, "/webdev/imgs/");
+    for (size_t i = 0; i < iters; ++i)
+        g_sink += resp.toString().size();
+}
+
+static void bench_canned_error(size_t iters) {
+    const CannedResponse &resp = CannedResponse::defaultError(HttpStatusCode::NotFound);
+    for (size_t i = 0; i < iters; ++i)
+        g_sink += resp.render(true).size();
+}
+
+static void bench_canned_redirect(size_t iters) {
+    CannedResponse resp = CannedResponse::redirect(HttpStatusCode::MovedPermanently, "/webdev/imgs/");
+    for (size_t i = 0; i < iters; ++i)
+        g_sink += resp.render(true).size();
+}
+
+struct MicroCase {
+    const char  *name;
+    void        (*fn)(size_t iters);
+    int         scanner;    // implementación que requiere, -1 si ninguna
+};
+
+static const MicroCase g_cases[] = {
+    { "request/parse",              bench_request_parse,        -1 },
+    { "scanner/header-end/scalar",  bench_scanner_scalar,       SCAN_SCALAR },
+    { "scanner/header-end/sse2",    bench_scanner_sse2,         SCAN_SSE2 },
+    { "scanner/header-end/avx2",    bench_scanner_avx2,         SCAN_AVX2 },
+    { "path/normalization",         bench_path_normalization,   -1 },
+    { "path/normalization/hostile", bench_path_normalization_hostile, -1 },
+    { "path/normalize-uri",         bench_normalize_uri,        -1 },
+    { "path/normalize-uri/hostile", bench_normalize_uri_hostile, -1 },
+    { "route/find-location/10",     bench_find_location_10,     -1 },
+    { "route/find-location/100",    bench_find_location_100,    -1 },
+    { "route/find-location/1000",   bench_find_location_1000,   -1 },
+    { "route/compiled/10",          bench_route_10,             -1 },
+    { "route/compiled/100",         bench_route_100,            -1 },
+    { "route/compiled/1000",        bench_route_1000,           -1 },
+    { "mime/content-type",          bench_content_type,         -1 },
+    { "response/to-string/404",     bench_to_string_error,      -1 },
+    { "response/to-string/301",     bench_to_string_redirect,   -1 },
+    { "response/canned/404",        bench_canned_error,         -1 },
+    { "response/canned/301",        bench_canned_redirect,      -1 },
+};
+
+/*** MEDICIÓN ***/
+
+struct MicroResult {
+    std::string name;
+    double      ns_per_op;
+    double      allocs_per_op;
+    double      gb_per_s;   // solo el escáner
+};
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Ajusta las iteraciones para que cada ronda dure MICRO_ROUND_TIME y se
+ * queda con la ronda más rápida (la menos perturbada por el sistema).
+ */
+static MicroResult run_case(const MicroCase &c) {
+    size_t iters = 1;
+    for (;;) {
+        double t0 = now();
+        c.fn(iters);
+        double elapsed = now() - t0;
+        if (elapsed >= MICRO_ROUND_TIME / 10 || iters >= (static_cast<size_t>(1) << 30)) {
+            double per_op = elapsed / iters;
+            iters = static_cast<size_t>(MICRO_ROUND_TIME / (per_op > 0 ? per_op : 1e-9)) + 1;
+            break;
+        }
+        iters *= 2;
+    }
+
+    MicroResult r;
+    r.name = c.name;
+    r.ns_per_op = 0;
+    r.allocs_per_op = 0;
+    for (int round = 0; round < MICRO_ROUNDS; ++round) {
+        unsigned long allocs = g_allocs;
+        double t0 = now();
+        c.fn(iters);
+        double ns = (now() - t0) * 1e9 / iters;
+        if (round == 0 || ns < r.ns_per_op)
+            r.ns_per_op = ns;
+        r.allocs_per_op = static_cast<double>(g_allocs - allocs) / iters;
+    }
+    r.gb_per_s = c.scanner >= 0 ? (g_request_bytes / static_cast<double>(g_requests.size())) / r.ns_per_op : 0;
+    return r;
+}
+
+/*** LÍNEA BASE ***/
+
+static std::map<std::string, MicroResult> load_baseline(const std::string &path) {
+    std::map<std::string, MicroResult> base;
+    std::ifstream in(path.c_str());
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream ss(line);
+        MicroResult r;
+        if (ss >> r.name >> r.ns_per_op >> r.allocs_per_op)
+            base[r.name] = r;
+    }
+    return base;
+}
+
+static void save_baseline(const std::string &path, const std::vector<MicroResult> &results) {
+    std::ofstream out(path.c_str());
+    if (!out) {
+        fprintf(stderr, "micro_bench: cannot write %s\n", path.c_str());
+        return;
+    }
+    out << "# name ns/op allocs/op (" << Scanner::implName() << ")\n";
+    for (size_t i = 0; i < results.size(); ++i)
+        out << results[i].name << " " << results[i].ns_per_op << " " << results[i].allocs_per_op << "\n";
+    printf("baseline saved to %s\n", path.c_str());
+}
+
+int main(int argc, char **argv) {
+    std::string filter, save, baseline_path;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc)
+            filter = argv[++i];
+        else if (arg == "--save" && i + 1 < argc)
+            save = argv[++i];
+        else if (arg == "--baseline" && i + 1 < argc)
+            baseline_path = argv[++i];
+        else {
+            fprintf(stderr, "Usage: micro_bench [--filter text] [--save file] [--baseline file]\n");
+            return 1;
+        }
+    }
+    // el logging del servidor formatea igual, pero no se imprime
+    std::cout.setstate(std::ios::failbit);
+    init_corpus();
+    e_scanner_impl best = Scanner::impl();
+
+    std::map<std::string, MicroResult> base;
+    if (!baseline_path.empty())
+        base = load_baseline(baseline_path);
+
+    printf("%-28s %12s %10s %8s %12s %8s\n", "case", "ns/op", "allocs/op", "GB/s", "base ns/op", "delta");
+    std::vector<MicroResult> results;
+    for (size_t i = 0; i < COUNT(g_cases); ++i) {
+        const MicroCase &c = g_cases[i];
+        if (!filter.empty() && std::string(c.name).find(filter) == std::string::npos)
+            continue;
+        if (c.scanner >= 0) {
+            Scanner::force(static_cast<e_scanner_impl>(c.scanner));
+            if (Scanner::impl() != c.scanner)
+                continue; // CPU sin esa extensión
+        }
+        MicroResult r = run_case(c);
+        Scanner::force(best);
+        results.push_back(r);
+
+        printf("%-28s %12.1f %10.2f", r.name.c_str(), r.ns_per_op, r.allocs_per_op);
+        if (r.gb_per_s > 0)
+            printf(" %8.2f", r.gb_per_s);
+        else
+            printf(" %8s", "-");
+        std::map<std::string, MicroResult>::iterator b = base.find(r.name);
+        if (b != base.end()) {
+            double delta = (r.ns_per_op - b->second.ns_per_op) / b->second.ns_per_op * 100;
+            printf(" %12.1f %+7.1f%%", b->second.ns_per_op, delta);
+            if (r.allocs_per_op != b->second.allocs_per_op)
+                printf("  allocs %.2f -> %.2f", b->second.allocs_per_op, r.allocs_per_op);
+        }
+        printf("\n");
+    }
+    if (!save.empty())
+        save_baseline(save, results);
+    return g_sink == 42 ? 1 : 0;
+}
@@ -0,0 +1,67 @@
+#!/bin/sh
+# Escenarios de carga de `make bench` contra config/bench.config.
+# Cada escenario añade una línea JSON a $BENCH_OUT (por defecto
+# bench/results/<fecha>.jsonl); compara dos ficheros para ver regresiones.
+#
+#   BENCH_DURATION  segundos por escenario (5)
+#   BENCH_CONNS     conexiones concurrentes en los escenarios estáticos (32)
+#   BENCH_OUT       fichero de resultados
+
+DURATION=${BENCH_DURATION:-5}
+CONNS=${BENCH_CONNS:-32}
+OUT=${BENCH_OUT:-bench/results/$(date +%Y%m%d-%H%M%S).jsonl}
+TARGET=127.0.0.1:8090
+LOADGEN=./bench/loadgen
+BOUNDARY=webservbenchboundary
+TMP=$(mktemp -d)
+
+mkdir -p "$(dirname "$OUT")"
+
+# el log del servidor va a fichero: escribirlo en la terminal domina el tiempo
+./webserv config/bench.config > "$TMP/webserv.log" 2>&1 &
+PID=$!
+trap 'kill $PID 2>/dev/null; rm -rf "$TMP"; rm -f www/file/bench-upload.bin' EXIT INT TERM
+
+# listo cuando responde a una petición
+i=0
+until $LOADGEN -c 1 -d 0.1 -n probe $TARGET /favicon.ico > /dev/null 2>&1; do
+    i=$((i + 1))
+    if [ $i -gt 50 ] || ! kill -0 $PID 2>/dev/null; then
+        echo "webserv did not start:" >&2
+        cat "$TMP/webserv.log" >&2
+        exit 1
+    fi
+    sleep 0.1
+done
+
+# cuerpos de las peticiones POST
+{
+    printf -- "--%s\r\n" "$BOUNDARY"
+    printf 'Content-Disposition: form-data; name="file"; filename="bench-upload.bin"\r\n'
+    printf 'Content-Type: application/octet-stream\r\n\r\n'
+    head -c 65536 /dev/urandom
+    printf -- "\r\n--%s--\r\n" "$BOUNDARY"
+} > "$TMP/upload.body"
+printf 'name=bench&value=42' > "$TMP/form.body"
+head -c 2000000 /dev/urandom > "$TMP/cgi.body"
+
+SMALL="/about.html /contact.html /css/templatemo-style.css /favicon.ico /img/people-2.jpg /img/select-arrow.png"
+ASSETS=$(cd www && for f in webdev/imgs/*; do printf '/%s ' "$f"; done)
+
+run() {
+    name=$1
+    shift
+    $LOADGEN -d "$DURATION" -n "$name" -o "$OUT" "$@" || echo "$name: no requests completed" >&2
+}
+
+echo "webserv benchmark: ${DURATION}s per scenario, results in $OUT"
+run static-ka      -c "$CONNS" -k $TARGET $SMALL
+run static-close   -c "$CONNS"    $TARGET $SMALL
+run webdev-assets  -c 8 -k        $TARGET $ASSETS
+run upload-64k     -c 8 -k -m POST -b "$TMP/upload.body" -T "multipart/form-data; boundary=$BOUNDARY" $TARGET /upload
+run cgi            -c 8 -k -m POST -b "$TMP/form.body" -T application/x-www-form-urlencoded $TARGET /cgi/hello.sh
+run cgi-upload-2m  -c 4 -k -m POST -b "$TMP/cgi.body" -T application/octet-stream $TARGET /cgi/hello.sh
+run not-found      -c "$CONNS" -k $TARGET /no/such/page.html
+# 3xx/4xx sin excepciones: deberían ir como not-found y static-ka
+run dir-redirect   -c "$CONNS" -k $TARGET /css
+run not-allowed    -c "$CONNS" -k -m DELETE $TARGET /about.html
@@ -0,0 +1,63 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include "WebServ.hpp"
+
+# define ARENA_BLOCK_SIZE 16384
+
+/**
+ * Vista (puntero + longitud) sobre memoria que no es nuestra: el buffer
+ * crudo de la petición o un bloque de Arena. No reserva ni copia nada.
+ */
+struct StrRef {
+	const char	*data;
+	size_t		len;
+
+	StrRef();
+	StrRef(const char *data, size_t len);
+	StrRef(const std::string &str);
+
+	bool		empty() const;
+	std::string	str() const;
+	size_t		find(char c, size_t from = 0) const;
+	size_t		find_first_not_of(char c, size_t from = 0) const;
+	StrRef		sub(size_t pos, size_t n = std::string::npos) const;
+	StrRef		trim(char c) const;
+	bool		iequals(const char *other) const;
+};
+
+/**
+ * Asignador "bump" ligado a la vida de una petición.
+ * alloc() solo avanza un puntero dentro del bloque actual; reset() libera
+ * todo de golpe y conserva los bloques para la siguiente petición, así que
+ * en régimen estable no hay llamadas a malloc.
+ */
+class Arena
+{
+	private:
+		std::vector<char*>	_blocks;
+		std::vector<size_t>	_sizes;
+		size_t				_block_size;
+		size_t				_current;  // índice del bloque en uso
+		size_t				_offset;   // bytes usados del bloque en uso
+		size_t				_used;     // total asignado desde el último reset()
+
+		bool	_next_block(size_t min_size);
+
+		Arena(const Arena &);
+		Arena &operator=(const Arena &);
+
+	public:
+		Arena(size_t block_size = ARENA_BLOCK_SIZE);
+		~Arena();
+
+		void	*alloc(size_t size, size_t align = sizeof(void*));
+		char	*dup(const char *str, size_t len);
+		StrRef	dupRef(const StrRef &ref);
+		void	reset();
+
+		size_t	used() const;
+		size_t	capacity() const;
+};
+
+#endif
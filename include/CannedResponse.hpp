@@ -0,0 +1,35 @@
+#ifndef CANNEDRESPONSE_HPP
+#define CANNEDRESPONSE_HPP
+
+#include "WebServ.hpp"
+
+/**
+ * Respuesta fija (página de error, redirección) renderizada una sola vez:
+ * línea de estado y cabeceras menos Connection en _head, el cuerpo aparte.
+ * render() solo añade la cabecera Connection de la petición, así que
+ * responder cuesta una reserva y dos copias, sin leer disco ni formatear.
+ *
+ * Las de la configuración (error_page, return) las crea ConfigSnapshot al
+ * cargarla; las páginas por defecto se crean al pedirlas la primera vez.
+ */
+class CannedResponse
+{
+	private:
+		int			_code;
+		std::string	_head;
+		std::string	_body;
+		bool		_close;  // cierra siempre, aunque el cliente pida keep-alive
+
+	public:
+		CannedResponse();
+		CannedResponse(int code, const std::string &body, bool close);
+
+		static CannedResponse		redirect(int code, const std::string &location);
+		static const CannedResponse	&defaultError(int code);
+
+		std::string		render(bool keep_alive) const;
+		int				getCode() const;
+		bool			closes() const;
+};
+
+#endif
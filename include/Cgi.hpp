@@ -12,12 +12,14 @@ class Cgi
 		std::map<std::string, std::string> _envVariables;
 
 		void setEnvVariables(const Request& req);
-		std::string executeCgi(const Request& req);
+		std::string executeCgi(const Request& req, bool keep_output);
+		std::string fastCgiRecords(unsigned short id, const Request& req);
 
 	public:
 		Cgi(const std::string& scriptPath);
 		~Cgi();
 
-		std::string run(const Request& req);
+		std::string run(const Request& req, bool keep_output = true);
+		int runFastCgi(const Request& req, const std::string& socketPath, std::string &output);
 };
 #endif
\ No newline at end of file
@@ -5,16 +5,30 @@
 
 enum e_file_type {
 	F_NOT_EXIST = -1,
+	F_PENDING = 0,      // FileCache en modo diferido: aún hay que mirar el disco
 	F_REGULAR_FILE = 1,
 	F_DIRECTORY = 2,
 	F_OTHER = 3
 };
 
+/**
+ * Acceso al fichero de configuración y comprobaciones de rutas (stat,
+ * access) para validar sus directivas.
+ *
+ * Entre beginBatch() y endBatch() las comprobaciones se memorizan por
+ * ruta: una configuración generada con miles de location que comparten
+ * root o ejecutable CGI hace un stat() por ruta distinta, no uno por
+ * directiva. Solo se usa mientras se carga la configuración.
+ */
 class ConfigFile {
 	private:
 		std::string		_path;
 		size_t			_size;
 
+		static bool									_batch;
+		static std::map<std::string, int>			_types;
+		static std::map<std::pair<std::string, int>, bool>	_access;
+
 	public:
 		ConfigFile();
 		ConfigFile(std::string const path);
@@ -25,6 +39,8 @@ class ConfigFile {
 		std::string		readFile(std::string path);
 		static bool 	isFileExistAndReadable(std::string const path, std::string const index);
 		static bool 	isFileExistAndExecutable(std::string const path, std::string const executable);
+		static void		beginBatch();
+		static void		endBatch();
 
 		std::string 	getPath();
 		int 			getSize();
@@ -0,0 +1,98 @@
+#ifndef CONFIGSNAPSHOT_HPP
+#define CONFIGSNAPSHOT_HPP
+
+#include "WebServ.hpp"
+
+class ServerUnit;
+class Location;
+
+/** Extensión CGI y su intérprete, dentro del bloque de cadenas del snapshot. */
+struct CgiRoute {
+	StrRef	ext;
+	StrRef	handler;
+};
+
+/**
+ * Location compilada: lo que se consulta en cada petición ya resuelto
+ * (root e index heredados del server, métodos como máscara de bits) y con
+ * las cadenas en el bloque contiguo del snapshot, que vive lo mismo que él.
+ */
+struct CompiledLocation {
+	const Location	*source;     // la original, para lo que necesita std::string (FastCGI)
+	StrRef			path;
+	size_t			match_len;   // path sin la barra final ("/" cuenta como 0: casa con todo)
+	StrRef			root;        // el de la location o, si no tiene, el del server
+	StrRef			alias;
+	StrRef			index;       // ídem
+	StrRef			redirect;    // destino de `return`
+	StrRef			allow;       // "GET, POST" para la cabecera Allow de un 405
+	unsigned		methods;     // bit (1 << e_methods) por método permitido
+	bool			autoindex;
+	bool			status;
+	bool			fastcgi;
+	unsigned long	max_body;
+	const CgiRoute	*cgi;        // ordenadas por extensión
+	size_t			cgi_count;
+
+	bool			allows(int method) const;
+	bool			matches(const std::string &request_path) const;
+	StrRef			cgiHandler(const StrRef &ext) const;
+};
+
+/**
+ * Configuración cargada en un momento dado: los servers y, por socket de
+ * escucha, cuál atiende. No se modifica tras construirse. Cada conexión
+ * retiene la que tenía al empezar su petición, así un SIGHUP cambia la
+ * configuración de las peticiones nuevas sin tocar las que están en curso;
+ * la vieja se libera cuando la suelta la última conexión.
+ *
+ * También guarda ya renderizadas (CannedResponse) las páginas de error de
+ * cada server y las redirecciones `return` de sus locations, y compila las
+ * locations (CompiledLocation) para que resolver una petición solo lea
+ * memoria contigua: route() recorre las de un server de la más larga a la
+ * más corta y se queda con la primera que casa.
+ *
+ * Lo único que cambia después es la caché de rutas resueltas (RouteCache),
+ * que así se descarta entera con la configuración.
+ */
+class ConfigSnapshot
+{
+	private:
+		std::vector<ServerUnit>	_servers;
+		std::map<int, size_t>	_by_fd;      // socket de escucha -> índice en _servers
+		std::vector<std::map<int, CannedResponse> >	_error_pages; // por índice en _servers
+		std::map<std::string, CannedResponse>		_redirects;   // por destino de `return`
+		Arena									_strings;     // cadenas internadas de las locations
+		std::vector<CompiledLocation>			_routes;      // las de cada server seguidas
+		std::vector<std::pair<size_t, size_t> >	_route_ranges; // por server: [primera, cuántas)
+		std::vector<CgiRoute>					_cgi_routes;
+		mutable RouteCache						_route_cache;
+		unsigned int			_generation; // 1 al arrancar, +1 por recarga
+		int						_refs;
+
+		ConfigSnapshot(const ConfigSnapshot &);
+		ConfigSnapshot &operator=(const ConfigSnapshot &);
+
+		void							_render_responses();
+		void							_compile_routes();
+		size_t							_index_of(const ServerUnit *server) const;
+		StrRef							_intern(const std::string &str,
+												std::map<std::string, StrRef> &seen);
+
+	public:
+		ConfigSnapshot(const std::vector<ServerUnit> &servers, unsigned int generation);
+		~ConfigSnapshot();
+
+		ConfigSnapshot					*retain();
+		void							release();
+
+		const ServerUnit				*serverFor(int listen_fd) const;
+		const std::vector<ServerUnit>	&getServers() const;
+		const CannedResponse			*errorPage(const ServerUnit *server, int code) const;
+		const CannedResponse			*redirect(const std::string &location) const;
+		const CompiledLocation			*route(const ServerUnit *server, const std::string &path) const;
+		RouteCache						&routeCache() const;
+		unsigned int					getGeneration() const;
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef FASTCGI_HPP
+#define FASTCGI_HPP
+
+#include "WebServ.hpp"
+
+# define FCGI_VERSION_1         1
+# define FCGI_BEGIN_REQUEST     1
+# define FCGI_END_REQUEST       3
+# define FCGI_PARAMS            4
+# define FCGI_STDIN             5
+# define FCGI_STDOUT            6
+# define FCGI_STDERR            7
+# define FCGI_RESPONDER         1
+# define FCGI_KEEP_CONN         1
+# define FCGI_HEADER_LEN        8
+# define FCGI_MAX_CONTENT       65535
+# define FCGI_LISTENSOCK_FILENO 0
+
+# define FASTCGI_DEFAULT_POOL   4
+# define FASTCGI_DEFAULT_QUEUE  64
+# define FASTCGI_TIMEOUT        10 // segundos por lectura/escritura con el backend
+# define FASTCGI_THREADS        16 // intercambios con los backends a la vez (IoPool propio)
+
+struct IoJob;
+
+/**
+ * Pool de conexiones persistentes hacia backends FastCGI (sockets Unix).
+ * Cada backend se identifica por la ruta de su socket. Las conexiones
+ * se reutilizan gracias a FCGI_KEEP_CONN y se limita el número de
+ * peticiones en curso (queue) para aplicar backpressure con 503.
+ *
+ * Con setDeferred(true) el intercambio con el backend lo hace un hilo de
+ * un IoPool: Cgi::runFastCgi lanza Pending, el ServerManager aparca la
+ * petición y, al terminar el hilo, responde con el resultado que guarda
+ * para esa conexión. Así un backend lento no para las demás conexiones.
+ */
+class FastCgiPool
+{
+	private:
+		struct Backend {
+			std::string			socket_path;
+			size_t				max_idle;     // conexiones ociosas que se conservan
+			size_t				max_queue;    // peticiones en curso permitidas
+			size_t				in_flight;
+			unsigned short		next_id;
+			std::vector<int>	idle;
+			std::vector<pid_t>	workers;
+			bool				owns_socket;  // lo creamos nosotros (fastcgi_spawn)
+			dev_t				socket_dev;   // el socket que creamos, para no borrar
+			ino_t				socket_ino;   // el de otro proceso (SIGUSR2) con la misma ruta
+
+			Backend();
+		};
+
+		static std::map<std::string, Backend>	_backends;
+		static bool								_deferred;
+
+		static Backend	&_get(const std::string &socket_path);
+		static int		_connect(const std::string &socket_path);
+
+		FastCgiPool();
+
+	public:
+		/** Lanzada en modo diferido: 'job' ya tiene conexión y registros; falta el intercambio. */
+		struct Pending {
+			IoJob	*job;
+		};
+
+		static void				setDeferred(bool deferred);
+		static bool				deferred();
+		static void				exchange(IoJob &job);
+		static void				finish(IoJob &job);
+
+		static void				configure(const std::string &socket_path, size_t pool, size_t queue);
+		static void				spawnWorkers(const std::string &socket_path, const std::string &exec, size_t count);
+		static int				acquire(const std::string &socket_path, int &fd, unsigned short &request_id, bool &pooled);
+		static void				release(const std::string &socket_path, int fd, bool reusable);
+		static void				shutdown();
+
+		static size_t			inFlight(const std::string &socket_path);
+		static size_t			idleCount(const std::string &socket_path);
+		static bool				hasWorkers(const std::string &socket_path);
+};
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef FILECACHE_HPP
+#define FILECACHE_HPP
+
+#include "WebServ.hpp"
+
+# define OPEN_FILE_CACHE_MAX   256 // entradas, negativas incluidas (cada fichero regular retiene un fd)
+# define OPEN_FILE_CACHE_VALID 5   // segundos antes de volver a comprobar una entrada con stat()
+
+/**
+ * Caché de ficheros abiertos, al estilo del open_file_cache de Nginx. Por
+ * cada ruta guarda el tipo (también "no existe"), el tamaño y, si es un
+ * fichero regular, un descriptor abierto que comparten las respuestas que
+ * lo leen (pread o io_uring, siempre con offset).
+ *
+ * Pasados OPEN_FILE_CACHE_VALID segundos una entrada se revalida con un
+ * stat(): si el fichero es el mismo (inodo, tamaño y mtime) se conserva;
+ * DELETE y las subidas la descartan al momento con invalidate_path(). Al
+ * superar OPEN_FILE_CACHE_MAX se expulsa la menos usada. Los descriptores
+ * llevan un contador de usos y solo se cierran cuando ni la caché ni
+ * ninguna respuesta en curso los necesitan.
+ *
+ * Los directorios guardan también su listado (autoindex), que se descarta
+ * con la entrada o al cambiar uno de sus ficheros.
+ *
+ * Con setDeferred(true) (hay IoPool) la caché no llama nunca a stat(),
+ * open() ni readdir() desde el bucle: una entrada que falta o ha caducado
+ * se da por pendiente (type() devuelve F_PENDING, las demás consultas
+ * fallan con pending() a true), el ServerManager aparca la petición con
+ * wanted(), un hilo del IoPool hace las llamadas y prime() /
+ * primeListing() guardan el resultado antes de repetirla. pin() mantiene
+ * esa entrada (ni caduca ni se expulsa) hasta que la petición se responde.
+ */
+class FileCache
+{
+	private:
+		struct Entry {
+			int									type;        // e_file_type
+			int									fd;          // -1 si no es un fichero regular legible
+			size_t								size;
+			dev_t								dev;
+			ino_t								ino;
+			struct timespec						mtime;
+			unsigned long long					valid_until; // Metrics::now()
+			std::list<const std::string*>::iterator	lru;
+			int									listed;      // directorio: 0 sin leer, 1 en 'listing', -1 opendir() falló
+			std::vector<std::string>			listing;
+			unsigned							pins;        // peticiones aparcadas que la esperan (ver pin)
+		};
+
+		enum e_lookup { LOOKUP_HIT, LOOKUP_MISS, LOOKUP_PENDING };
+
+		static std::map<std::string, Entry>		_entries;
+		static std::list<const std::string*>	_lru;     // la más reciente delante
+		static std::map<int, unsigned>			_refs;    // usos de cada fd; la caché cuenta uno
+		static bool								_hooked;
+		static bool								_deferred;
+		static bool								_pending;  // la última consulta necesita el disco
+		static std::string						_wanted;
+		static bool								_wanted_listing;
+
+		static int		_lookup(const std::string &path, Entry *&e);
+		static void		_want(const std::string &path, bool listing);
+		static Entry	&_insert(const std::string &path);
+		static void		_fill(Entry &e, const struct stat *st, int fd);
+		static int		_open_regular(const std::string &path, const struct stat *st);
+		static bool		_unchanged(const Entry &e, const struct stat *st);
+		static void		_drop_fd(Entry &e);
+		static void		_erase(std::map<std::string, Entry>::iterator it);
+
+		FileCache();
+
+	public:
+		/** Modo diferido: hay que mirar 'path' en disco (listing: también leerlo). */
+		struct Pending {
+			std::string	path;
+			bool		listing;
+		};
+
+		static void		setDeferred(bool deferred);
+		static void		prime(const std::string &path, const struct stat *st, int fd);
+		static void		primeListing(const std::string &path, const struct stat *st,
+									const std::vector<std::string> *entries);
+		static bool		readDirectory(const std::string &path, std::vector<std::string> &entries);
+		static bool		pending();
+		static Pending	wanted();
+		static void		pin(const std::string &path);
+		static void		unpin(const std::string &path);
+
+		static int		type(const std::string &path);
+		static bool		list(const std::string &path, std::vector<std::string> &entries);
+		static int		acquire(const std::string &path, size_t &size);
+		static void		release(int fd);
+		static bool		read(const std::string &path, std::string &out);
+		static void		invalidate(const std::string &path);
+		static void		clear();
+};
+
+#endif
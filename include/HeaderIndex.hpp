@@ -0,0 +1,58 @@
+#ifndef HEADERINDEX_HPP
+#define HEADERINDEX_HPP
+
+#include "WebServ.hpp"
+
+# define HEADER_TABLE_SIZE 64 // potencia de 2, mayor que H_COUNT
+
+/** Cabeceras conocidas: acceso O(1) desde Request::getHeader(e_header_id). */
+enum e_header_id {
+	H_UNKNOWN = -1,
+	H_ACCEPT = 0,
+	H_ACCEPT_CHARSET,
+	H_ACCEPT_ENCODING,
+	H_ACCEPT_LANGUAGE,
+	H_AUTHORIZATION,
+	H_CACHE_CONTROL,
+	H_CONNECTION,
+	H_CONTENT_LENGTH,
+	H_CONTENT_TYPE,
+	H_COOKIE,
+	H_EXPECT,
+	H_HOST,
+	H_IF_MODIFIED_SINCE,
+	H_IF_NONE_MATCH,
+	H_IF_RANGE,
+	H_RANGE,
+	H_REFERER,
+	H_TRANSFER_ENCODING,
+	H_UPGRADE,
+	H_USER_AGENT,
+	H_COUNT
+};
+
+/**
+ * Tabla hash perfecta (sin colisiones) de los nombres conocidos.
+ * La semilla se busca una sola vez al arrancar: se prueba hasta que los
+ * H_COUNT nombres caen en huecos distintos, así que lookup() es un hash
+ * más una única comparación, sin sondeo.
+ */
+class HeaderIndex
+{
+	private:
+		static const char	*_names[H_COUNT];
+		static unsigned int	_seed;
+		static signed char	_table[HEADER_TABLE_SIZE];
+		static bool			_ready;
+
+		static unsigned int	_hash(const char *name, size_t len, unsigned int seed);
+		static void			_build();
+
+		HeaderIndex();
+
+	public:
+		static e_header_id	lookup(const char *name, size_t len);
+		static const char	*name(e_header_id id);
+};
+
+#endif
@@ -24,6 +24,9 @@ struct ResponseHeaders {
 
 
 
+std::string discover_content_type(const std::string &filename);
+std::string get_default_error_page(int errorCode);
+
 class HttpResponse
 {
 private:
@@ -31,6 +34,12 @@ private:
 	ResponseStatus _status_line;
 	ResponseHeaders _headers;
 	std::string _body;
+	int _body_fd;        // cuerpo aún en disco (ver setAsyncFileBodies)
+	size_t _body_size;
+	int _error;          // 4xx/5xx a responder con la página de error del server (ver getError)
+	bool _waiting;       // FileCache necesita el disco: no hay respuesta todavía (ver waiting)
+
+	static bool _async_files;
 	
 	HttpResponse();
 	HttpResponse(const HttpResponse &other);
@@ -58,9 +67,19 @@ public:
 	void set_empty_response_alive(int code);
 	void set_empty_response_close(int code);
 	void set_allow_methods(const std::string& methods);
+	void set_cgi_response(const std::string& cgi_output);
+	void set_keep_alive(bool keep);
+	bool keep_alive() const;
+	int getError() const;
+	bool waiting() const;
+	int releaseBodyFile(size_t &size);
+	static void setAsyncFileBodies(bool enabled);
 
 	void handle_GET();
 	void handle_POST();
+	void handle_DELETE();
+	void handle_FastCGI();
+	void handle_status();
 
 	
 
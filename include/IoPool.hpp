@@ -0,0 +1,91 @@
+#ifndef IOPOOL_HPP
+#define IOPOOL_HPP
+
+#include "WebServ.hpp"
+#include <pthread.h>
+#include <semaphore.h>
+
+# define IO_POOL_THREADS 4    // hilos por defecto; WEBSERV_IO_THREADS lo cambia (0: sin pool)
+# define IO_POOL_QUEUE   1024 // trabajos en curso como máximo (potencia de 2)
+
+/** Trabajo para un IoPool: lo rellena el bucle y lo completa un hilo. */
+struct IoJob {
+	enum e_kind { OPEN, READ, LIST, FASTCGI };
+
+	e_kind						kind;
+	unsigned long long			id;      // READ: lectura de ServerManager::_file_reads; FASTCGI: requestId
+	std::string					path;    // OPEN, LIST; FASTCGI: socket del backend
+	int							fd;      // OPEN: abierto por el hilo (o -1); READ: a leer; FASTCGI: conexión
+	char						*buf;    // READ: destino de 'size' bytes desde el offset 0
+	size_t						size;
+	size_t						done;    // READ: bytes leídos (llega con los que el bucle ya copió)
+	int							err;     // errno del fallo, 0 si no hubo
+	bool						found;   // OPEN, LIST: stat() encontró la ruta; FASTCGI: END_REQUEST correcto
+	struct stat					st;
+	std::vector<std::string>	entries; // LIST
+	std::string					data;    // FASTCGI: registros a enviar
+	std::string					output;  // FASTCGI: FCGI_STDOUT
+	std::string					errors;  // FASTCGI: FCGI_STDERR (se registra en el bucle)
+	bool						pooled;  // FASTCGI: la conexión venía del pool (puede estar cerrada)
+	unsigned long long			started; // FASTCGI: Metrics::now() al pedir la conexión
+
+	IoJob();
+};
+
+/**
+ * Hilos que hacen stat(), open(), pread() y readdir() para que el bucle de
+ * eventos solo toque sockets: un disco lento (NFS, caché fría) retrasa la
+ * petición que lo necesita, no a todas las conexiones.
+ *
+ * El bucle publica los trabajos en una cola sin cerrojos (anillo acotado
+ * de Vyukov, con los builtins atómicos de GCC) y despierta a un hilo con
+ * un semáforo; los terminados vuelven por otro anillo igual y un eventfd,
+ * que el bucle vigila como cualquier otro descriptor. Solo el bucle llama
+ * a submit() y completed(): nunca hay más de IO_POOL_QUEUE trabajos en
+ * curso, así que los hilos siempre tienen sitio para devolverlos.
+ */
+class IoPool
+{
+	private:
+		struct Ring {
+			struct Cell {
+				size_t	seq;
+				IoJob	*job;
+			};
+			Cell	cells[IO_POOL_QUEUE];
+			size_t	head;
+			size_t	tail;
+
+			Ring();
+			bool	push(IoJob *job);
+			IoJob	*pop();
+		};
+
+		std::vector<pthread_t>	_threads;
+		Ring					_submitted;
+		Ring					_finished;
+		sem_t					_ready;     // un post por trabajo publicado
+		int						_event_fd;  // los hilos avisan de lo terminado
+		size_t					_in_flight; // solo lo toca el bucle
+		int						_stopping;
+
+		IoPool(const IoPool &other);
+		IoPool &operator=(const IoPool &other);
+
+		static void	*_worker(void *arg);
+
+	public:
+		IoPool();
+		~IoPool();
+
+		bool		start(size_t threads);
+		size_t		threads() const;
+		int			fd() const;
+		bool		submit(IoJob *job);
+		IoJob		*completed();
+		void		ack();
+
+		static void	run(IoJob &job);
+};
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef IOURING_HPP
+#define IOURING_HPP
+
+#include "WebServ.hpp"
+#include <linux/io_uring.h>
+
+# define URING_ENTRIES 256       // SQEs del anillo; la CQ tiene el cuádruple
+# define URING_BUFFERS 256       // buffers del grupo para recv (potencia de 2)
+# define URING_BUFFER_SIZE 8192
+# define URING_BUFFER_GROUP 0
+# define URING_DRAIN_MS 1000     // espera máxima a las operaciones en curso al cerrar
+
+/**
+ * io_uring sobre las llamadas al sistema, sin liburing. Las operaciones se
+ * preparan en la SQ y se envían todas juntas en submitAndWait(), que en la
+ * misma llamada espera la primera finalización; después next() recorre la
+ * CQ. Los recv toman buffers de un grupo registrado (IORING_REGISTER_PBUF_RING)
+ * que se devuelven con recycle() tras consumirlos.
+ *
+ * init() falla si el kernel no ofrece algo de lo que se usa (accept
+ * multishot y buffer rings: Linux 5.19); entonces se sigue con select().
+ */
+class IoUring
+{
+	public:
+		struct Completion {
+			unsigned long long	data;
+			int					res;
+			unsigned			flags;
+		};
+
+	private:
+		int						_fd;
+		void					*_ring;
+		size_t					_ring_size;
+		struct io_uring_sqe		*_sqes;
+		size_t					_sqes_size;
+		unsigned				*_sq_head;
+		unsigned				*_sq_tail;
+		unsigned				_sq_mask;
+		unsigned				*_sq_array;
+		unsigned				_sq_entries;
+		unsigned				_sq_local_tail; // preparados, aún no publicados
+		unsigned				*_cq_head;
+		unsigned				*_cq_tail;
+		unsigned				_cq_mask;
+		struct io_uring_cqe		*_cqes;
+		struct io_uring_buf_ring	*_buf_ring;
+		char					*_buffers;
+		unsigned short			_buf_tail;
+		size_t					_in_flight;     // operaciones sin su última CQE
+
+		IoUring(const IoUring &other);
+		IoUring &operator=(const IoUring &other);
+
+		bool					_probe();
+		bool					_setup_buffers();
+		struct io_uring_sqe		*_get_sqe();
+		int						_enter(unsigned to_submit, unsigned min_complete, unsigned flags,
+										const struct timespec *timeout);
+		void					_add_buffer(unsigned short bid);
+
+	public:
+		IoUring();
+		~IoUring();
+
+		bool		init();
+		void		accept(int listen_fd, unsigned long long data);
+		void		recv(int fd, unsigned long long data);
+		void		writev(int fd, const struct iovec *iov, int count, unsigned long long data);
+		void		read(int fd, void *buf, size_t len, size_t offset, unsigned long long data);
+		void		pollIn(int fd, unsigned long long data);
+		void		cancel(unsigned long long target, unsigned long long data);
+		void		close(int fd, unsigned long long data);
+
+		int			submitAndWait(int timeout_ms);
+		bool		next(Completion &c);
+		const char	*buffer(unsigned flags) const;
+		void		recycle(unsigned flags);
+		void		drain(unsigned long long data);
+		size_t		inFlight() const;
+};
+
+#endif
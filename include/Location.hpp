@@ -6,6 +6,7 @@
 #define ERR_ROOT_ALIAS "Error: Alias and Root cannot coexist in the same location"
 #define ERR_ROOT_LOCATION "Error: Root must be a valid directory"
 #define ERR_SUPPORT_METHOD "Error: Allow Method not Supported "
+#define ERR_FASTCGI_NUMBER "Error: FastCGI value must be a positive number"
 
 class Location
 {
@@ -19,6 +20,12 @@ class Location
 		std::string							_alias;
 		unsigned long						_client_max_body_size;
 		std::map<std::string, std::string>	_cgi_ext_map; // map extension -> cgi path
+		std::string							_fastcgi_pass; // unix socket del backend FastCGI
+		size_t								_fastcgi_pool; // conexiones ociosas a conservar
+		size_t								_fastcgi_queue; // peticiones en curso antes de 503
+		std::string							_fastcgi_spawn; // ejecutable a lanzar como workers
+		size_t								_fastcgi_workers;
+		bool									_status; // sirve las métricas del servidor (Metrics)
 
 	public:
 		Location();
@@ -36,6 +43,11 @@ class Location
 		void                                        setAlias(std::string token);
 		void                                        setMaxBodySize(std::string token);
 		void                                        setMaxBodySize(unsigned long token);
+		void                                        setFastCgiPass(std::string token);
+		void                                        setFastCgiPool(std::string token);
+		void                                        setFastCgiQueue(std::string token);
+		void                                        setFastCgiSpawn(std::string exec, std::string workers);
+		void                                        setStatus(std::string token);
 
 		const std::string                           &getPathLocation() const;
 		const std::string                           &getRootLocation() const;
@@ -47,6 +59,12 @@ class Location
 		const std::map<std::string, std::string>    &getCgiExtMap() const;
 		const unsigned long                         &getMaxBodySize() const;
 		std::string                                 getPrintMethods() const;
+		const std::string                           &getFastCgiPass() const;
+		const size_t                                &getFastCgiPool() const;
+		const size_t                                &getFastCgiQueue() const;
+		const std::string                           &getFastCgiSpawn() const;
+		const size_t                                &getFastCgiWorkers() const;
+		const bool                                  &getStatus() const;
 
 		void addCgiHandler(const std::string &ext, const std::string &path);
 		const std::string &getCgiHandler(const std::string &ext) const;
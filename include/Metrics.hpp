@@ -0,0 +1,101 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include "WebServ.hpp"
+
+# define HIST_SUB_BITS 5                       // 32 sub-buckets por potencia de 2: error < 3.2 %
+# define HIST_MAX_EXP 30                       // hasta 2^36 us (~19 h)
+# define HIST_BUCKETS ((HIST_MAX_EXP + 2) << HIST_SUB_BITS)
+# define METRICS_STATUS_MIN 100
+# define METRICS_STATUS_MAX 599
+# define METRICS_METHODS 6                     // e_methods + "OTHER"
+
+/**
+ * Histograma log-lineal al estilo HDR: cada potencia de 2 se divide en
+ * 2^HIST_SUB_BITS cubos iguales, así el error relativo es constante desde
+ * microsegundos hasta horas con un array fijo. record() es una suma
+ * atómica, sin locks ni reservas.
+ */
+class LatencyHistogram
+{
+	private:
+		unsigned long long	_counts[HIST_BUCKETS];
+		unsigned long long	_count;
+		unsigned long long	_sum;
+		unsigned long long	_max;
+
+		static size_t				_index(unsigned long long value);
+		static unsigned long long	_upper(size_t index);
+
+	public:
+		LatencyHistogram();
+
+		void				record(unsigned long long usec);
+		unsigned long long	count() const;
+		unsigned long long	sum() const;
+		unsigned long long	percentile(double q) const;
+		unsigned long long	countAtMost(unsigned long long usec) const;
+};
+
+/**
+ * Contadores del servidor expuestos en formato de texto de Prometheus por
+ * las locations con `status on;`. Todo es estático (como Scanner o
+ * FastCgiPool) para que Cgi y FastCgiPool registren sin recibir nada; los
+ * contadores se actualizan con sumas atómicas.
+ */
+class Metrics
+{
+	private:
+		static unsigned long long	_connections_active;
+		static unsigned long long	_connections_total;
+		static unsigned long long	_bytes_in;
+		static unsigned long long	_bytes_out;
+		static unsigned long long	_requests[METRICS_METHODS][METRICS_STATUS_MAX - METRICS_STATUS_MIN + 1];
+		static unsigned long long	_cgi_spawns[2];
+		static unsigned long long	_cgi_failures[2];
+		static unsigned long long	_accept_failures;
+		static unsigned long long	_socket_writes;
+		static unsigned long long	_socket_short_writes;
+		static unsigned long long	_socket_corked_writes;
+		static unsigned long long	_tcp_retransmits;
+		static unsigned long long	_tcp_fastopen;
+		static LatencyHistogram		_tcp_rtt;
+		static const char			*_io_backend;
+		static unsigned long long	_uring_enters;
+		static unsigned long long	_uring_sqes;
+		static std::map<std::string, unsigned long long>	_cache_hits;
+		static std::map<std::string, unsigned long long>	_cache_misses;
+		static std::map<std::string, LatencyHistogram*>		_latency; // por server
+		static LatencyHistogram		_cgi_latency[2];
+		static time_t				_started;
+
+		static void		_render_histogram(std::ostringstream &out, const char *name,
+										const std::string &labels, const LatencyHistogram &h);
+		static void		_render_listen_overflows(std::ostringstream &out);
+
+		Metrics();
+
+	public:
+		enum e_cgi_kind { CGI_FORK = 0, CGI_FASTCGI };
+
+		static unsigned long long	now();
+
+		static void		connectionOpened();
+		static void		connectionClosed();
+		static void		acceptFailed();
+		static void		bytesIn(size_t n);
+		static void		bytesOut(size_t n);
+		static void		socketWrite(bool short_write, bool corked);
+		static void		tcpInfo(unsigned long long rtt_usec, unsigned long long retransmits, bool syn_data);
+		static void		ioBackend(const char *name);
+		static void		ioUringEnter(unsigned submitted);
+		static void		request(const std::string &server, const std::string &method,
+								int status, unsigned long long usec);
+		static void		cgiSpawned(e_cgi_kind kind);
+		static void		cgiFinished(e_cgi_kind kind, unsigned long long usec, bool ok);
+		static void		cacheLookup(const std::string &cache, bool hit);
+
+		static std::string	render();
+};
+
+#endif
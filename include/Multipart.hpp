@@ -0,0 +1,63 @@
+#ifndef MULTIPART_HPP
+#define MULTIPART_HPP
+
+#include "WebServ.hpp"
+
+# define MULTIPART_MAX_HEADERS 8192 // tamaño máximo de las cabeceras de cada parte
+
+enum e_multipart_state {
+	MP_BODY = 0,         // datos de una parte (o preámbulo) hasta el delimitador
+	MP_AFTER_BOUNDARY,   // "--" (fin) o CRLF (nueva parte) tras el delimitador
+	MP_HEADERS,          // cabeceras de la parte hasta CRLFCRLF
+	MP_DONE,
+	MP_ERROR
+};
+
+/**
+ * Parser incremental de multipart/form-data.
+ * Recibe el cuerpo trozo a trozo (tal y como llega del socket) y escribe
+ * las partes con `filename` directamente en `upload_dir`. La memoria usada
+ * está acotada por la longitud del delimitador y MULTIPART_MAX_HEADERS.
+ * El delimitador se busca con Boyer-Moore-Horspool.
+ */
+class MultipartParser
+{
+	private:
+		std::string					_delimiter;   // "\r\n--" + boundary
+		size_t						_skip[256];   // tabla de saltos BMH
+		std::string					_upload_dir;
+		int							_state;
+		std::string					_carry;       // cola que puede ser prefijo del delimitador
+		std::string					_headers;
+		int							_fd;
+		std::string					_tmp_path;
+		std::string					_final_path;
+		std::vector<std::string>	_saved;
+
+		size_t	_find_delimiter(const char *hay, size_t len) const;
+		size_t	_consume_body(const char *data, size_t len);
+		size_t	_consume_after_boundary(const char *data, size_t len);
+		size_t	_consume_headers(const char *data, size_t len);
+		bool	_open_part(const std::string &headers);
+		void	_write(const char *data, size_t len);
+		void	_end_part();
+		void	_boundary_found();
+		void	_abort_part();
+
+		MultipartParser();
+		MultipartParser(const MultipartParser &);
+		MultipartParser &operator=(const MultipartParser &);
+
+	public:
+		MultipartParser(const std::string &boundary, const std::string &upload_dir);
+		~MultipartParser();
+
+		bool								feed(const char *data, size_t len);
+		bool								finished() const;
+		bool								failed() const;
+		const std::vector<std::string>		&savedFiles() const;
+
+		static std::string					boundaryFromContentType(const std::string &content_type);
+};
+
+#endif
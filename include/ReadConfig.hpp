@@ -16,6 +16,10 @@
 #define HOST_ERR "Error: Host is Duplicated"
 #define ROOT_ERR "Error: Root is Duplicated"
 #define CLIENT_ERR "Error: Client_max_body_size is Duplicated"
+#define KEEPALIVE_ERR "Error: Keepalive_requests is Duplicated"
+#define BACKLOG_ERR "Error: Backlog is Duplicated"
+#define DEFER_ACCEPT_ERR "Error: Defer_accept is Duplicated"
+#define SOCKET_OPT_ERR "Error: Socket Option is Duplicated: "
 #define SERVER_NAME_ERR "Error: Server Name is Duplicated"
 #define INDEX_ERR "Error: Index is Duplicated"
 #define AUTOINDEX_ERR "Error: Autoindex error"
@@ -27,11 +31,27 @@
 
 class ServerUnit;
 
+/** Posición (1-based) de un token en el fichero, para los mensajes de error. */
+struct ConfigPos {
+	unsigned	line;
+	unsigned	column;
+};
+
+/**
+ * Lee el fichero de configuración en una sola pasada: tokenize() separa
+ * palabras, '{' y '}' (los comentarios '#' se saltan ahí mismo) y guarda
+ * la línea y columna de cada token; splitServers() marca cada bloque
+ * server {...} por índices, sin copiar el texto, y createServer() recorre
+ * sus tokens. Un error de una directiva indica la posición donde empieza.
+ */
 class ReadConfig {
 	private:
 		std::vector<ServerUnit>	_servers;
-		std::vector<std::string>	_server_config;
+		std::vector<std::string>	_tokens;
+		std::vector<ConfigPos>		_positions;     // en paralelo a _tokens
+		std::vector<std::pair<size_t, size_t> >	_server_blocks; // índices de '{' y '}'
 		size_t						_nb_server;
+		size_t						_at;            // token de la directiva en curso
 
 	public:
 
@@ -39,12 +59,9 @@ class ReadConfig {
 		~ReadConfig();
 
 		int                         createServerGroup(const std::string &config_file);
-		void                        splitServers(std::string &content);
-		void                        removeComments(std::string &content);
-		void                        removeWhiteSpace(std::string &content);
-		size_t                      findStartServer(size_t start, std::string &content);
-		size_t                      findEndServer(size_t start, std::string &content);
-		void                        createServer(std::string &config, ServerUnit &server);
+		void                        tokenize(const std::string &content);
+		void                        splitServers();
+		void                        createServer(size_t begin, size_t end, ServerUnit &server);
 		void                        checkServers();
 		std::vector<ServerUnit>			getServers();
 
@@ -58,6 +75,13 @@ class ReadConfig {
 				{
 					_message = READ_CONFIG_ERR + message;
 				}
+				// message ya completo (what() del error original) + posición
+				ErrorException(std::string message, const ConfigPos &at) throw()
+				{
+					std::ostringstream out;
+					out << message << " (line " << at.line << ", column " << at.column << ")";
+					_message = out.str();
+				}
 				virtual const char* what() const throw()
 				{
 					return (_message.c_str());
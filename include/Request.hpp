@@ -3,29 +3,50 @@
 
 #include "WebServ.hpp"
 
+# define REQUEST_INITIAL_FIELDS 16
+
+/**
+ * Cabecera tal y como llega: nombre y valor apuntan al buffer crudo de la
+ * petición, sin copias. El array que las contiene vive en la Arena.
+ * Las desconocidas (id == H_UNKNOWN) también se guardan, p.ej. para CGI.
+ */
+struct HeaderField {
+	StrRef		name;
+	StrRef		value;
+	e_header_id	id;
+};
+
 class Request
 {
 	private:
 		std::string									_method;
 		std::string									_version;
-		std::map<std::string, std::string>			_headers;
+		HeaderField*								_fields;   // array en la arena
+		size_t										_nfields;
+		size_t										_fields_cap;
+		int											_known[H_COUNT]; // id -> índice en _fields, -1 si no está
+		Arena*										_arena;
+		Arena*										_own_arena; // solo si no nos pasan una
 		int											_ret; // return number?
 		std::string									_body;
+		int											_body_fd; // cuerpo ya en un fichero (recibido con splice), -1 si está en _body
 		int											_port;
 		std::string									_path;
 		std::string									_query;
 		std::list<std::pair<std::string, float> >	_lang;
 		const std::string&							_raw;
 		bool										_autoindex; // to generate index (file list) if no index file found. False by default.
-		const Location*								_matched_location; // best matching location for this request
+		const CompiledLocation*						_matched_location; // best matching location for this request (del ConfigSnapshot)
+		std::string									_root; // root (o alias) efectivo tras resolver la ruta
 
 		/*** PARSING ***/
-		int			read_first_line(const std::string& line);
-		int			readPath(const std::string& line, size_t i);
-		int			readVersion(const std::string& line, size_t i);
+		int			read_first_line(const StrRef& line);
+		int			readPath(const StrRef& line, size_t i);
+		int			readVersion(const StrRef& line, size_t i);
 		int			checkMethod();
 		int			checkPort();
-		std::string	nextLine(const std::string &str, size_t& i);
+		StrRef		nextLine(const StrRef &str, size_t& i);
+		void		addHeader(const StrRef& name, const StrRef& value);
 		void		setLang();
 
 
@@ -37,31 +58,41 @@ class Request
 		Request(const Request&);
 
 	public:
-		Request(const std::string& str);
+		Request(const std::string& str, Arena *arena = NULL);
 		~Request();
 		Request&	operator=(const Request&);
 
 		/*** GETTERS ***/
-		const std::map<std::string, std::string>&			getHeaders() const;
+		StrRef												getHeader(e_header_id id) const;
+		StrRef												getHeader(const char *name) const;
+		bool												hasHeader(e_header_id id) const;
+		bool												hasHeader(const char *name) const;
+		size_t												getHeaderCount() const;
+		const HeaderField&									getHeaderField(size_t i) const;
+		Arena&												getArena() const;
 		const std::string&									getMethod() const;
 		const std::string&									getVersion() const;
 		int													getRet() const;
 		const std::string&									getBody() const;
+		int													getBodyFile() const;
 		int													getPort() const;
 		const std::string&									getPath() const;
 		const std::string&									getQuery() const;
 		const std::string&									getRaw() const;
 		const std::list<std::pair<std::string, float> >&	getLang() const;
 		const bool&											getAutoindex() const;
-		const Location*										getMatchedLocation() const;
+		const CompiledLocation*								getMatchedLocation() const;
+		const std::string&									getRoot() const;
 
 		/*** SETTERS **/
-		void	setBody(const std::string& line);
+		void	setBody(const StrRef& line);
+		void	setBodyFile(int fd);
 		void	setRet(int);
 		void	setMethod(const std::string &method);
 		void	setPath(const std::string &new_path);
 		void	setAutoindex(bool ai);
-		void	setMatchedLocation(const Location *loc);
+		void	setMatchedLocation(const CompiledLocation *loc);
+		void	setRoot(const std::string &root);
 
 		/*** UTILS ****/
 		int		parse(const std::string& str);
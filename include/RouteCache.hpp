@@ -0,0 +1,76 @@
+#ifndef ROUTECACHE_HPP
+#define ROUTECACHE_HPP
+
+#include "WebServ.hpp"
+
+# define ROUTE_CACHE_MAX 1024 // entradas por configuración (server, método, ruta)
+
+struct CompiledLocation;
+
+/**
+ * Resultado de resolver una petición contra la configuración: la ruta en
+ * disco y lo que la acompaña o, si la petición no llega a un fichero, la
+ * respuesta 3xx/4xx que le toca.
+ */
+struct ResolvedRoute {
+	int						status;     // 0: resuelta; si no, el código a responder
+	std::string				target;     // Location (3xx) o métodos permitidos (405)
+	const CompiledLocation	*location;
+	std::string				root;
+	std::string				path;       // ruta en disco (con el index ya aplicado)
+	bool					autoindex;  // directorio sin index: listar
+	bool					pending;    // FileCache tiene que mirar el disco: ni se cachea ni se responde
+
+	ResolvedRoute();
+};
+
+/**
+ * Caché de rutas resueltas por (server, método, ruta tal como llega). El
+ * tráfico real se concentra en unos cientos de URLs, así que la mayoría de
+ * peticiones se ahorran normalizar, buscar la location, concatenar root o
+ * alias y comprobar si es un directorio.
+ *
+ * Vive en el ConfigSnapshot, de modo que una recarga empieza con la caché
+ * vacía. Como la decisión de directorio/index mira el disco, una entrada
+ * caduca a los OPEN_FILE_CACHE_VALID segundos, igual que las de FileCache,
+ * y invalidate_path() (DELETE, subidas) vacía todas. Con ROUTE_CACHE_MAX
+ * entradas se expulsa la menos usada.
+ */
+class RouteCache
+{
+	private:
+		struct Key {
+			const ServerUnit	*server;
+			int					method;  // method_id()
+			std::string			path;
+
+			bool operator<(const Key &other) const;
+		};
+		struct Entry {
+			ResolvedRoute						route;
+			unsigned long long					valid_until; // Metrics::now()
+			std::list<const Key*>::iterator		lru;
+		};
+
+		std::map<Key, Entry>	_entries;
+		std::list<const Key*>	_lru;     // la más reciente delante
+		unsigned				_epoch;   // _fs_epoch al llenarse
+
+		static unsigned			_fs_epoch; // +1 por cada invalidate_path()
+		static bool				_hooked;
+
+		static void		_on_invalidate(const std::string &path);
+
+		RouteCache(const RouteCache &);
+		RouteCache &operator=(const RouteCache &);
+
+	public:
+		RouteCache();
+
+		const ResolvedRoute	*find(const ServerUnit *server, int method, const std::string &path);
+		const ResolvedRoute	&store(const ServerUnit *server, int method, const std::string &path,
+									const ResolvedRoute &route);
+		void				clear();
+};
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef SCANNER_HPP
+#define SCANNER_HPP
+
+#include "WebServ.hpp"
+
+enum e_scanner_impl {
+	SCAN_SCALAR = 0,
+	SCAN_SSE2,
+	SCAN_AVX2
+};
+
+/**
+ * Búsquedas de bytes del parser HTTP (CRLF, CRLFCRLF, ':'), vectorizadas.
+ * La implementación (AVX2, SSE2 o escalar) se elige una vez en tiempo de
+ * ejecución según la CPU; se puede forzar con WEBSERV_SCANNER=scalar|sse2|avx2.
+ */
+class Scanner
+{
+	private:
+		typedef size_t (*t_find_byte)(const char *p, size_t len, char c);
+		typedef size_t (*t_find_crlf)(const char *p, size_t len);
+
+		static t_find_byte		_find_byte;
+		static t_find_crlf		_find_crlf;
+		static e_scanner_impl	_impl;
+		static bool				_ready;
+
+		static void				_select();
+
+		Scanner();
+
+	public:
+		static size_t			findByte(const char *p, size_t len, char c);
+		static size_t			findCrlf(const char *p, size_t len);
+		static size_t			findHeaderEnd(const char *p, size_t len, size_t &resume);
+		static void				force(e_scanner_impl impl);
+		static e_scanner_impl	impl();
+		static const char		*implName();
+};
+
+#endif
@@ -6,6 +6,14 @@
 #include <stdexcept>
 
 # define CONNECTION_TIMEOUT 5
+# define MAX_PIPELINE 16    // peticiones atendidas de una vez por conexión
+# define WRITEV_MAX_IOV 64  // respuestas enviadas por writev()
+# define DRAIN_TIMEOUT 10   // segundos para terminar lo pendiente tras SIGTERM
+# define SPLICE_CHUNK (1 << 20) // cuerpo CGI movido con splice() por cada aviso de lectura
+# define ENV_LISTEN_FDS "WEBSERV_LISTEN_FDS" // sockets de escucha heredados
+# define ENV_READY_FD "WEBSERV_READY_FD"     // pipe para avisar al proceso viejo
+# define ENV_IO_BACKEND "WEBSERV_IO_BACKEND" // "select" para no usar io_uring
+# define ENV_IO_THREADS "WEBSERV_IO_THREADS" // hilos del IoPool; 0 para no usarlo
 
 class ServerUnit;
 
@@ -14,25 +22,62 @@ struct ClientRequest {
     size_t      max_size;     // límite efectivo (location o server); 0 = ilimitado
     size_t      current_size; // bytes totales recibidos (headers + body)
     long        content_length; // -1 si no hay Content-Length
-    bool        is_chunked;    // true si Transfer-Encoding: chunked
+    bool        is_chunked;    // true si Transfer-Encoding termina en chunked
+    bool        bad_framing;   // Content-Length inválido o junto a Transfer-Encoding: 400
+    size_t      chunk_pos;    // chunked: dónde retomar la decodificación en buffer
+    std::string chunk_data;   // chunked: datos ya decodificados
     size_t      header_end;   // posición de "\r\n\r\n" (fin de headers) en buffer
+    size_t      scan_pos;     // dónde retomar la búsqueda de "\r\n\r\n"
     size_t      body_start;   // header_end + 4
     std::string request_path; // para elegir location
     std::string method;       // GET/POST/DELETE...
+    std::string content_type; // para detectar multipart/form-data
     bool        headers_parsed;
+    bool        keep_alive;   // según versión HTTP y cabecera Connection
+    unsigned long long started; // Metrics::now() al llegar el primer byte
 
     ClientRequest();
     void append_to_buffer(const std::string& str);
+    int  dechunk_body();
+};
+
+/** Estado de un fd (conexión o socket de escucha) en el backend io_uring. */
+struct UringState {
+    unsigned     serial;     // distingue CQEs viejas cuando el fd se reutiliza
+    bool         recv_armed;
+    bool         polled;     // lo armado es un poll (cuerpo CGI con splice), no un recv
+    bool         send_busy;  // writev en curso: la cola no se puede tocar
+    bool         more;       // tcp_cork: tras este lote vienen más
+    bool         corked;
+    size_t       total;      // bytes del lote enviado
+    struct iovec iov[WRITEV_MAX_IOV];
+
+    UringState();
+};
+
+/** Cuerpo de un fichero estático que se está leyendo con io_uring o el IoPool. */
+struct FileRead {
+    int                 client;
+    int                 fd;
+    std::string         data;  // cabecera + cuerpo: sustituye a la respuesta encolada
+    size_t              head;  // longitud de la cabecera
+    size_t              done;  // bytes del cuerpo ya leídos
+    const std::string   *slot; // respuesta de _write_queue que espera este cuerpo
 };
 
 class ServerManager {
     private:
-        std::vector<ServerUnit>    _servers;
-        std::map<int,ServerUnit>   _servers_map;
+        ConfigSnapshot             *_config;       // configuración vigente
+        std::map<int, ConfigSnapshot*> _client_config; // la que usa cada conexión
+        std::map<int, std::pair<in_addr_t, int> > _listeners; // socket de escucha -> host:port
         std::map<int, int>          _client_server_map; // Buffer for incoming requests
+        std::string                 _config_path;
 
 
-        static bool _running;
+        static volatile sig_atomic_t _running;
+        static volatile sig_atomic_t _term_requested;    // SIGTERM: drenar y salir
+        static volatile sig_atomic_t _upgrade_requested; // SIGUSR2: lanzar binario nuevo
+        static volatile sig_atomic_t _reload_requested;  // SIGHUP: releer la configuración
         // select sets
         fd_set _read_fds;
         fd_set _write_fds;
@@ -40,58 +85,169 @@ class ServerManager {
 
         // Buffers
         std::map<int, ClientRequest> _read_requests;
-        std::map<int, std::string> _write_buffer;
-        std::map<int, size_t> _bytes_sent;
+        std::map<int, std::deque<std::string> > _write_queue; // respuestas en orden de llegada
+        std::map<int, size_t> _bytes_sent; // enviado de la primera respuesta de la cola
+        std::map<int, MultipartParser*> _uploads; // subidas multipart en streaming
+        std::map<int, int> _cgi_bodies; // cuerpo para un CGI que llega a un temporal con splice()
+        int _splice_pipe[2];            // pipe de paso socket -> fichero, vacío entre llamadas
+        std::map<int, Arena*> _arenas; // memoria de la petición en curso, por conexión
+        std::map<int, size_t> _served; // peticiones respondidas en la conexión
+        std::map<int, bool> _close_after; // cerrar al terminar de enviar la respuesta
+        std::map<int, bool> _corked; // TCP_CORK puesto (tcp_cork on)
+
+        // Apagado ordenado y cambio de binario
+        bool _draining;           // ya no se aceptan conexiones nuevas
+        time_t _drain_deadline;
+        char **_argv;             // para re-ejecutar el binario con SIGUSR2
+        std::string _exe_path;
+        pid_t _upgrade_pid;       // binario nuevo arrancando, -1 si ninguno
+        int _upgrade_fd;          // extremo de lectura del pipe de "listo"
+        std::map<std::pair<in_addr_t, int>, int> _inherited; // host:port -> fd heredado
+
+        // Backend io_uring (NULL: bucle con select)
+        IoUring *_uring;
+        unsigned _io_serial;
+        std::map<int, UringState> _uring_state;
+        std::set<int> _rearm; // conexiones que vuelven a leer
+        std::map<unsigned, std::deque<std::string> > _orphaned_sends; // cola de una conexión cerrada con writev en curso
+        std::map<unsigned long long, FileRead> _file_reads;
+        std::map<const std::string*, unsigned long long> _filling; // respuesta -> lectura que la completa
+        unsigned long long _file_read_seq;
+        int _body_fd;      // cuerpo en disco de la última respuesta (HttpResponse::releaseBodyFile)
+        size_t _body_size;
+
+        // Disco en hilos aparte (NULL: FileCache llama a stat/open en el bucle)
+        IoPool *_io_pool;
+        IoPool *_fcgi_pool; // intercambios FastCGI (NULL: se hacen en el bucle)
+        std::map<int, std::string> _parked; // conexión -> consulta de disco o FastCGI que espera
+        std::map<std::string, std::vector<int> > _lookups; // consulta en curso -> conexiones aparcadas
+        std::map<int, IoJob*> _fastcgi_done; // intercambio terminado de la petición aparcada, hasta que se repite
+        std::map<int, std::vector<std::string> > _pinned; // entradas de FileCache fijadas hasta responder (ver FileCache::pin)
 
 
         ServerManager(const ServerManager &other);
         ServerManager &operator=(const ServerManager &other);
 
-        void _init_server_unit(ServerUnit &server);
+        void _bind_servers(std::vector<ServerUnit> &servers, std::vector<int> &opened);
+        void _init_listener(int fd, const std::vector<ServerUnit> &servers);
+        void _close_listener(int fd);
+        void _reload();
+        const ServerUnit *_server_for(int client_sock) const;
+        const ConfigSnapshot *_config_for(int client_sock) const;
+        void _refresh_config(int client_sock);
+        void _setup_fastcgi(const ServerUnit &server);
+        void _load_inherited_fds();
+        bool _adopt_inherited_fd(ServerUnit &server);
+        void _notify_ready();
         int _get_client_server_fd(int client_socket) const;
         bool parse_headers(int client_sock, ClientRequest &cr);
+        void _parse_connection_header(const StrRef &value, ClientRequest &cr);
         bool _try_drain_and_adjust_response(int client_socket, std::string &response_str);
         bool _drain_request_body(int client_sock, ClientRequest &cr);
+        void _start_native_upload(int client_sock, ClientRequest &cr);
+        std::string _finish_native_upload(int client_sock);
+        void _drop_native_upload(int client_sock);
+        void _start_cgi_body(int client_sock, ClientRequest &cr);
+        void _splice_cgi_body(int client_sock);
+        bool _flush_splice_pipe(int fd, size_t len);
+        void _drop_cgi_body(int client_sock);
 
         
-        void resolve_path(Request &request, int client_socket);
-        const Location* _find_best_location(const std::string& request_path, const std::vector<Location> &locations) const;
-        void _apply_location_config(
-            const Location *loc,
+        const ResolvedRoute *resolve_path(Request &request, int client_socket);
+        void _resolve_route(const ConfigSnapshot *config, const ServerUnit *srv,
+                            const std::string &request_path, const std::string &method,
+                            ResolvedRoute &route);
+        bool _apply_location_config(
+            const CompiledLocation *loc,
             std::string &root,
             std::string &index,
             bool &autoindex,
             std::string &full_path,
             const std::string &request_path,
             const std::string &request_method,
-            bool &used_alias
+            bool &used_alias,
+            ResolvedRoute &route
         );
-        void _handle_directory_case(
+        bool _handle_directory_case(
             std::string &full_path,
             const std::string &request_path,
             const std::string &index,
             bool autoindex,
-            Request &request
+            ResolvedRoute &route
         );
-        void _apply_redirection(const Location *loc);
+        bool _apply_redirection(const CompiledLocation *loc, ResolvedRoute &route);
 
 
         std::string prepare_response(int client_socket, const std::string& request);
         std::string prepare_error_response(int client_socket, int code);
+        std::string _route_response(int client_socket, const ResolvedRoute &route);
+        std::string _redirect_response(int client_socket, int code, const std::string &location);
+        std::string _fastcgi_response(int client_socket, IoJob *job);
+        std::string _not_allowed_response(int client_socket, const std::string &methods);
+        std::string _finalize_response(int client_socket, HttpResponse &response);
+        std::string _finalize_canned(int client_socket, const CannedResponse &response);
+        std::string _close_with_error(int client_socket, int code);
+        bool _keep_alive_allowed(int client_socket);
         
         
         static void _handle_signal(int signal);
+        void _handle_pending_signals();
+        void _begin_drain();
+        bool _drain_finished();
+        bool _close_if_idle(int client_sock);
+        void _start_upgrade();
+        void _handle_upgrade_ready();
+        void _close_all();
+        void _select_backend();
+        void _run_select();
+        void _run_uring();
+        void _rearm_reads();
+        void _handle_completion(const IoUring::Completion &c);
+        void _on_accept(int listening_socket, const IoUring::Completion &c);
+        void _on_recv(int client_sock, const IoUring::Completion &c);
+        void _on_send(int client_sock, int res);
+        void _on_file_read(unsigned long long id, long res);
+        void _fail_file_read(int client_sock, std::string *slot);
+        void _read_body_async(int client_sock);
+        void _submit_send(int client_sock);
+        void _watch_pool(IoPool *pool);
+        void _start_fastcgi_pool();
+        void _on_io_complete(IoPool *pool);
+        void _io_submit(IoJob *job);
+        void _io_done(IoJob *job);
+        void _hold_request(int client_sock, ClientRequest &cr, const std::string &next);
+        void _park(int client_sock, const FileCache::Pending &pending);
+        void _park(int client_sock, const FastCgiPool::Pending &pending);
+        void _resume(const std::string &key);
+        void _unpin(int client_sock);
+        void _uring_forget(int client_sock);
+        void _watch_listener(int fd);
+        void _unwatch_listener(int fd);
+        void _want_read(int client_sock);
+        void _want_write(int client_sock);
         void _handle_new_connection(int listening_socket);
+        void _register_client(int client_sock, int listening_socket);
+        void _apply_listener_options(int fd, const std::vector<ServerUnit> &servers);
+        void _apply_client_options(int client_sock, const SocketOptions &opts);
         void _handle_read(int client_sock);
+        void _on_received(int client_sock, const char *data, ssize_t n);
         void _handle_write(int client_sock);
+        int _fill_iov(int client_sock, struct iovec *iov, size_t &total);
+        void _on_written(int client_sock, ssize_t n, size_t total, bool was_corked);
+        void _process_requests(int client_sock);
+        void _queue_response(int client_sock, const std::string &response);
+        bool _more_responses_pending(int client_sock, int batch);
+        bool _set_cork(int client_sock, bool on);
+        void _record_response(int client_sock, const std::string &response);
         void _cleanup_client(int client_sock);
         bool _request_complete(const ClientRequest& clrequest);
-        bool _should_close_connection(const std::string& request, const std::string& response);
 
     public:
         ServerManager();
         ~ServerManager();
 
+        void setCommandLine(char **argv);
+        void setConfigPath(const std::string &path);
         void setup(const std::vector<ServerUnit>& servers);
         void init();
 };
@@ -11,6 +11,12 @@
 #define SYNTAX_ERR_INDEX "Syntax Error: index"
 #define SYNTAX_ERR_CGI_EXT "Syntax Error: cgi extension must start with . "
 #define SYNTAX_ERR_CGI_PATH "Syntax Error: cgi path must start with ./"
+#define SYNTAX_ERR_FASTCGI_PASS "Syntax Error: fastcgi_pass"
+#define SYNTAX_ERR_KEEPALIVE "Syntax Error: keepalive_requests"
+#define SYNTAX_ERR_BACKLOG "Syntax Error: backlog"
+#define SYNTAX_ERR_DEFER_ACCEPT "Syntax Error: defer_accept"
+#define SYNTAX_ERR_SOCKET_OPT "Syntax Error: "
+#define SYNTAX_ERR_STATUS "Syntax Error: status"
 #define TOKEN_ERR "Error: Invalid Token"
 #define PAGE_ERR_INIT "Error: Page Initialization Failed"
 #define PAGE_ERR_CODE "Error: Code is Invalid"
@@ -27,6 +33,9 @@
 #define CMBS_DUP_ERR "Error: Client Max Body Size of Location is Duplicated"
 #define INVLAID_CGI_ERR "Error: cgi_path is Invalid"
 #define CGI_EXT_DUP_ERR "Error: cgi is Duplicated"
+#define FASTCGI_DUP_ERR "Error: fastcgi directive is Duplicated"
+#define STATUS_DUP_ERR "Error: status of Location is Duplicated"
+#define FASTCGI_SPAWN_ERR "Error: fastcgi_spawn requires fastcgi_pass"
 #define CGI_ERR_VALIDATION "Failed CGI Validation"
 #define LOCATION_ERR_VALIDATION "Failed Location Validation"
 #define REDIRECTION_ERR_VALIDATION "Failed Redirection Validation"
@@ -53,9 +62,40 @@
 #define CGI "cgi" // directive: cgi extension ./cgi_path;
 #define CGI_BIN_PATH "/cgi-bin"
 #define CMBS "client_max_body_size"
+#define FASTCGI_PASS "fastcgi_pass"     // directive: fastcgi_pass unix:/path.sock;
+#define FASTCGI_POOL "fastcgi_pool"     // directive: fastcgi_pool <idle_conns>;
+#define FASTCGI_QUEUE "fastcgi_queue"   // directive: fastcgi_queue <max_in_flight>;
+#define FASTCGI_SPAWN "fastcgi_spawn"   // directive: fastcgi_spawn ./exec <workers>;
+#define KEEPALIVE_REQUESTS "keepalive_requests" // directive: keepalive_requests <n>;
+#define STATUS "status"             // directive: status on; (métricas de Prometheus)
+#define DEFAULT_KEEPALIVE_REQUESTS 1000
+#define BACKLOG "backlog"           // directive: backlog <n>;
+#define DEFER_ACCEPT "defer_accept" // directive: defer_accept <segundos>; (TCP_DEFER_ACCEPT)
+#define TCP_NODELAY_DIRECTIVE "tcp_nodelay" // directive: tcp_nodelay on|off;
+#define TCP_CORK_DIRECTIVE "tcp_cork"       // directive: tcp_cork on|off; (TCP_CORK entre lotes de respuestas)
+#define SNDBUF "sndbuf"                     // directive: sndbuf <bytes>[k|m];
+#define RCVBUF "rcvbuf"                     // directive: rcvbuf <bytes>[k|m];
+#define FASTOPEN "fastopen"                 // directive: fastopen <cola>; (TCP_FASTOPEN)
 
 class Location;
 
+/**
+ * Opciones TCP de un server. TCP_FASTOPEN y SO_RCVBUF se fijan en el socket
+ * de escucha (las conexiones aceptadas heredan el buffer, con la escala de
+ * ventana ya negociada); TCP_NODELAY y SO_SNDBUF en cada conexión al
+ * aceptarla; tcp_cork decide si _handle_write mantiene TCP_CORK entre
+ * lotes de respuestas encadenadas y lo retira tras el último.
+ */
+struct SocketOptions {
+	bool	tcp_nodelay;
+	bool	tcp_cork;
+	int		sndbuf;   // 0 = valor del sistema
+	int		rcvbuf;
+	int		fastopen; // longitud de la cola TFO, 0 = desactivado
+
+	SocketOptions();
+};
+
 enum e_err_validation {
 	ER_VAL_CGI = 1,
 	ER_VAL_LOCATION = 2,
@@ -74,6 +114,10 @@ class ServerUnit
 		std::string						_server_name;
 		std::string						_root;
 		unsigned long					_client_max_body_size;
+		size_t							_keepalive_requests; // peticiones por conexión antes de cerrarla
+		int								_backlog;      // cola de conexiones pendientes de accept()
+		int								_defer_accept; // segundos de TCP_DEFER_ACCEPT, 0 = desactivado
+		SocketOptions					_socket_options;
 		std::string						_index;
 		bool							_autoindex;
 		std::map<short, std::string>	_error_list;
@@ -96,22 +140,31 @@ class ServerUnit
 		void                                    		setIndex(std::string index);
 		void                                    		setLocation(std::string nameLocation, std::vector<std::string> token);
 		void                                    		setAutoindex(std::string autoindex);
+		void                                    		setKeepaliveRequests(std::string token);
+		void                                    		setBacklog(std::string token);
+		void                                    		setDeferAccept(std::string token);
+		void                                    		setSocketOption(const std::string &directive, std::string token);
+		static bool                             		isSocketOption(const std::string &directive);
 
 		bool                                    		isValidHost(std::string host) const;
 		bool                                    		isValidErrorPages();
 		int                                     		isValidLocation(Location &location) const;
 
-		const std::string                       		&getServerName();
+		const std::string                       		&getServerName() const;
 		const uint16_t  								&getPort() const;
 		const in_addr_t									&getHost() const;
-		const size_t                            		&getClientMaxBodySize(); 
-		const std::string                       		&getRoot(); 
-		const std::vector<Location>       				&getLocations();
-		const std::map<short, std::string>      		&getErrorPages();
-		const std::string                       		&getIndexFiles();
-		const std::string								&getIndex();
-		const bool                              		&getAutoindex(); 
-		const std::string                       		&getPathErrorPage(short key); 
+		const size_t                            		&getClientMaxBodySize() const; 
+		const std::string                       		&getRoot() const; 
+		const std::vector<Location>       				&getLocations() const;
+		const std::map<short, std::string>      		&getErrorPages() const;
+		const std::string                       		&getIndexFiles() const;
+		const std::string								&getIndex() const;
+		const bool                              		&getAutoindex() const; 
+		size_t											getKeepaliveRequests() const;
+		int												getBacklog() const;
+		int												getDeferAccept() const;
+		const SocketOptions								&getSocketOptions() const;
+		const std::string                       		&getPathErrorPage(short key) const; 
 		const std::vector<Location>::iterator			getLocationKey(std::string key);
 
 		int               								getFd() const;
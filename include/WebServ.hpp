@@ -28,6 +28,7 @@
 #include <algorithm>
 #include <iterator>
 #include <list>
+#include <deque>
 
 # include <sys/types.h>
 # include <sys/wait.h>
@@ -37,7 +38,9 @@
 # include <signal.h>
 
 # include <sys/socket.h>
+# include <sys/uio.h>
 # include <netinet/in.h>
+# include <netinet/tcp.h>
 # include <sys/select.h>
 # include <arpa/inet.h>
 
@@ -48,10 +51,22 @@
 #include "Location.hpp"
 #include "ConfigFile.hpp"
 #include "ReadConfig.hpp"
+#include "Arena.hpp"
+#include "CannedResponse.hpp"
+#include "RouteCache.hpp"
+#include "ConfigSnapshot.hpp"
 #include "utils.hpp"
+#include "Scanner.hpp"
+#include "HeaderIndex.hpp"
 #include "Request.hpp"
 #include "HttpResponse.hpp"
 #include "Cgi.hpp"
+#include "FastCgi.hpp"
+#include "Multipart.hpp"
+#include "Metrics.hpp"
+#include "FileCache.hpp"
+#include "IoPool.hpp"
+#include "IoUring.hpp"
 #include "ServerManager.hpp"
 #include "Cgi.hpp"
 
@@ -62,7 +77,7 @@
 # define MAX_CONTENT_LENGTH 30000000
 # define USAGE "Usage: ./webserv [config_file]"
 # define BUFFER_SIZE  1024
-# define BACKLOG_SIZE 10
+# define BACKLOG_SIZE 511 // cola de accept() por defecto (como Nginx); directiva backlog
 
 # define DEFAULT_CONFIG_FILE "config/default.config"
 
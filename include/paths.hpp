@@ -12,11 +12,18 @@ const std::string DEFAULT_INDEX = WWW_ROOT + "index.html";
 // WIP
 // Carpeta para scripts CGI
 const std::string CGI_BIN = "cgi-bin/";
-// Carpeta para uploads
-//const std::string UPLOADS_DIR = WWW_ROOT + "uploads/";
+// Carpeta para uploads (la misma que usan los scripts de cgi-bin/paths.py)
+const std::string UPLOADS_DIR = WWW_ROOT + "file/";
 // Rutas especiales
 const std::string UPLOADS_URI = "www/upload";
 
 std::string		clean_path(const std::string& path);
+ssize_t			normalize_uri(const char *target, size_t len, char *out);
 std::string		path_normalization(const std::string& path);
+bool			path_is_confined(const std::string& base, const std::string& path);
+
+// Hooks para que las cachés descarten entradas cuando un fichero cambia
+typedef void	(*t_invalidation_hook)(const std::string& path);
+void			add_invalidation_hook(t_invalidation_hook hook);
+void			invalidate_path(const std::string& path);
 #endif
@@ -29,12 +29,16 @@ int 			ft_stoi(std::string str);
 bool 			in_str(const std::string &word, const std::string &str);
 std::string 	read_file_binary(const std::string &file_path);
 std::string		read_file_text(const std::string &file_path);
+bool			write_all(int fd, const char *data, size_t len);
 std::string		replace_all(const std::string& str, const std::string& from, const std::string& to);
 bool			path_matches(const std::string& prefix, const std::string& path);
+const Location	*find_best_location(const std::string& request_path, const std::vector<Location> &locations);
 std::string		method_toString(int method);
 short			method_toEnum(const std::string& method);
+int				method_id(const std::string& method);
 bool			ci_equal(const std::string& a, const std::string& b);
 std::string		getFileExtension(const std::string &path);
+std::string		get_query_param(const std::string &query, const std::string &key);
 
 #endif // UTILS_HPP
 
@@ -0,0 +1,152 @@
+#include "../include/WebServ.hpp"
+
+/*** STRREF ***/
+
+StrRef::StrRef() : data(""), len(0) {}
+
+StrRef::StrRef(const char *data, size_t len) : data(data), len(len) {}
+
+StrRef::StrRef(const std::string &str) : data(str.data()), len(str.size()) {}
+
+bool StrRef::empty() const {
+    return len == 0;
+}
+
+std::string StrRef::str() const {
+    return std::string(data, len);
+}
+
+size_t StrRef::find(char c, size_t from) const {
+    if (from >= len)
+        return std::string::npos;
+    size_t pos = Scanner::findByte(data + from, len - from, c);
+    return pos == std::string::npos ? pos : from + pos;
+}
+
+size_t StrRef::find_first_not_of(char c, size_t from) const {
+    for (size_t i = from; i < len; ++i) {
+        if (data[i] != c)
+            return i;
+    }
+    return std::string::npos;
+}
+
+StrRef StrRef::sub(size_t pos, size_t n) const {
+    if (pos > len)
+        pos = len;
+    if (n > len - pos)
+        n = len - pos;
+    return StrRef(data + pos, n);
+}
+
+StrRef StrRef::trim(char c) const {
+    size_t start = 0;
+    size_t end = len;
+    while (start < end && data[start] == c)
+        start++;
+    while (end > start && data[end - 1] == c)
+        end--;
+    return StrRef(data + start, end - start);
+}
+
+bool StrRef::iequals(const char *other) const {
+    size_t i = 0;
+    for (; i < len && other[i]; ++i) {
+        if (tolower(static_cast<unsigned char>(data[i])) != tolower(static_cast<unsigned char>(other[i])))
+            return false;
+    }
+    return i == len && other[i] == '\0';
+}
+
+/*** ARENA ***/
+
+Arena::Arena(size_t block_size)
+    : _block_size(block_size), _current(0), _offset(0), _used(0) {}
+
+Arena::~Arena() {
+    for (size_t i = 0; i < _blocks.size(); ++i)
+        free(_blocks[i]);
+}
+
+/**
+ * Pasa al siguiente bloque con al menos min_size bytes, reutilizando los
+ * que ya existen antes de pedir uno nuevo.
+ */
+bool Arena::_next_block(size_t min_size) {
+    while (!_blocks.empty() && _current + 1 < _blocks.size()) {
+        _current++;
+        _offset = 0;
+        if (_sizes[_current] >= min_size)
+            return true;
+    }
+    size_t size = std::max(_block_size, min_size);
+    char *block = static_cast<char*>(malloc(size));
+    if (!block)
+        return false;
+    _blocks.push_back(block);
+    _sizes.push_back(size);
+    _current = _blocks.size() - 1;
+    _offset = 0;
+    return true;
+}
+
+void *Arena::alloc(size_t size, size_t align) {
+    if (size == 0)
+        size = 1;
+    if (!_blocks.empty()) {
+        size_t start = (_offset + align - 1) & ~(align - 1);
+        if (start + size <= _sizes[_current]) {
+            _offset = start + size;
+            _used += size;
+            return _blocks[_current] + start;
+        }
+    }
+    if (!_next_block(size + align))
+        throw std::bad_alloc();
+    return alloc(size, align);
+}
+
+char *Arena::dup(const char *str, size_t len) {
+    char *copy = static_cast<char*>(alloc(len + 1, 1));
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+StrRef Arena::dupRef(const StrRef &ref) {
+    return StrRef(dup(ref.data, ref.len), ref.len);
+}
+
+/**
+ * Libera todo lo asignado de una vez. Los bloques normales se conservan;
+ * los sobredimensionados (peticiones grandes puntuales) se devuelven al
+ * sistema para que la memoria por conexión no crezca sin límite.
+ */
+void Arena::reset() {
+    size_t kept = 0;
+    for (size_t i = 0; i < _blocks.size(); ++i) {
+        if (_sizes[i] > _block_size) {
+            free(_blocks[i]);
+            continue;
+        }
+        _blocks[kept] = _blocks[i];
+        _sizes[kept] = _sizes[i];
+        kept++;
+    }
+    _blocks.resize(kept);
+    _sizes.resize(kept);
+    _current = 0;
+    _offset = 0;
+    _used = 0;
+}
+
+size_t Arena::used() const {
+    return _used;
+}
+
+size_t Arena::capacity() const {
+    size_t total = 0;
+    for (size_t i = 0; i < _sizes.size(); ++i)
+        total += _sizes[i];
+    return total;
+}
@@ -0,0 +1,51 @@
+#include "../include/WebServ.hpp"
+
+CannedResponse::CannedResponse() : _code(0), _close(false) {}
+
+/** Respuesta text/html con el cuerpo dado (vacío en las redirecciones). */
+CannedResponse::CannedResponse(int code, const std::string &body, bool close)
+    : _code(code), _body(body), _close(close)
+{
+    _head = HttpResponse::version + " " + to_string(code) + " " + statusCodeString(code) + "\r\n"
+          + "Content-Type: text/html\r\n"
+          + "Content-Length: " + to_string(body.size()) + "\r\n";
+}
+
+CannedResponse CannedResponse::redirect(int code, const std::string &location) {
+    CannedResponse r(code, "", false);
+    r._head += "Location: " + location + "\r\n";
+    return r;
+}
+
+/**
+ * Página de error generada (get_default_error_page) para 'code'. Como las
+ * de HttpResponse(int), cierra la conexión.
+ */
+const CannedResponse &CannedResponse::defaultError(int code) {
+    static std::map<int, CannedResponse> pages;
+    std::map<int, CannedResponse>::iterator it = pages.find(code);
+    if (it == pages.end())
+        it = pages.insert(std::make_pair(code, CannedResponse(code, get_default_error_page(code), true))).first;
+    return it->second;
+}
+
+std::string CannedResponse::render(bool keep_alive) const {
+    static const std::string keep = "Connection: keep-alive\r\n\r\n";
+    static const std::string close = "Connection: close\r\n\r\n";
+    const std::string &connection = (keep_alive && !_close) ? keep : close;
+
+    std::string out;
+    out.reserve(_head.size() + connection.size() + _body.size());
+    out.append(_head);
+    out.append(connection);
+    out.append(_body);
+    return out;
+}
+
+int CannedResponse::getCode() const {
+    return _code;
+}
+
+bool CannedResponse::closes() const {
+    return _close;
+}
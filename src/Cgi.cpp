@@ -24,20 +24,48 @@ void Cgi::setEnvVariables(const Request& req) {
     _envVariables["REQUEST_METHOD"] = req.getMethod();
     _envVariables["QUERY_STRING"] = req.getQuery();
 
-    if (req.getHeaders().count("Content-Type"))
-        _envVariables["CONTENT_TYPE"] = req.getHeaders().at("Content-Type");
-    if (req.getHeaders().count("Content-Length"))
-        _envVariables["CONTENT_LENGTH"] = req.getHeaders().at("Content-Length");
-    else {
-        std::ostringstream oss;
-        oss << req.getBody().size();
-        _envVariables["CONTENT_LENGTH"] = oss.str();
+    if (req.hasHeader(H_CONTENT_TYPE))
+        _envVariables["CONTENT_TYPE"] = req.getHeader(H_CONTENT_TYPE).str();
+    if (req.hasHeader(H_CONTENT_LENGTH))
+        _envVariables["CONTENT_LENGTH"] = req.getHeader(H_CONTENT_LENGTH).str();
+    else
+        _envVariables["CONTENT_LENGTH"] = to_string(req.getBody().size());
+
+    // RFC 3875 4.1.18: el resto de cabeceras como HTTP_<NOMBRE>, salvo Proxy:
+    // HTTP_PROXY lo leen muchas librerías como proxy de salida (httpoxy)
+    for (size_t i = 0; i < req.getHeaderCount(); ++i) {
+        const HeaderField &field = req.getHeaderField(i);
+        if (field.id == H_CONTENT_TYPE || field.id == H_CONTENT_LENGTH || field.name.iequals("Proxy"))
+            continue;
+        std::string key = "HTTP_";
+        key.reserve(5 + field.name.len);
+        for (size_t j = 0; j < field.name.len; ++j) {
+            char c = field.name.data[j];
+            key += (c == '-') ? '_' : static_cast<char>(toupper(static_cast<unsigned char>(c)));
+        }
+        std::map<std::string, std::string>::iterator it = _envVariables.find(key);
+        if (it != _envVariables.end())
+            it->second.append(field.id == H_COOKIE ? "; " : ", ").append(field.value.data, field.value.len);
+        else
+            _envVariables[key] = field.value.str();
     }
 
     _envVariables["SCRIPT_NAME"] = req.getPath();
     _envVariables["SERVER_PROTOCOL"] = req.getVersion();
 }
 
+/** Cierra y borra los temporales de executeCgi (fd < 0 o path NULL: no se crearon). */
+static void cgi_cleanup(int input_fd, const char *input_path, int output_fd, const char *output_path) {
+    if (input_fd >= 0)
+        close(input_fd);
+    if (input_path)
+        unlink(input_path);
+    if (output_fd >= 0)
+        close(output_fd);
+    if (output_path)
+        unlink(output_path);
+}
+
 /**
  * Executes the CGI script with the given request.
  * Returns the output of the script.
@@ -47,65 +75,73 @@ void Cgi::setEnvVariables(const Request& req) {
  * - el body (si existe) por la entrada estándar (stdin).
  * 
  * Se usa:
- * - stdin para enviar el body de la petición 
- * - stdout para recibir la salida del script.
+ * - stdin para enviar el body de la petición: el fichero donde ServerManager
+ *   lo recibió con splice() (Request::getBodyFile) o, si no, un temporal
+ * - stdout para recibir la salida del script, o /dev/null si no se va a usar
  */
-std::string Cgi::executeCgi(const Request& req) {
+std::string Cgi::executeCgi(const Request& req, bool keep_output) {
     std::string output;
 
     char inputTemplate[] = "/tmp/webserv_cgi_inXXXXXX";
     char outputTemplate[] = "/tmp/webserv_cgi_outXXXXXX";
+    const char *input_path = NULL;
+    const char *output_path = NULL;
 
-    int input_fd = mkstemp(inputTemplate);
-    if (input_fd == -1) {
-        throw std::runtime_error("Failed to create CGI input temp file");
+    int input_fd = req.getBodyFile();
+    if (input_fd >= 0) {
+        input_fd = dup(input_fd); // el fichero es de ServerManager
+        if (input_fd == -1 || lseek(input_fd, 0, SEEK_SET) == -1) {
+            cgi_cleanup(input_fd, NULL, -1, NULL);
+            throw HttpException(HttpStatusCode::InternalServerError);
+        }
+    } else {
+        input_fd = mkstemp(inputTemplate);
+        if (input_fd == -1) {
+            throw std::runtime_error("Failed to create CGI input temp file");
+        }
+        input_path = inputTemplate;
     }
 
-    int output_fd = mkstemp(outputTemplate);
+    int output_fd;
+    if (keep_output) {
+        output_fd = mkstemp(outputTemplate);
+        output_path = outputTemplate;
+    } else {
+        output_fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    }
     if (output_fd == -1) {
-        close(input_fd);
-        unlink(inputTemplate);
+        cgi_cleanup(input_fd, input_path, -1, NULL);
         throw std::runtime_error("Failed to create CGI output temp file");
     }
 
     const std::string &body = req.getBody();
     size_t total_written = 0;
-    while (total_written < body.size()) {
+    while (input_path && total_written < body.size()) {
         ssize_t written = write(input_fd, body.data() + total_written, body.size() - total_written);
         if (written < 0) {
             if (errno == EINTR)
                 continue;
-            close(input_fd);
-            close(output_fd);
-            unlink(inputTemplate);
-            unlink(outputTemplate);
+            cgi_cleanup(input_fd, input_path, output_fd, output_path);
             throw HttpException(HttpStatusCode::InternalServerError);
         }
         if (written == 0) {
-            close(input_fd);
-            close(output_fd);
-            unlink(inputTemplate);
-            unlink(outputTemplate);
+            cgi_cleanup(input_fd, input_path, output_fd, output_path);
             throw HttpException(HttpStatusCode::InternalServerError);
         }
         total_written += static_cast<size_t>(written);
     }
-    if (lseek(input_fd, 0, SEEK_SET) == -1) {
-        close(input_fd);
-        close(output_fd);
-        unlink(inputTemplate);
-        unlink(outputTemplate);
+    if (input_path && lseek(input_fd, 0, SEEK_SET) == -1) {
+        cgi_cleanup(input_fd, input_path, output_fd, output_path);
         throw HttpException(HttpStatusCode::InternalServerError);
     }
 
     pid_t pid = fork();
     if (pid < 0) {
-        close(input_fd);
-        close(output_fd);
-        unlink(inputTemplate);
-        unlink(outputTemplate);
+        cgi_cleanup(input_fd, input_path, output_fd, output_path);
         throw std::runtime_error("Fork failed");
     }
+    Metrics::cgiSpawned(Metrics::CGI_FORK);
+    unsigned long long started = Metrics::now();
 
     if (pid == 0) { // Child process
         if (dup2(input_fd, STDIN_FILENO) == -1 || dup2(output_fd, STDOUT_FILENO) == -1) {
@@ -135,41 +171,156 @@ std::string Cgi::executeCgi(const Request& req) {
     }
 
     close(input_fd);
-    close(output_fd);
+    if (input_path)
+        unlink(input_path);
+    input_fd = -1;
+    input_path = NULL;
 
     int status = 0;
     if (waitpid(pid, &status, 0) == -1) {
-        unlink(inputTemplate);
-        unlink(outputTemplate);
+        Metrics::cgiFinished(Metrics::CGI_FORK, Metrics::now() - started, false);
+        cgi_cleanup(-1, NULL, output_fd, output_path);
         throw HttpException(HttpStatusCode::InternalServerError);
     }
 
-    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
-        unlink(inputTemplate);
-        unlink(outputTemplate);
+    bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    Metrics::cgiFinished(Metrics::CGI_FORK, Metrics::now() - started, ok);
+    if (!ok) {
+        cgi_cleanup(-1, NULL, output_fd, output_path);
         throw HttpException(HttpStatusCode::InternalServerError);
     }
 
-    std::ifstream outputFile(outputTemplate, std::ios::in | std::ios::binary);
-    if (!outputFile) {
-        unlink(inputTemplate);
-        unlink(outputTemplate);
-        throw HttpException(HttpStatusCode::InternalServerError);
+    // la salida se lee de una vez del temporal, sin pasar por streams
+    if (keep_output) {
+        struct stat st;
+        if (fstat(output_fd, &st) == -1) {
+            cgi_cleanup(-1, NULL, output_fd, output_path);
+            throw HttpException(HttpStatusCode::InternalServerError);
+        }
+        output.resize(static_cast<size_t>(st.st_size));
+        size_t done = 0;
+        while (done < output.size()) {
+            ssize_t n = pread(output_fd, &output[done], output.size() - done, done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            done += static_cast<size_t>(n);
+        }
+        output.resize(done);
     }
 
-    std::ostringstream oss;
-    oss << outputFile.rdbuf();
-    output = oss.str();
-
-    outputFile.close();
-    unlink(inputTemplate);
-    unlink(outputTemplate);
+    cgi_cleanup(-1, NULL, output_fd, output_path);
     return output;
 }
 
-std::string Cgi::run(const Request& req) {
+/** keep_output = false: la salida del script no se usa y va a /dev/null. */
+std::string Cgi::run(const Request& req, bool keep_output) {
     if (_scriptPath.empty()) {
         throw std::runtime_error("Script path is not set");
     }
-    return executeCgi(req);
-}
\ No newline at end of file
+    return executeCgi(req, keep_output);
+}
+/*** FASTCGI ***/
+
+static void fcgi_append_header(std::string& out, unsigned char type, unsigned short id, size_t len) {
+    unsigned char h[FCGI_HEADER_LEN];
+    h[0] = FCGI_VERSION_1;
+    h[1] = type;
+    h[2] = (id >> 8) & 0xff;
+    h[3] = id & 0xff;
+    h[4] = (len >> 8) & 0xff;
+    h[5] = len & 0xff;
+    h[6] = 0; // padding
+    h[7] = 0;
+    out.append(reinterpret_cast<char*>(h), FCGI_HEADER_LEN);
+}
+
+static void fcgi_append_length(std::string& out, size_t len) {
+    if (len < 128) {
+        out += static_cast<char>(len);
+        return;
+    }
+    out += static_cast<char>(((len >> 24) & 0x7f) | 0x80);
+    out += static_cast<char>((len >> 16) & 0xff);
+    out += static_cast<char>((len >> 8) & 0xff);
+    out += static_cast<char>(len & 0xff);
+}
+
+/** Trocea `data` en registros del tipo dado y añade el registro vacío de fin de stream. */
+static void fcgi_append_stream(std::string& out, unsigned char type, unsigned short id, const std::string& data) {
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t len = std::min(data.size() - pos, static_cast<size_t>(FCGI_MAX_CONTENT));
+        fcgi_append_header(out, type, id, len);
+        out.append(data, pos, len);
+        pos += len;
+    }
+    fcgi_append_header(out, type, id, 0);
+}
+
+/**
+ * Registros de una petición completa (BEGIN_REQUEST, PARAMS, STDIN), para
+ * enviarlos en una sola escritura. Pide FCGI_KEEP_CONN para poder devolver
+ * la conexión al pool.
+ */
+std::string Cgi::fastCgiRecords(unsigned short id, const Request& req) {
+    std::string packet;
+    std::string params;
+
+    fcgi_append_header(packet, FCGI_BEGIN_REQUEST, id, 8);
+    unsigned char begin[8] = {0, FCGI_RESPONDER, FCGI_KEEP_CONN, 0, 0, 0, 0, 0};
+    packet.append(reinterpret_cast<char*>(begin), sizeof(begin));
+
+    for (std::map<std::string, std::string>::iterator it = _envVariables.begin(); it != _envVariables.end(); ++it) {
+        fcgi_append_length(params, it->first.size());
+        fcgi_append_length(params, it->second.size());
+        params += it->first;
+        params += it->second;
+    }
+    fcgi_append_stream(packet, FCGI_PARAMS, id, params);
+    fcgi_append_stream(packet, FCGI_STDIN, id, req.getBody());
+    return packet;
+}
+
+/**
+ * Ejecuta la petición en un backend FastCGI persistente en lugar de hacer
+ * fork/execve por petición. En modo diferido lanza FastCgiPool::Pending
+ * con la conexión y los registros: el intercambio lo hace un hilo y la
+ * respuesta sale de su resultado (ServerManager::_fastcgi_response). Sin
+ * hilos el intercambio se hace en el momento. Devuelve 0 con la salida
+ * del backend en 'output', o el código a responder (502, 503) si el
+ * backend está saturado, no responde o falla.
+ */
+int Cgi::runFastCgi(const Request& req, const std::string& socketPath, std::string &output) {
+    setEnvVariables(req);
+    _envVariables["SCRIPT_FILENAME"] = _scriptPath;
+    _envVariables["GATEWAY_INTERFACE"] = "CGI/1.1";
+    unsigned long long started = Metrics::now();
+    int fd = -1;
+    unsigned short id = 0;
+    bool pooled = false;
+    int status = FastCgiPool::acquire(socketPath, fd, id, pooled);
+    if (status)
+        return status;
+
+    IoJob *job = new IoJob();
+    job->kind = IoJob::FASTCGI;
+    job->path = socketPath;
+    job->fd = fd;
+    job->id = id;
+    job->pooled = pooled;
+    job->started = started;
+    job->data = fastCgiRecords(id, req);
+    if (FastCgiPool::deferred()) {
+        FastCgiPool::Pending pending;
+        pending.job = job;
+        throw pending;
+    }
+    FastCgiPool::exchange(*job);
+    FastCgiPool::finish(*job);
+    bool ok = job->found;
+    output.swap(job->output);
+    delete job;
+    return ok ? 0 : static_cast<int>(HttpStatusCode::BadGateway);
+}
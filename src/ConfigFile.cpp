@@ -6,6 +6,10 @@ ConfigFile::ConfigFile(std::string const path) : _path(path), _size(0) { }
 
 ConfigFile::~ConfigFile() { }
 
+bool										ConfigFile::_batch = false;
+std::map<std::string, int>					ConfigFile::_types;
+std::map<std::pair<std::string, int>, bool>	ConfigFile::_access;
+
 /**
  * ¿Es archivo (`1:F_REGULAR_FILE`), directorio (`2:F_DIRECTORY`) o inexistente (`-1:F_NOT_EXIST`)?
  */
@@ -13,19 +17,29 @@ int ConfigFile::getTypePath(std::string const path)
 {
 	struct stat	buffer;
 	int			result;
-	
+	int			type;
+
+	if (_batch)
+	{
+		std::map<std::string, int>::const_iterator it = _types.find(path);
+		if (it != _types.end())
+			return (it->second);
+	}
 	result = stat(path.c_str(), &buffer);
 	if (result == 0)
 	{
 		if (buffer.st_mode & S_IFREG) // regular file
-			return (F_REGULAR_FILE);
+			type = F_REGULAR_FILE;
 		else if (buffer.st_mode & S_IFDIR) // directory
-			return (F_DIRECTORY);
+			type = F_DIRECTORY;
 		else
-			return (F_OTHER);
+			type = F_OTHER;
 	}
 	else
-		return (F_NOT_EXIST);
+		type = F_NOT_EXIST;
+	if (_batch)
+		_types[path] = type;
+	return (type);
 }
 
 /**
@@ -36,7 +50,34 @@ int ConfigFile::getTypePath(std::string const path)
  */
 bool	ConfigFile::checkFile(std::string const path, int mode)
 {
-	return (access(path.c_str(), mode) == 0);
+	if (!_batch)
+		return (access(path.c_str(), mode) == 0);
+	std::pair<std::string, int> key(path, mode);
+	std::map<std::pair<std::string, int>, bool>::const_iterator it = _access.find(key);
+	if (it != _access.end())
+		return (it->second);
+	bool ok = (access(path.c_str(), mode) == 0);
+	_access[key] = ok;
+	return (ok);
+}
+
+/**
+ * Memoriza getTypePath() y checkFile() hasta endBatch(). ReadConfig la
+ * abre al empezar a leer la configuración y la cierra al terminar, haya
+ * ido bien o no, para que las peticiones no vean resultados viejos.
+ */
+void ConfigFile::beginBatch()
+{
+	_types.clear();
+	_access.clear();
+	_batch = true;
+}
+
+void ConfigFile::endBatch()
+{
+	_batch = false;
+	_types.clear();
+	_access.clear();
 }
 
 bool ConfigFile::isFileExistAndReadable(std::string const path, std::string const index)
@@ -0,0 +1,231 @@
+#include "../include/WebServ.hpp"
+
+/**
+ * Los servers ya tienen asignado su socket de escucha. Si varios comparten
+ * host:port atiende el último declarado, como hasta ahora.
+ */
+ConfigSnapshot::ConfigSnapshot(const std::vector<ServerUnit> &servers, unsigned int generation)
+    : _servers(servers), _generation(generation), _refs(1)
+{
+    for (size_t i = 0; i < _servers.size(); ++i)
+        _by_fd[_servers[i].getFd()] = i;
+    _render_responses();
+    _compile_routes();
+}
+
+static bool longer_path(const CompiledLocation &a, const CompiledLocation &b) {
+    return a.path.len > b.path.len;
+}
+
+StrRef ConfigSnapshot::_intern(const std::string &str, std::map<std::string, StrRef> &seen) {
+    if (str.empty())
+        return StrRef();
+    std::map<std::string, StrRef>::iterator it = seen.find(str);
+    if (it != seen.end())
+        return it->second;
+    StrRef ref(_strings.dup(str.data(), str.size()), str.size());
+    seen[str] = ref;
+    return ref;
+}
+
+/**
+ * Paso de compilación tras leer la configuración: cada Location pasa a un
+ * CompiledLocation con las cadenas internadas (las repetidas, como el root
+ * del server, se guardan una vez) y los CGI en un array ordenado. Las de
+ * un server quedan juntas y ordenadas de ruta más larga a más corta; a
+ * igual longitud conservan el orden del fichero, como find_best_location.
+ */
+void ConfigSnapshot::_compile_routes() {
+    size_t total = 0, cgi_total = 0;
+    for (size_t i = 0; i < _servers.size(); ++i) {
+        const std::vector<Location> &locations = _servers[i].getLocations();
+        total += locations.size();
+        for (size_t l = 0; l < locations.size(); ++l)
+            cgi_total += locations[l].getCgiExtMap().size();
+    }
+    _routes.reserve(total);
+    _cgi_routes.reserve(cgi_total); // no se mueve: los CompiledLocation apuntan dentro
+
+    std::map<std::string, StrRef> seen;
+    for (size_t i = 0; i < _servers.size(); ++i) {
+        const ServerUnit &server = _servers[i];
+        const std::vector<Location> &locations = server.getLocations();
+        size_t first = _routes.size();
+        for (size_t l = 0; l < locations.size(); ++l) {
+            const Location &loc = locations[l];
+            CompiledLocation c;
+            c.source = &loc;
+            c.path = _intern(loc.getPathLocation(), seen);
+            c.match_len = c.path.len;
+            if (c.match_len > 0 && c.path.data[c.match_len - 1] == '/') // "/" queda en 0
+                c.match_len--;
+            c.root = _intern(loc.getRootLocation().empty() ? server.getRoot() : loc.getRootLocation(), seen);
+            c.alias = _intern(loc.getAlias(), seen);
+            c.index = _intern(loc.getIndexLocation().empty() ? server.getIndex() : loc.getIndexLocation(), seen);
+            c.redirect = _intern(loc.getReturn(), seen);
+            c.allow = _intern(loc.getPrintMethods(), seen);
+            c.methods = 0;
+            for (int m = M_GET; m <= M_HEAD; ++m)
+                if (loc.getMethods()[m])
+                    c.methods |= 1u << m;
+            c.autoindex = loc.getAutoindex();
+            c.status = loc.getStatus();
+            c.fastcgi = !loc.getFastCgiPass().empty();
+            c.max_body = loc.getMaxBodySize();
+            c.cgi = NULL;
+            c.cgi_count = loc.getCgiExtMap().size();
+            std::map<std::string, std::string>::const_iterator cgi; // el map ya va ordenado
+            for (cgi = loc.getCgiExtMap().begin(); cgi != loc.getCgiExtMap().end(); ++cgi) {
+                CgiRoute r;
+                r.ext = _intern(cgi->first, seen);
+                r.handler = _intern(cgi->second, seen);
+                _cgi_routes.push_back(r);
+            }
+            if (c.cgi_count)
+                c.cgi = &_cgi_routes[_cgi_routes.size() - c.cgi_count];
+            _routes.push_back(c);
+        }
+        std::stable_sort(_routes.begin() + first, _routes.end(), longer_path);
+        _route_ranges.push_back(std::make_pair(first, _routes.size() - first));
+    }
+}
+
+/**
+ * Lee una vez cada error_page (bajo WWW_ROOT, como antes en cada error) y
+ * prepara las redirecciones de las locations con `return`. Una página que
+ * no se puede leer se sustituye por la generada.
+ */
+void ConfigSnapshot::_render_responses() {
+    _error_pages.resize(_servers.size());
+    for (size_t i = 0; i < _servers.size(); ++i) {
+        const std::map<short, std::string> &pages = _servers[i].getErrorPages();
+        std::map<short, std::string>::const_iterator it;
+        for (it = pages.begin(); it != pages.end(); ++it) {
+            if (it->second.empty())
+                continue;
+            std::string path = WWW_ROOT + it->second;
+            std::ifstream file(path.c_str(), std::ios::binary);
+            if (!file) {
+                logError("Error page %d: cannot read %s, using the default one", it->first, path.c_str());
+                continue;
+            }
+            std::stringstream body;
+            body << file.rdbuf();
+            _error_pages[i][it->first] = CannedResponse(it->first, body.str(), false);
+        }
+        const std::vector<Location> &locations = _servers[i].getLocations();
+        for (size_t l = 0; l < locations.size(); ++l) {
+            const std::string &target = locations[l].getReturn();
+            if (!target.empty() && !_redirects.count(target))
+                _redirects[target] = CannedResponse::redirect(HttpStatusCode::MovedPermanently, target);
+        }
+    }
+}
+
+ConfigSnapshot::~ConfigSnapshot() {}
+
+ConfigSnapshot *ConfigSnapshot::retain() {
+    _refs++;
+    return this;
+}
+
+void ConfigSnapshot::release() {
+    if (--_refs > 0)
+        return;
+    logDebug("Configuration generation %u released", _generation);
+    delete this;
+}
+
+const ServerUnit *ConfigSnapshot::serverFor(int listen_fd) const {
+    std::map<int, size_t>::const_iterator it = _by_fd.find(listen_fd);
+    if (it == _by_fd.end())
+        return NULL;
+    return &_servers[it->second];
+}
+
+const std::vector<ServerUnit> &ConfigSnapshot::getServers() const {
+    return _servers;
+}
+
+/** Página de error configurada para 'code' en 'server' (uno de los de este snapshot), o NULL. */
+const CannedResponse *ConfigSnapshot::errorPage(const ServerUnit *server, int code) const {
+    size_t i = _index_of(server);
+    if (i == _servers.size())
+        return NULL;
+    const std::map<int, CannedResponse> &pages = _error_pages[i];
+    std::map<int, CannedResponse>::const_iterator it = pages.find(code);
+    return it == pages.end() ? NULL : &it->second;
+}
+
+/** Redirección 301 ya renderizada hacia 'location' si es el `return` de alguna location. */
+const CannedResponse *ConfigSnapshot::redirect(const std::string &location) const {
+    std::map<std::string, CannedResponse>::const_iterator it = _redirects.find(location);
+    return it == _redirects.end() ? NULL : &it->second;
+}
+
+/**
+ * Location de 'server' con el prefijo más largo que casa con 'path' (ya
+ * normalizado), con la misma regla que path_matches(). NULL si ninguna.
+ */
+const CompiledLocation *ConfigSnapshot::route(const ServerUnit *server, const std::string &path) const {
+    size_t i = _index_of(server);
+    if (i == _servers.size())
+        return NULL;
+    const CompiledLocation *it = _routes.empty() ? NULL : &_routes[0] + _route_ranges[i].first;
+    const CompiledLocation *end = it + _route_ranges[i].second;
+    for (; it != end; ++it) {
+        if (it->matches(path))
+            return it;
+    }
+    return NULL;
+}
+
+/** Posición de 'server' (uno de los de este snapshot) en _servers; _servers.size() si no lo es. */
+size_t ConfigSnapshot::_index_of(const ServerUnit *server) const {
+    if (_servers.empty() || server < &_servers[0] || server >= &_servers[0] + _servers.size())
+        return _servers.size();
+    return server - &_servers[0];
+}
+
+RouteCache &ConfigSnapshot::routeCache() const {
+    return _route_cache;
+}
+
+unsigned int ConfigSnapshot::getGeneration() const {
+    return _generation;
+}
+
+bool CompiledLocation::allows(int method) const {
+    return method >= 0 && (methods & (1u << method));
+}
+
+/** path_matches() sobre la ruta ya recortada: "/" casa con todo. */
+bool CompiledLocation::matches(const std::string &request_path) const {
+    if (match_len == 0)
+        return true;
+    size_t len = request_path.size();
+    if (len > 1 && request_path[len - 1] == '/')
+        len--;
+    if (len < match_len || request_path.compare(0, match_len, path.data, match_len) != 0)
+        return false;
+    return len == match_len || request_path[match_len] == '/';
+}
+
+/** Intérprete CGI para 'ext' (".py"), búsqueda binaria; vacío si no hay. */
+StrRef CompiledLocation::cgiHandler(const StrRef &ext) const {
+    size_t lo = 0, hi = cgi_count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        const StrRef &key = cgi[mid].ext;
+        int cmp = memcmp(key.data, ext.data, std::min(key.len, ext.len));
+        if (cmp == 0)
+            cmp = (key.len < ext.len) ? -1 : (key.len > ext.len);
+        if (cmp == 0)
+            return cgi[mid].handler;
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return StrRef();
+}
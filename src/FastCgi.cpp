@@ -0,0 +1,306 @@
+#include "../include/WebServ.hpp"
+#include <sys/un.h>
+#include <cerrno>
+
+std::map<std::string, FastCgiPool::Backend> FastCgiPool::_backends;
+bool										FastCgiPool::_deferred = false;
+
+enum e_fcgi_result {
+    FCGI_OK = 0,
+    FCGI_STALE,  // el backend cerró una conexión reutilizada antes de responder
+    FCGI_FAILED
+};
+
+FastCgiPool::Backend::Backend()
+    : socket_path(""), max_idle(FASTCGI_DEFAULT_POOL), max_queue(FASTCGI_DEFAULT_QUEUE),
+      in_flight(0), next_id(1), owns_socket(false), socket_dev(0), socket_ino(0) {}
+
+FastCgiPool::Backend &FastCgiPool::_get(const std::string &socket_path) {
+    std::map<std::string, Backend>::iterator it = _backends.find(socket_path);
+    if (it == _backends.end()) {
+        Backend &b = _backends[socket_path];
+        b.socket_path = socket_path;
+        return b;
+    }
+    return it->second;
+}
+
+void FastCgiPool::configure(const std::string &socket_path, size_t pool, size_t queue) {
+    Backend &b = _get(socket_path);
+    b.max_idle = pool;
+    b.max_queue = queue;
+    logDebug("🦑 FastCGI backend %s: pool=%zu queue=%zu", socket_path.c_str(), pool, queue);
+}
+
+/**
+ * Lanza `count` procesos persistentes que heredan el socket de escucha en el
+ * fd 0 (FCGI_LISTENSOCK_FILENO), igual que spawn-fcgi.
+ */
+void FastCgiPool::spawnWorkers(const std::string &socket_path, const std::string &exec, size_t count) {
+    Backend &b = _get(socket_path);
+    struct sockaddr_un addr;
+
+    if (socket_path.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("fastcgi socket path too long: " + socket_path);
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0)
+        throw std::runtime_error(std::string("fastcgi socket() failed: ") + strerror(errno));
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(socket_path.c_str());
+    if (bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0
+        || listen(listen_fd, static_cast<int>(b.max_queue)) < 0) {
+        int err = errno;
+        close(listen_fd);
+        throw std::runtime_error(std::string("fastcgi bind/listen failed: ") + strerror(err));
+    }
+    struct stat st;
+    b.owns_socket = (stat(socket_path.c_str(), &st) == 0);
+    if (b.owns_socket) {
+        b.socket_dev = st.st_dev;
+        b.socket_ino = st.st_ino;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            logError("FastCGI fork failed: %s", strerror(errno));
+            break;
+        }
+        if (pid == 0) {
+            if (dup2(listen_fd, FCGI_LISTENSOCK_FILENO) == -1)
+                _exit(EXIT_FAILURE);
+            if (listen_fd != FCGI_LISTENSOCK_FILENO)
+                close(listen_fd);
+            char* const args[] = {const_cast<char*>(exec.c_str()), NULL};
+            char* const envp[] = {NULL};
+            execve(exec.c_str(), args, envp);
+            _exit(EXIT_FAILURE);
+        }
+        b.workers.push_back(pid);
+        Metrics::cgiSpawned(Metrics::CGI_FASTCGI);
+    }
+    close(listen_fd);
+    logInfo("🦑 FastCGI: %zu worker(s) of %s listening on %s", b.workers.size(), exec.c_str(), socket_path.c_str());
+}
+
+int FastCgiPool::_connect(const std::string &socket_path) {
+    struct sockaddr_un addr;
+
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+    // no bloqueante: si el backlog del backend está lleno connect() devuelve EAGAIN
+    // en lugar de bloquear el bucle de eventos.
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    fcntl(fd, F_SETFL, flags);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    struct timeval tv;
+    tv.tv_sec = FASTCGI_TIMEOUT;
+    tv.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    return fd;
+}
+
+/**
+ * Deja en 'fd' una conexión al backend: una ociosa del pool si la hay, o
+ * una nueva. Devuelve 0, o el código a responder: 503 si se supera la
+ * profundidad de cola o el backend está saturado, 502 si no está disponible.
+ */
+int FastCgiPool::acquire(const std::string &socket_path, int &fd, unsigned short &request_id, bool &pooled) {
+    Backend &b = _get(socket_path);
+
+    fd = -1;
+    if (b.in_flight >= b.max_queue) {
+        logError("FastCGI %s: queue depth %zu reached", socket_path.c_str(), b.max_queue);
+        return HttpStatusCode::ServiceUnavailable;
+    }
+    pooled = false;
+    if (!b.idle.empty()) {
+        fd = b.idle.back();
+        b.idle.pop_back();
+        pooled = true;
+    } else {
+        fd = _connect(socket_path);
+        if (fd < 0) {
+            int err = errno;
+            logError("FastCGI connect(%s) failed: %s", socket_path.c_str(), strerror(err));
+            if (err == EAGAIN || err == EWOULDBLOCK)
+                return HttpStatusCode::ServiceUnavailable;
+            return HttpStatusCode::BadGateway;
+        }
+    }
+    Metrics::cacheLookup("fastcgi_conn", pooled);
+    b.in_flight++;
+    request_id = b.next_id++;
+    if (b.next_id == 0)
+        b.next_id = 1;
+    return 0;
+}
+
+void FastCgiPool::release(const std::string &socket_path, int fd, bool reusable) {
+    Backend &b = _get(socket_path);
+
+    if (b.in_flight > 0)
+        b.in_flight--;
+    if (reusable && b.idle.size() < b.max_idle)
+        b.idle.push_back(fd);
+    else if (fd >= 0)
+        close(fd);
+}
+
+/** Con un IoPool para FastCGI: runFastCgi lanza Pending en vez de bloquear el bucle. */
+void FastCgiPool::setDeferred(bool deferred) {
+    _deferred = deferred;
+}
+
+bool FastCgiPool::deferred() {
+    return _deferred;
+}
+
+static bool fcgi_send_all(int fd, const std::string& data) {
+    size_t sent = 0;
+    int flags = 0;
+#ifdef MSG_NOSIGNAL
+    flags = MSG_NOSIGNAL;
+#endif
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, flags);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+/** Lee exactamente `len` bytes. Devuelve los bytes leídos (< len si el peer cerró o hubo error). */
+static size_t fcgi_recv_all(int fd, char* buf, size_t len) {
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = recv(fd, buf + got, len - got, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        got += static_cast<size_t>(n);
+    }
+    return got;
+}
+
+/** Envía job.data y lee registros hasta END_REQUEST. */
+static int fcgi_exchange_once(IoJob &job) {
+    unsigned short id = static_cast<unsigned short>(job.id);
+    if (!fcgi_send_all(job.fd, job.data))
+        return FCGI_STALE;
+
+    bool received = false;
+    while (true) {
+        unsigned char h[FCGI_HEADER_LEN];
+        size_t got = fcgi_recv_all(job.fd, reinterpret_cast<char*>(h), FCGI_HEADER_LEN);
+        if (got != FCGI_HEADER_LEN)
+            return (got == 0 && !received) ? FCGI_STALE : FCGI_FAILED;
+        received = true;
+
+        unsigned short rid = static_cast<unsigned short>((h[2] << 8) | h[3]);
+        size_t len = static_cast<size_t>((h[4] << 8) | h[5]);
+        size_t total = len + h[6];
+        std::vector<char> content(total + 1);
+        if (total && fcgi_recv_all(job.fd, &content[0], total) != total)
+            return FCGI_FAILED;
+        if (h[0] != FCGI_VERSION_1 || rid != id)
+            return FCGI_FAILED;
+
+        if (h[1] == FCGI_STDOUT)
+            job.output.append(&content[0], len);
+        else if (h[1] == FCGI_STDERR)
+            job.errors.append(&content[0], len);
+        else if (h[1] == FCGI_END_REQUEST) {
+            if (len < 8 || content[4] != 0) // protocolStatus != FCGI_REQUEST_COMPLETE
+                return FCGI_FAILED;
+            return FCGI_OK;
+        }
+    }
+}
+
+/**
+ * El intercambio completo con el backend, bloqueante (FASTCGI_TIMEOUT por
+ * lectura). Lo hace un hilo del IoPool, así que solo toca el job: nada de
+ * logs, métricas ni del estado del pool. Si una conexión reutilizada
+ * resulta estar cerrada, se reintenta una vez con una nueva.
+ */
+void FastCgiPool::exchange(IoJob &job) {
+    int result = fcgi_exchange_once(job);
+    if (result == FCGI_STALE && job.pooled) {
+        close(job.fd);
+        job.pooled = false;
+        job.output.clear();
+        job.errors.clear();
+        job.fd = _connect(job.path);
+        result = (job.fd < 0) ? FCGI_FAILED : fcgi_exchange_once(job);
+    }
+    job.found = (result == FCGI_OK);
+}
+
+/** Ya en el bucle: devuelve la conexión al pool y registra el resultado. */
+void FastCgiPool::finish(IoJob &job) {
+    release(job.path, job.fd, job.found);
+    job.fd = -1;
+    if (!job.errors.empty())
+        logError("FastCGI stderr: %s", job.errors.c_str());
+    Metrics::cgiFinished(Metrics::CGI_FASTCGI, Metrics::now() - job.started, job.found);
+    if (!job.found)
+        logError("FastCGI request to %s failed", job.path.c_str());
+}
+
+void FastCgiPool::shutdown() {
+    std::map<std::string, Backend>::iterator it;
+    for (it = _backends.begin(); it != _backends.end(); ++it) {
+        Backend &b = it->second;
+        for (size_t i = 0; i < b.idle.size(); ++i)
+            close(b.idle[i]);
+        b.idle.clear();
+        for (size_t i = 0; i < b.workers.size(); ++i)
+            kill(b.workers[i], SIGTERM);
+        for (size_t i = 0; i < b.workers.size(); ++i)
+            waitpid(b.workers[i], NULL, 0);
+        b.workers.clear();
+        // tras un SIGUSR2 el proceso nuevo ya ha creado su socket en la misma ruta
+        struct stat st;
+        if (b.owns_socket && stat(b.socket_path.c_str(), &st) == 0
+            && st.st_dev == b.socket_dev && st.st_ino == b.socket_ino)
+            unlink(b.socket_path.c_str());
+    }
+}
+
+size_t FastCgiPool::inFlight(const std::string &socket_path) {
+    return _get(socket_path).in_flight;
+}
+
+size_t FastCgiPool::idleCount(const std::string &socket_path) {
+    return _get(socket_path).idle.size();
+}
+
+/** Tras un SIGHUP no se vuelven a lanzar workers que ya están corriendo. */
+bool FastCgiPool::hasWorkers(const std::string &socket_path) {
+    return !_get(socket_path).workers.empty();
+}
@@ -0,0 +1,339 @@
+#include "../include/WebServ.hpp"
+#include <sys/stat.h>
+#include <cerrno>
+
+std::map<std::string, FileCache::Entry>	FileCache::_entries;
+std::list<const std::string*>			FileCache::_lru;
+std::map<int, unsigned>					FileCache::_refs;
+bool									FileCache::_hooked = false;
+bool									FileCache::_deferred = false;
+bool									FileCache::_pending = false;
+std::string								FileCache::_wanted;
+bool									FileCache::_wanted_listing = false;
+
+/** Con IoPool: las consultas que necesiten el disco quedan pendientes (ver pending). */
+void FileCache::setDeferred(bool deferred) {
+    _deferred = deferred;
+}
+
+/** Anota que la consulta en curso necesita el disco, para wanted(). */
+void FileCache::_want(const std::string &path, bool listing) {
+    _pending = true;
+    _wanted = path;
+    _wanted_listing = listing;
+}
+
+/** true si la última consulta (type, list, acquire, read) se quedó esperando al disco. */
+bool FileCache::pending() {
+    return _pending;
+}
+
+/** Lo que necesita la última consulta pendiente, para pedírselo al IoPool. */
+FileCache::Pending FileCache::wanted() {
+    Pending p;
+    p.path = _wanted;
+    p.listing = _wanted_listing;
+    return p;
+}
+
+/**
+ * Entrada de 'path' en 'e': LOOKUP_HIT si estaba vigente (o fijada con
+ * pin), LOOKUP_MISS si hubo que mirar el disco. Una caducada se revalida
+ * con stat() y solo se vuelve a abrir si el fichero cambió; una nueva
+ * entra delante en el LRU y puede expulsar a la última. En modo diferido
+ * ninguna de las dos toca el disco: LOOKUP_PENDING, 'e' a NULL.
+ */
+int FileCache::_lookup(const std::string &path, Entry *&e) {
+    unsigned long long now = Metrics::now();
+    _pending = false;
+    e = NULL;
+    std::map<std::string, Entry>::iterator it = _entries.find(path);
+    if (it != _entries.end()) {
+        _lru.splice(_lru.begin(), _lru, it->second.lru);
+        if (now < it->second.valid_until || it->second.pins) {
+            Metrics::cacheLookup("open_file", true);
+            e = &it->second;
+            return LOOKUP_HIT;
+        }
+        if (_deferred) {
+            _want(path, false);
+            return LOOKUP_PENDING;
+        }
+        e = &it->second;
+        struct stat st;
+        const struct stat *found = (stat(path.c_str(), &st) == 0) ? &st : NULL;
+        bool same = _unchanged(*e, found);
+        Metrics::cacheLookup("open_file", same);
+        if (!same) {
+            _drop_fd(*e);
+            _fill(*e, found, _open_regular(path, found));
+        }
+        e->valid_until = now + OPEN_FILE_CACHE_VALID * 1000000ULL;
+        return same ? LOOKUP_HIT : LOOKUP_MISS;
+    }
+
+    Metrics::cacheLookup("open_file", false);
+    if (_deferred) {
+        _want(path, false);
+        return LOOKUP_PENDING;
+    }
+    struct stat st;
+    const struct stat *found = (stat(path.c_str(), &st) == 0) ? &st : NULL;
+    e = &_insert(path);
+    _fill(*e, found, _open_regular(path, found));
+    e->valid_until = now + OPEN_FILE_CACHE_VALID * 1000000ULL;
+    return LOOKUP_MISS;
+}
+
+/** Entrada nueva (vacía) delante en el LRU; expulsa la última si sobra. */
+FileCache::Entry &FileCache::_insert(const std::string &path) {
+    if (!_hooked) {
+        add_invalidation_hook(&FileCache::invalidate);
+        _hooked = true;
+    }
+    std::map<std::string, Entry>::iterator it = _entries.insert(std::make_pair(path, Entry())).first;
+    Entry &e = it->second;
+    e.fd = -1;
+    e.listed = 0;
+    e.pins = 0;
+    e.lru = _lru.insert(_lru.begin(), &it->first);
+    if (_entries.size() <= OPEN_FILE_CACHE_MAX)
+        return e;
+    // la menos usada que no espere ninguna petición aparcada; si lo están
+    // todas, la caché crece un poco hasta que se respondan
+    std::list<const std::string*>::reverse_iterator old = _lru.rbegin();
+    while (old != _lru.rend() && (*old == &it->first || _entries.find(**old)->second.pins))
+        ++old;
+    if (old != _lru.rend())
+        _erase(_entries.find(**old));
+    return e;
+}
+
+/** Descriptor de lectura si stat() dice que es un fichero regular, o -1. */
+int FileCache::_open_regular(const std::string &path, const struct stat *st) {
+    if (!st || !S_ISREG(st->st_mode))
+        return -1;
+    return open(path.c_str(), O_RDONLY | O_CLOEXEC);
+}
+
+/**
+ * Rellena la entrada con el resultado de stat() (NULL: no existe) y el
+ * descriptor ya abierto de un fichero regular (-1 si no se pudo abrir).
+ */
+void FileCache::_fill(Entry &e, const struct stat *st, int fd) {
+    e.fd = -1;
+    e.size = 0;
+    e.listed = 0;
+    e.listing.clear();
+    if (!st) {
+        e.type = F_NOT_EXIST;
+        return;
+    }
+    e.dev = st->st_dev;
+    e.ino = st->st_ino;
+    e.mtime = st->st_mtim;
+    e.size = static_cast<size_t>(st->st_size);
+    if (S_ISDIR(st->st_mode))
+        e.type = F_DIRECTORY;
+    else if (!S_ISREG(st->st_mode))
+        e.type = F_OTHER;
+    else {
+        e.type = F_REGULAR_FILE;
+        e.fd = fd;
+        if (e.fd >= 0)
+            _refs[e.fd] = 1;
+        return;
+    }
+    if (fd >= 0)
+        close(fd);
+}
+
+/**
+ * Resultado de un stat()/open() hecho fuera del bucle (IoPool). Si la
+ * entrada ya estaba y el fichero no cambió se conserva, con su descriptor
+ * y su listado; si no, se sustituye.
+ */
+void FileCache::prime(const std::string &path, const struct stat *st, int fd) {
+    std::map<std::string, Entry>::iterator it = _entries.find(path);
+    Entry &e = (it != _entries.end()) ? it->second : _insert(path);
+    bool fresh = (it == _entries.end());
+    if (!fresh && _unchanged(e, st) && !(e.type == F_REGULAR_FILE && e.fd < 0)) {
+        if (fd >= 0)
+            close(fd);
+    } else {
+        if (!fresh)
+            _drop_fd(e);
+        _fill(e, st, fd);
+    }
+    e.valid_until = Metrics::now() + OPEN_FILE_CACHE_VALID * 1000000ULL;
+}
+
+/** Igual que prime() para un directorio y su listado (NULL: opendir() falló). */
+void FileCache::primeListing(const std::string &path, const struct stat *st,
+                             const std::vector<std::string> *entries) {
+    prime(path, st, -1);
+    Entry &e = _entries.find(path)->second;
+    if (e.type != F_DIRECTORY)
+        return;
+    e.listed = entries ? 1 : -1;
+    if (entries)
+        e.listing = *entries;
+}
+
+/**
+ * Fija la entrada que acaba de guardar prime() mientras la petición que la
+ * esperaba no se responda: no caduca ni se expulsa, así que al repetirse
+ * la encuentra aunque entretanto hayan entrado OPEN_FILE_CACHE_MAX rutas.
+ */
+void FileCache::pin(const std::string &path) {
+    std::map<std::string, Entry>::iterator it = _entries.find(path);
+    if (it != _entries.end())
+        ++it->second.pins;
+}
+
+/** Deshace un pin(); la entrada pudo borrarse entretanto (invalidate, clear). */
+void FileCache::unpin(const std::string &path) {
+    std::map<std::string, Entry>::iterator it = _entries.find(path);
+    if (it != _entries.end() && it->second.pins)
+        --it->second.pins;
+}
+
+/** Nombres de un directorio menos ".", en el orden de readdir(). Sin estado: vale en cualquier hilo. */
+bool FileCache::readDirectory(const std::string &path, std::vector<std::string> &entries) {
+    DIR *dir = opendir(path.c_str());
+    if (!dir)
+        return false;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (std::string(entry->d_name) == ".")
+            continue;
+        entries.push_back(entry->d_name);
+    }
+    closedir(dir);
+    return true;
+}
+
+bool FileCache::_unchanged(const Entry &e, const struct stat *st) {
+    if (!st)
+        return e.type == F_NOT_EXIST;
+    return e.type != F_NOT_EXIST && e.dev == st->st_dev && e.ino == st->st_ino
+        && e.size == static_cast<size_t>(st->st_size)
+        && e.mtime.tv_sec == st->st_mtim.tv_sec && e.mtime.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+void FileCache::_drop_fd(Entry &e) {
+    if (e.fd >= 0)
+        release(e.fd);
+    e.fd = -1;
+}
+
+void FileCache::_erase(std::map<std::string, Entry>::iterator it) {
+    if (it == _entries.end())
+        return;
+    _drop_fd(it->second);
+    _lru.erase(it->second.lru);
+    _entries.erase(it);
+}
+
+/**
+ * Tipo de 'path' como ConfigFile::getTypePath (F_NOT_EXIST incluido),
+ * sin llamar a stat() mientras la entrada esté vigente. En modo diferido,
+ * F_PENDING si hay que mirar el disco.
+ */
+int FileCache::type(const std::string &path) {
+    Entry *e;
+    if (_lookup(path, e) == LOOKUP_PENDING)
+        return F_PENDING;
+    return e->type;
+}
+
+/**
+ * Listado de un directorio para el autoindex. false si no es un directorio
+ * legible o, con pending() a true, si aún hay que leerlo.
+ */
+bool FileCache::list(const std::string &path, std::vector<std::string> &entries) {
+    Entry *e;
+    if (_lookup(path, e) == LOOKUP_PENDING || e->type != F_DIRECTORY)
+        return false;
+    if (!e->listed) {
+        if (_deferred) {
+            _want(path, true);
+            return false;
+        }
+        e->listed = readDirectory(path, e->listing) ? 1 : -1;
+    }
+    if (e->listed < 0)
+        return false;
+    entries = e->listing;
+    return true;
+}
+
+/**
+ * Descriptor compartido de un fichero regular no vacío y su tamaño, o -1
+ * (con pending() a true si aún hay que abrirlo). Se lee siempre con
+ * offset (pread, io_uring) y se devuelve con release().
+ */
+int FileCache::acquire(const std::string &path, size_t &size) {
+    Entry *e;
+    if (_lookup(path, e) == LOOKUP_PENDING || e->fd < 0 || e->size == 0)
+        return -1;
+    ++_refs[e->fd];
+    size = e->size;
+    return e->fd;
+}
+
+void FileCache::release(int fd) {
+    std::map<int, unsigned>::iterator it = _refs.find(fd);
+    if (it == _refs.end() || --it->second > 0)
+        return;
+    close(fd);
+    _refs.erase(it);
+}
+
+/**
+ * Lee el fichero entero desde el descriptor de la caché. false si no es
+ * un fichero regular abierto, si pread falla o si aún hay que abrirlo
+ * (pending()); el llamador usa entonces read_file_binary(), que da el
+ * error HTTP adecuado.
+ */
+bool FileCache::read(const std::string &path, std::string &out) {
+    Entry *e;
+    if (_lookup(path, e) == LOOKUP_PENDING || e->fd < 0)
+        return false;
+    int fd = e->fd;
+    size_t size = e->size;
+    ++_refs[fd];
+    out.resize(size);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = pread(fd, &out[done], size - done, done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        done += n;
+    }
+    release(fd);
+    if (done == size)
+        return true;
+    invalidate(path); // el fichero ha cambiado por debajo
+    return false;
+}
+
+/**
+ * Hook de invalidate_path(): el fichero se borró o se reescribió. El
+ * listado del directorio que lo contiene (con o sin '/' final) ya no vale.
+ */
+void FileCache::invalidate(const std::string &path) {
+    _erase(_entries.find(path));
+    size_t slash = path.find_last_of('/');
+    if (slash == std::string::npos || slash + 1 == path.size())
+        return;
+    _erase(_entries.find(path.substr(0, slash)));
+    _erase(_entries.find(path.substr(0, slash + 1)));
+}
+
+void FileCache::clear() {
+    while (!_entries.empty())
+        _erase(_entries.begin());
+}
@@ -0,0 +1,72 @@
+#include "../include/WebServ.hpp"
+
+const char *HeaderIndex::_names[H_COUNT] = {
+    "Accept",
+    "Accept-Charset",
+    "Accept-Encoding",
+    "Accept-Language",
+    "Authorization",
+    "Cache-Control",
+    "Connection",
+    "Content-Length",
+    "Content-Type",
+    "Cookie",
+    "Expect",
+    "Host",
+    "If-Modified-Since",
+    "If-None-Match",
+    "If-Range",
+    "Range",
+    "Referer",
+    "Transfer-Encoding",
+    "Upgrade",
+    "User-Agent"
+};
+
+unsigned int    HeaderIndex::_seed = 0;
+signed char     HeaderIndex::_table[HEADER_TABLE_SIZE];
+bool            HeaderIndex::_ready = false;
+
+/** FNV-1a sobre el nombre en minúsculas, mezclado con la semilla. */
+unsigned int HeaderIndex::_hash(const char *name, size_t len, unsigned int seed) {
+    unsigned int h = 2166136261u ^ seed;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= static_cast<unsigned char>(tolower(static_cast<unsigned char>(name[i])));
+        h *= 16777619u;
+    }
+    return (h ^ (h >> 16)) & (HEADER_TABLE_SIZE - 1);
+}
+
+void HeaderIndex::_build() {
+    for (unsigned int seed = 0; ; ++seed) {
+        bool collision = false;
+        memset(_table, -1, sizeof(_table));
+        for (int id = 0; id < H_COUNT && !collision; ++id) {
+            unsigned int slot = _hash(_names[id], strlen(_names[id]), seed);
+            if (_table[slot] != -1)
+                collision = true;
+            else
+                _table[slot] = static_cast<signed char>(id);
+        }
+        if (!collision) {
+            _seed = seed;
+            break;
+        }
+    }
+    _ready = true;
+}
+
+e_header_id HeaderIndex::lookup(const char *name, size_t len) {
+    if (!_ready)
+        _build();
+    int id = _table[_hash(name, len, _seed)];
+    if (id < 0 || !StrRef(name, len).iequals(_names[id]))
+        return H_UNKNOWN;
+    return static_cast<e_header_id>(id);
+}
+
+const char *HeaderIndex::name(e_header_id id) {
+    if (id < 0 || id >= H_COUNT)
+        return "";
+    return _names[id];
+}
@@ -1,7 +1,9 @@
 #include "../include/WebServ.hpp"
+#include <cerrno>
 
 const std::string HttpResponse::CRLF = "\r\n";
 const std::string HttpResponse::version = "HTTP/1.1";
+bool HttpResponse::_async_files = false;
 
 ResponseStatus::ResponseStatus()
         : code(0), message("Empty") {}
@@ -18,28 +20,30 @@ void HttpResponse::reset_all() {
     _headers.location = "";
 }
 
-HttpResponse::HttpResponse(Request *request) : _request(request) {
+/**
+ * Resultados previsibles (404, 403, 400, 501) no se lanzan: el handler los
+ * deja en _error y prepare_response() responde con la página de error.
+ * Las excepciones quedan para fallos de verdad (CGI, E/S).
+ */
+HttpResponse::HttpResponse(Request *request) : _request(request), _body_fd(-1), _body_size(0), _error(0), _waiting(false) {
   reset_all();
   assert(request != NULL);
-  if (request->getMethod() == "GET") 
+  const CompiledLocation* loc = request->getMatchedLocation();
+  if (loc && loc->status)
+    handle_status();
+  else if (loc && loc->fastcgi)
+    handle_FastCGI();
+  else if (request->getMethod() == "GET") 
     handle_GET();
   else if (request->getMethod() == "POST") {
     handle_POST();
   }
   else if (request->getMethod() == "DELETE" ) {
-    if(request->getQuery().empty()) {
-      set_empty_response_close(HttpStatusCode::NotFound);
-    } else {
-      std::cout << "[DEBUG] path: " << request->getPath() << std::endl;
-      Cgi cgi("cgi-bin/deleteFile.py");
-      std::string cgi_output = cgi.run(*request);
-      set_empty_response_alive(HttpStatusCode::OK);
-    }
+    handle_DELETE();
   }
   
-  if (_status_line.code == 0) {
-    throw HttpException(HttpStatusCode::NotImplemented);
-  }
+  if (_status_line.code == 0 && !_error && !_waiting)
+    _error = HttpStatusCode::NotImplemented;
 
 }
 
@@ -72,7 +76,7 @@ std::string get_default_error_page(int errorCode) {
 }
 
 /** creates default error page */
-HttpResponse::HttpResponse(int errorCode) : _request(NULL) {
+HttpResponse::HttpResponse(int errorCode) : _request(NULL), _body_fd(-1), _body_size(0), _error(0), _waiting(false) {
   _status_line = ResponseStatus(errorCode);
   _body = get_default_error_page(errorCode);
 
@@ -89,7 +93,8 @@ HttpResponse::HttpResponse(int errorCode) : _request(NULL) {
   * If errorCode is an error (4xx, 5xx), errorpage_or_location is the path to the error page
   * If the error page does not exist, a default error page is generated
  */
-HttpResponse::HttpResponse(int errorCode, const std::string &errorpage_or_location) : _request(NULL) {
+HttpResponse::HttpResponse(int errorCode, const std::string &errorpage_or_location)
+    : _request(NULL), _body_fd(-1), _body_size(0), _error(0), _waiting(false) {
   if (errorCode >= 301 && errorCode <= 308) {
     set_redirect_response(errorCode, errorpage_or_location);
     return;
@@ -97,14 +102,18 @@ HttpResponse::HttpResponse(int errorCode, const std::string &errorpage_or_locati
   
   _status_line = ResponseStatus(errorCode);
   std::string valid_path = errorpage_or_location;
-  _body = read_file_binary(valid_path);
+  if (!FileCache::read(valid_path, _body))
+    _body = read_file_binary(valid_path);
 
   _headers.content_type = "text/html";
   _headers.content_length = to_string(_body.size());
   _headers.connection = "keep-alive";
 }
 
-HttpResponse::~HttpResponse() {}
+HttpResponse::~HttpResponse() {
+  if (_body_fd >= 0)
+    FileCache::release(_body_fd);
+}
 
 std::string HttpResponse::getStatusLine() const {
   return version + " " + to_string(_status_line.code) + " " + _status_line.message;
@@ -123,22 +132,37 @@ std::string HttpResponse::getHeaders() const {
 std::string HttpResponse::getBody() const {
   return _body;
 }
-std::string HttpResponse::toString() const {
-  return getStatusLine() + "\r\n" +
-       getHeaders() + "\r\n" +
-       getBody();
-}
-
 /**
- * checks if the file exists, otherwise throw 404
+ * Serializa la respuesta en una sola reserva: la cabecera se compone en la
+ * arena de la petición (o en la pila si no hay) y después se copia junto
+ * al cuerpo, sin los temporales de las concatenaciones con '+'.
  */
-std::string validate_path(const std::string &path) {
-  std::ifstream file(path.c_str());
-  if (!file.is_open()) {
-    logError("File not found: %s", path.c_str());
-    throw HttpException(HttpStatusCode::NotFound);
+std::string HttpResponse::toString() const {
+  char stack_buf[512];
+  size_t cap = 128 + _status_line.message.size() + _headers.content_type.size() +
+               _headers.content_length.size() + _headers.allow.size() +
+               _headers.location.size() + _headers.connection.size();
+  char *head = stack_buf;
+  if (cap > sizeof(stack_buf)) {
+    if (!_request)
+      return getStatusLine() + "\r\n" + getHeaders() + "\r\n" + getBody();
+    head = static_cast<char*>(_request->getArena().alloc(cap, 1));
   }
-  return path;
+
+  int len = snprintf(head, cap, "%s %d %s\r\nContent-Type: %s\r\nContent-Length: %s\r\n",
+                     version.c_str(), _status_line.code, _status_line.message.c_str(),
+                     _headers.content_type.c_str(), _headers.content_length.c_str());
+  if (!_headers.allow.empty())
+    len += snprintf(head + len, cap - len, "Allow: %s\r\n", _headers.allow.c_str());
+  if (!_headers.location.empty())
+    len += snprintf(head + len, cap - len, "Location: %s\r\n", _headers.location.c_str());
+  len += snprintf(head + len, cap - len, "Connection: %s\r\n\r\n", _headers.connection.c_str());
+
+  std::string out;
+  out.reserve(len + _body.size());
+  out.append(head, len);
+  out.append(_body);
+  return out;
 }
 
 std::string discover_content_type(const std::string &filename) {
@@ -164,7 +188,18 @@ void HttpResponse::handle_GET() {
     return;
   }
 
-  std::string file_path = validate_path(_request->getPath());
+  // checks if the file exists (open file cache, negative lookups included)
+  const std::string &file_path = _request->getPath();
+  int type = FileCache::type(file_path);
+  if (type == F_PENDING) {
+    _waiting = true;
+    return;
+  }
+  if (type == F_NOT_EXIST) {
+    logError("File not found: %s", file_path.c_str());
+    _error = HttpStatusCode::NotFound;
+    return;
+  }
   if (file_path == "www/photo-detail.html") {
     std::string html = read_file_text("www/photo-detail.html");
 
@@ -186,10 +221,25 @@ void HttpResponse::handle_GET() {
     return;
   }
   // else
-  _body = read_file_binary(file_path);
+  size_t size;
+  if (_async_files && (_body_fd = FileCache::acquire(file_path, size)) >= 0)
+    _body_size = size; // lo lee el bucle de eventos (io_uring o IoPool) sin bloquear
+  else if (FileCache::pending()) {
+    _waiting = true; // la entrada caducó entre type() y acquire()
+    return;
+  } else {
+    if (!FileCache::read(file_path, _body)) {
+      if (FileCache::pending()) {
+        _waiting = true;
+        return;
+      }
+      _body = read_file_binary(file_path);
+    }
+    size = _body.size();
+  }
 
   _headers.content_type = discover_content_type(file_path);
-  _headers.content_length = to_string(_body.size());
+  _headers.content_length = to_string(size);
   _headers.connection = "keep-alive";
 
   int code = HttpStatusCode::OK;
@@ -198,14 +248,14 @@ void HttpResponse::handle_GET() {
 }
 
 void HttpResponse::handle_POST() {
-  const Location* loc = _request->getMatchedLocation();
+  const CompiledLocation* loc = _request->getMatchedLocation();
   if (loc) {
     std::string ext = getFileExtension(_request->getPath());
-    std::string cgiExec = loc->getCgiHandler(ext);
+    std::string cgiExec = loc->cgiHandler(ext).str();
     if (!cgiExec.empty()) {
       // Ejecutar CGI
       Cgi cgi(cgiExec);
-      std::string cgi_output = cgi.run(*_request);
+      cgi.run(*_request, false); // la respuesta no lleva la salida del script
       set_empty_response_alive(HttpStatusCode::Created);
       return;
     }
@@ -216,7 +266,8 @@ void HttpResponse::handle_POST() {
   }
   if  (_request->getPath() == UPLOADS_URI) {
       if (_request->getBody().empty()) {
-        throw HttpException(HttpStatusCode::BadRequest);
+        _error = HttpStatusCode::BadRequest;
+        return;
       }
       logDebug("[DEBUG] Body size: %i", _request->getBody().size());
       Cgi cgi("cgi-bin/saveFile.py");
@@ -232,23 +283,156 @@ void HttpResponse::handle_POST() {
   }
 }
 
+/**
+ * Delega la petición al backend FastCGI configurado con `fastcgi_pass`.
+ * El backend decide si el recurso existe: no se valida la ruta en disco.
+ */
+void HttpResponse::handle_FastCGI() {
+  const CompiledLocation* loc = _request->getMatchedLocation();
+  Cgi cgi(_request->getPath());
+  std::string cgi_output;
+  int status = cgi.runFastCgi(*_request, loc->source->getFastCgiPass(), cgi_output);
+  if (status) {
+    _error = status;
+    return;
+  }
+  set_cgi_response(cgi_output);
+}
+
+/** Location con `status on;`: métricas en formato de texto de Prometheus. */
+void HttpResponse::handle_status() {
+  _body = Metrics::render();
+  _headers.content_type = "text/plain; version=0.0.4; charset=utf-8";
+  _headers.content_length = to_string(_body.size());
+  _headers.connection = "keep-alive";
+  _status_line = ResponseStatus(HttpStatusCode::OK);
+}
+
+/** Un nombre de fichero simple: sin barras ni "..", que saldrían de UPLOADS_DIR. */
+static bool is_plain_file_name(const std::string &name) {
+  return !name.empty() && name.find('/') == std::string::npos
+      && name.find('\\') == std::string::npos && name.find("..") == std::string::npos;
+}
+
+/**
+ * Borra un fichero sin pasar por CGI.
+ * - `?img=<nombre>`: fichero de UPLOADS_DIR (botón "Delete" de photo-detail.html);
+ *   el nombre se comprueba antes y después de decodificar los %XX (400 si
+ *   lleva barras o "..") y el destino tiene que quedar dentro de UPLOADS_DIR
+ * - sin query: el fichero de la ruta resuelta
+ * El destino tiene que quedar dentro del root/alias de la location.
+ * 204 si se borra, 404 si no existe, 403 si está fuera del root, es un
+ * directorio o no hay permisos.
+ */
+void HttpResponse::handle_DELETE() {
+  std::string target = _request->getPath();
+  std::string img = get_query_param(_request->getQuery(), "img");
+  if (!img.empty()) {
+    std::string name = clean_path(img);
+    if (!is_plain_file_name(img) || !is_plain_file_name(name)) {
+      logError("DELETE refused, bad file name: %s", img.c_str());
+      _error = HttpStatusCode::BadRequest;
+      return;
+    }
+    target = UPLOADS_DIR + name;
+    if (!path_is_confined(UPLOADS_DIR, target)) {
+      logError("DELETE outside of %s refused: %s", UPLOADS_DIR.c_str(), target.c_str());
+      _error = HttpStatusCode::Forbidden;
+      return;
+    }
+  }
+
+  if (!path_is_confined(_request->getRoot(), target)) {
+    struct stat st;
+    if (lstat(target.c_str(), &st) != 0) {
+      _error = HttpStatusCode::NotFound;
+      return;
+    }
+    logError("DELETE outside of root refused: %s", target.c_str());
+    _error = HttpStatusCode::Forbidden;
+    return;
+  }
+  int type = FileCache::type(target);
+  if (type == F_PENDING) {
+    _waiting = true;
+    return;
+  }
+  if (type == F_DIRECTORY) {
+    _error = HttpStatusCode::Forbidden;
+    return;
+  }
+  if (unlink(target.c_str()) != 0) {
+    if (errno == ENOENT || errno == ENOTDIR)
+      _error = HttpStatusCode::NotFound;
+    else if (errno == EACCES || errno == EPERM || errno == EISDIR)
+      _error = HttpStatusCode::Forbidden;
+    if (_error)
+      return;
+    logError("DELETE %s failed: %s", target.c_str(), strerror(errno));
+    throw HttpException(HttpStatusCode::InternalServerError);
+  }
+  logInfo("🗑️  Deleted %s", target.c_str());
+  invalidate_path(target);
+  set_empty_response_alive(HttpStatusCode::NoContent);
+}
+
+/**
+ * La conexión solo puede pasar de keep-alive a close: una respuesta que ya
+ * cierra (errores) no se reabre aunque el cliente pida keep-alive.
+ */
+void HttpResponse::set_keep_alive(bool keep) {
+  if (!keep)
+    _headers.connection = "close";
+}
+
+bool HttpResponse::keep_alive() const {
+  return _headers.connection != "close";
+}
+
+/** Código de error que dejó el handler (0 si hay respuesta normal). */
+int HttpResponse::getError() const {
+  return _error;
+}
+
+/**
+ * true si el handler se paró porque FileCache tiene que mirar el disco
+ * (FileCache::wanted()): la petición se aparca y se repite sin respuesta.
+ */
+bool HttpResponse::waiting() const {
+  return _waiting;
+}
+
 std::string HttpResponse::getResponse() const {
   return toString();
 }
 
+/**
+ * Con setAsyncFileBodies(true) un GET de un fichero regular deja el cuerpo
+ * en disco: toString() devuelve solo la cabecera y quien llama se queda el
+ * descriptor de la FileCache para leerlo por su cuenta y devolverlo con
+ * FileCache::release(). -1 si no hay.
+ */
+int HttpResponse::releaseBodyFile(size_t &size) {
+  int fd = _body_fd;
+  size = _body_size;
+  _body_fd = -1;
+  return fd;
+}
+
+void HttpResponse::setAsyncFileBodies(bool enabled) {
+  _async_files = enabled;
+}
+
 void HttpResponse::generate_autoindex(const Request& request) {
   logDebug("🍍 Generating autoindex for path: %s", request.getPath().c_str());
   std::string path = request.getPath();
   std::vector<std::string> entries;
-  DIR *dir = opendir((path).c_str());
-  if (!dir)
-      throw HttpException(HttpStatusCode::InternalServerError);
-  struct dirent *entry;
-  while ((entry = readdir(dir)) != NULL) {
-      if (std::string(entry->d_name) == ".") continue;
-      entries.push_back(entry->d_name);
+  if (!FileCache::list(path, entries)) { // cacheado; con IoPool lo lee un hilo
+      if (!FileCache::pending())
+          throw HttpException(HttpStatusCode::InternalServerError);
+      _waiting = true;
+      return;
   }
-  closedir(dir);
 
   std::ostringstream html;
   html << "<html><body><h1>Index" << "</h1><ul>";
@@ -270,7 +454,8 @@ void HttpResponse::generate_webindex(const Request& request) {
   
     std::ifstream file(request.getPath().c_str());
     if (!file.is_open()) {
-      throw HttpException(HttpStatusCode::NotFound);
+      _error = HttpStatusCode::NotFound;
+      return;
     }
     std::stringstream buffer;
     buffer << file.rdbuf();
@@ -324,3 +509,45 @@ void HttpResponse::set_allow_methods(const std::string& methods) {
 }
 
 
+
+/**
+ * Convierte la salida CGI (cabeceras CGI + cuerpo) en respuesta HTTP.
+ * Soporta `Status`, `Content-Type` y `Location`.
+ */
+void HttpResponse::set_cgi_response(const std::string& cgi_output) {
+    size_t sep = cgi_output.find("\r\n\r\n");
+    size_t body_start = (sep == std::string::npos) ? std::string::npos : sep + 4;
+    if (sep == std::string::npos) {
+        sep = cgi_output.find("\n\n");
+        body_start = (sep == std::string::npos) ? std::string::npos : sep + 2;
+    }
+
+    int code = HttpStatusCode::OK;
+    _headers.content_type = "text/html";
+    if (body_start == std::string::npos) {
+        _body = cgi_output; // sin cabeceras CGI
+    } else {
+        std::vector<std::string> lines = split(cgi_output.substr(0, sep), '\n');
+        for (size_t i = 0; i < lines.size(); ++i) {
+            std::string line = lines[i];
+            strip(line, '\r');
+            std::string key = readKey(line);
+            std::string value = readValue(line);
+            if (key == "Status")
+                code = ft_atoi(value.c_str());
+            else if (key == "Content-Type")
+                _headers.content_type = value;
+            else if (key == "Location") {
+                _headers.location = value;
+                if (code == HttpStatusCode::OK)
+                    code = HttpStatusCode::MovedTemporarily;
+            }
+        }
+        _body = cgi_output.substr(body_start);
+    }
+    if (statusCodeString(code) == UNDEFINED)
+        throw HttpException(HttpStatusCode::BadGateway);
+    _status_line = ResponseStatus(code);
+    _headers.content_length = to_string(_body.size());
+    _headers.connection = "keep-alive";
+}
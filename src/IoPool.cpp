@@ -0,0 +1,194 @@
+#include "../include/WebServ.hpp"
+#include <sys/eventfd.h>
+#include <cerrno>
+
+IoJob::IoJob()
+    : kind(OPEN), id(0), fd(-1), buf(NULL), size(0), done(0), err(0), found(false),
+      pooled(false), started(0) {
+    memset(&st, 0, sizeof(st));
+}
+
+IoPool::Ring::Ring() : head(0), tail(0) {
+    for (size_t i = 0; i < IO_POOL_QUEUE; ++i) {
+        cells[i].seq = i;
+        cells[i].job = NULL;
+    }
+}
+
+/**
+ * Cada celda lleva un número de secuencia: igual a la posición, está libre
+ * para escribir; igual a la posición + 1, tiene un trabajo para leer. Quien
+ * gana el compare-and-swap de tail (o head) es el único dueño de la celda.
+ */
+bool IoPool::Ring::push(IoJob *job) {
+    size_t pos = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+    for (;;) {
+        Cell &cell = cells[pos & (IO_POOL_QUEUE - 1)];
+        size_t seq = __atomic_load_n(&cell.seq, __ATOMIC_ACQUIRE);
+        long diff = static_cast<long>(seq) - static_cast<long>(pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&tail, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                cell.job = job;
+                __atomic_store_n(&cell.seq, pos + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+        } else if (diff < 0) {
+            return false; // llena
+        } else {
+            pos = __atomic_load_n(&tail, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+IoJob *IoPool::Ring::pop() {
+    size_t pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    for (;;) {
+        Cell &cell = cells[pos & (IO_POOL_QUEUE - 1)];
+        size_t seq = __atomic_load_n(&cell.seq, __ATOMIC_ACQUIRE);
+        long diff = static_cast<long>(seq) - static_cast<long>(pos + 1);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                IoJob *job = cell.job;
+                __atomic_store_n(&cell.seq, pos + IO_POOL_QUEUE, __ATOMIC_RELEASE);
+                return job;
+            }
+        } else if (diff < 0) {
+            return NULL; // vacía
+        } else {
+            pos = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+IoPool::IoPool() : _event_fd(-1), _in_flight(0), _stopping(0) {
+    sem_init(&_ready, 0, 0);
+}
+
+/** Para los hilos (terminan el trabajo que tengan entre manos) y libera lo que quede en las colas. */
+IoPool::~IoPool() {
+    __atomic_store_n(&_stopping, 1, __ATOMIC_RELEASE);
+    for (size_t i = 0; i < _threads.size(); ++i)
+        sem_post(&_ready);
+    for (size_t i = 0; i < _threads.size(); ++i)
+        pthread_join(_threads[i], NULL);
+    IoJob *job;
+    while ((job = _submitted.pop()) != NULL || (job = _finished.pop()) != NULL) {
+        // READ no es dueño de su fd (es de FileCache); los demás sí
+        if (job->kind != IoJob::READ && job->fd >= 0)
+            close(job->fd);
+        delete job;
+    }
+    sem_destroy(&_ready);
+    if (_event_fd >= 0)
+        close(_event_fd);
+}
+
+/**
+ * Arranca los hilos con todas las señales bloqueadas: SIGINT, SIGHUP... las
+ * sigue recibiendo el hilo del bucle, que es quien las atiende.
+ */
+bool IoPool::start(size_t threads) {
+    _event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_event_fd < 0) {
+        logError("IoPool: eventfd failed: %s", strerror(errno));
+        return false;
+    }
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for (size_t i = 0; i < threads; ++i) {
+        pthread_t thread;
+        int err = pthread_create(&thread, NULL, &IoPool::_worker, this);
+        if (err != 0) {
+            logError("IoPool: pthread_create failed: %s", strerror(err));
+            break;
+        }
+        _threads.push_back(thread);
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return !_threads.empty();
+}
+
+void *IoPool::_worker(void *arg) {
+    IoPool *pool = static_cast<IoPool*>(arg);
+    for (;;) {
+        while (sem_wait(&pool->_ready) < 0 && errno == EINTR)
+            ;
+        if (__atomic_load_n(&pool->_stopping, __ATOMIC_ACQUIRE))
+            break;
+        IoJob *job = pool->_submitted.pop();
+        if (!job)
+            continue;
+        run(*job);
+        pool->_finished.push(job); // siempre cabe: como mucho IO_POOL_QUEUE en curso
+        unsigned long long one = 1;
+        while (write(pool->_event_fd, &one, sizeof(one)) < 0 && errno == EINTR)
+            ;
+    }
+    return NULL;
+}
+
+size_t IoPool::threads() const {
+    return _threads.size();
+}
+
+/** eventfd que se vuelve legible cuando hay trabajos terminados. */
+int IoPool::fd() const {
+    return _event_fd;
+}
+
+/** Publica el trabajo para los hilos. false si ya hay IO_POOL_QUEUE en curso: el llamador lo hace él mismo. */
+bool IoPool::submit(IoJob *job) {
+    if (_in_flight >= IO_POOL_QUEUE || !_submitted.push(job))
+        return false;
+    ++_in_flight;
+    sem_post(&_ready);
+    return true;
+}
+
+/** Siguiente trabajo terminado (el llamador lo borra), o NULL. */
+IoJob *IoPool::completed() {
+    IoJob *job = _finished.pop();
+    if (job)
+        --_in_flight;
+    return job;
+}
+
+/** Vacía el eventfd antes de recoger con completed(). */
+void IoPool::ack() {
+    unsigned long long count;
+    while (read(_event_fd, &count, sizeof(count)) < 0 && errno == EINTR)
+        ;
+}
+
+/** Hace el trabajo en el hilo que llama: un hilo del pool o, con la cola llena, el bucle. */
+void IoPool::run(IoJob &job) {
+    if (job.kind == IoJob::FASTCGI) {
+        FastCgiPool::exchange(job);
+        return;
+    }
+    if (job.kind == IoJob::READ) {
+        while (job.done < job.size) {
+            ssize_t n = pread(job.fd, job.buf + job.done, job.size - job.done, job.done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                job.err = errno;
+            if (n <= 0)
+                break;
+            job.done += n;
+        }
+        return;
+    }
+    job.found = (stat(job.path.c_str(), &job.st) == 0);
+    if (!job.found)
+        return;
+    if (job.kind == IoJob::OPEN && S_ISREG(job.st.st_mode)) {
+        job.fd = open(job.path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (job.fd < 0)
+            job.err = errno;
+    } else if (job.kind == IoJob::LIST && S_ISDIR(job.st.st_mode)) {
+        if (!FileCache::readDirectory(job.path, job.entries))
+            job.err = errno;
+    }
+}
@@ -0,0 +1,338 @@
+#include "../include/WebServ.hpp"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <poll.h>
+
+IoUring::IoUring()
+    : _fd(-1), _ring(MAP_FAILED), _ring_size(0), _sqes(NULL), _sqes_size(0),
+      _sq_head(NULL), _sq_tail(NULL), _sq_mask(0), _sq_array(NULL), _sq_entries(0),
+      _sq_local_tail(0), _cq_head(NULL), _cq_tail(NULL), _cq_mask(0), _cqes(NULL),
+      _buf_ring(NULL), _buffers(NULL), _buf_tail(0), _in_flight(0) {}
+
+IoUring::~IoUring() {
+    if (_buffers)
+        munmap(_buffers, URING_BUFFERS * URING_BUFFER_SIZE);
+    if (_buf_ring)
+        munmap(_buf_ring, URING_BUFFERS * sizeof(struct io_uring_buf));
+    if (_sqes)
+        munmap(_sqes, _sqes_size);
+    if (_ring != MAP_FAILED)
+        munmap(_ring, _ring_size);
+    if (_fd >= 0)
+        ::close(_fd);
+}
+
+/**
+ * Crea el anillo (SQ y CQ en un solo mmap), comprueba las operaciones que
+ * usa el servidor y registra el grupo de buffers. Con COOP_TASKRUN el
+ * kernel no interrumpe al hilo para completar trabajo: lo hace al entrar
+ * en io_uring_enter(), que es lo que ya hace el bucle en cada vuelta.
+ */
+bool IoUring::init() {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = URING_ENTRIES * 4;
+    _fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (_fd < 0 && errno == EINVAL) {
+        params.flags = IORING_SETUP_CQSIZE; // COOP_TASKRUN es de 5.19
+        _fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    }
+    if (_fd < 0) {
+        logInfo("io_uring unavailable: %s", strerror(errno));
+        return false;
+    }
+    const unsigned needed = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP
+                          | IORING_FEAT_SUBMIT_STABLE | IORING_FEAT_EXT_ARG;
+    if ((params.features & needed) != needed) {
+        logInfo("io_uring unavailable: kernel lacks required features (0x%x)", params.features);
+        return false;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    _ring_size = std::max(sq_size, cq_size);
+    _ring = mmap(NULL, _ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                 _fd, IORING_OFF_SQ_RING);
+    if (_ring == MAP_FAILED) {
+        logError("io_uring: mmap of rings failed: %s", strerror(errno));
+        return false;
+    }
+    _sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(NULL, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      _fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        logError("io_uring: mmap of SQEs failed: %s", strerror(errno));
+        return false;
+    }
+    _sqes = static_cast<struct io_uring_sqe*>(sqes);
+
+    char *base = static_cast<char*>(_ring);
+    _sq_head = reinterpret_cast<unsigned*>(base + params.sq_off.head);
+    _sq_tail = reinterpret_cast<unsigned*>(base + params.sq_off.tail);
+    _sq_mask = *reinterpret_cast<unsigned*>(base + params.sq_off.ring_mask);
+    _sq_array = reinterpret_cast<unsigned*>(base + params.sq_off.array);
+    _sq_entries = params.sq_entries;
+    _sq_local_tail = *_sq_tail;
+    _cq_head = reinterpret_cast<unsigned*>(base + params.cq_off.head);
+    _cq_tail = reinterpret_cast<unsigned*>(base + params.cq_off.tail);
+    _cq_mask = *reinterpret_cast<unsigned*>(base + params.cq_off.ring_mask);
+    _cqes = reinterpret_cast<struct io_uring_cqe*>(base + params.cq_off.cqes);
+
+    return _probe() && _setup_buffers();
+}
+
+bool IoUring::_probe() {
+    const unsigned nops = 256;
+    std::vector<char> mem(sizeof(struct io_uring_probe) + nops * sizeof(struct io_uring_probe_op), 0);
+    struct io_uring_probe *probe = reinterpret_cast<struct io_uring_probe*>(&mem[0]);
+    if (syscall(__NR_io_uring_register, _fd, IORING_REGISTER_PROBE, probe, nops) < 0) {
+        logInfo("io_uring unavailable: probe failed: %s", strerror(errno));
+        return false;
+    }
+    const int ops[] = { IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_WRITEV, IORING_OP_READ,
+                        IORING_OP_POLL_ADD, IORING_OP_ASYNC_CANCEL, IORING_OP_CLOSE };
+    for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); ++i) {
+        if (ops[i] > probe->last_op || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) {
+            logInfo("io_uring unavailable: opcode %d not supported", ops[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Buffer ring de URING_BUFFERS buffers: el kernel elige uno al completar
+ * cada recv, así una conexión inactiva no retiene memoria.
+ */
+bool IoUring::_setup_buffers() {
+    void *ring = mmap(NULL, URING_BUFFERS * sizeof(struct io_uring_buf), PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    void *buffers = mmap(NULL, URING_BUFFERS * URING_BUFFER_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED || buffers == MAP_FAILED) {
+        if (ring != MAP_FAILED)
+            munmap(ring, URING_BUFFERS * sizeof(struct io_uring_buf));
+        if (buffers != MAP_FAILED)
+            munmap(buffers, URING_BUFFERS * URING_BUFFER_SIZE);
+        logError("io_uring: mmap of recv buffers failed: %s", strerror(errno));
+        return false;
+    }
+    _buf_ring = static_cast<struct io_uring_buf_ring*>(ring);
+    _buffers = static_cast<char*>(buffers);
+
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<unsigned long>(ring);
+    reg.ring_entries = URING_BUFFERS;
+    reg.bgid = URING_BUFFER_GROUP;
+    if (syscall(__NR_io_uring_register, _fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        logInfo("io_uring unavailable: buffer ring registration failed: %s", strerror(errno));
+        return false;
+    }
+    for (unsigned short bid = 0; bid < URING_BUFFERS; ++bid)
+        _add_buffer(bid);
+    return true;
+}
+
+/**
+ * El anillo es un array de io_uring_buf cuyo primer elemento comparte sitio
+ * con `tail`. No se usa el miembro `bufs`: en C++ __DECLARE_FLEX_ARRAY lo
+ * desplaza 8 bytes (la struct vacía que lo acompaña ocupa uno).
+ */
+void IoUring::_add_buffer(unsigned short bid) {
+    struct io_uring_buf *ring = reinterpret_cast<struct io_uring_buf*>(_buf_ring);
+    struct io_uring_buf *buf = &ring[_buf_tail & (URING_BUFFERS - 1)];
+    buf->addr = reinterpret_cast<unsigned long>(_buffers + static_cast<size_t>(bid) * URING_BUFFER_SIZE);
+    buf->len = URING_BUFFER_SIZE;
+    buf->bid = bid;
+    ++_buf_tail;
+    __atomic_store_n(&_buf_ring->tail, _buf_tail, __ATOMIC_RELEASE);
+}
+
+int IoUring::_enter(unsigned to_submit, unsigned min_complete, unsigned flags,
+                    const struct timespec *timeout) {
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    void *argp = NULL;
+    size_t argsz = 0;
+    if (timeout) {
+        ts.tv_sec = timeout->tv_sec;
+        ts.tv_nsec = timeout->tv_nsec;
+        memset(&arg, 0, sizeof(arg));
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = reinterpret_cast<unsigned long>(&ts);
+        argp = &arg;
+        argsz = sizeof(arg);
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+    int ret = syscall(__NR_io_uring_enter, _fd, to_submit, min_complete, flags, argp, argsz);
+    Metrics::ioUringEnter(ret > 0 ? ret : 0);
+    return ret < 0 ? -errno : ret;
+}
+
+/** SQE libre; si la SQ está llena se envía lo preparado para hacer sitio. */
+struct io_uring_sqe *IoUring::_get_sqe() {
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        unsigned head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+        if (_sq_local_tail - head < _sq_entries) {
+            unsigned index = _sq_local_tail & _sq_mask;
+            _sq_array[index] = index;
+            ++_sq_local_tail;
+            ++_in_flight;
+            struct io_uring_sqe *sqe = &_sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+            return sqe;
+        }
+        __atomic_store_n(_sq_tail, _sq_local_tail, __ATOMIC_RELEASE);
+        _enter(_sq_local_tail - head, 0, 0, NULL);
+    }
+    logError("io_uring: submission queue full");
+    return NULL;
+}
+
+/** accept multishot: una SQE entrega todas las conexiones hasta que se cancela. */
+void IoUring::accept(int listen_fd, unsigned long long data) {
+    struct io_uring_sqe *sqe = _get_sqe();
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data = data;
+}
+
+void IoUring::recv(int fd, unsigned long long data) {
+    struct io_uring_sqe *sqe = _get_sqe();
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = data;
+}
+
+/** El array iov se copia al enviar (FEAT_SUBMIT_STABLE); los datos deben seguir vivos hasta la CQE. */
+void IoUring::writev(int fd, const struct iovec *iov, int count, unsigned long long data) {
+    struct io_uring_sqe *sqe = _get_sqe();
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<unsigned long>(iov);
+    sqe->len = count;
+    sqe->user_data = data;
+}
+
+void IoUring::read(int fd, void *buf, size_t len, size_t offset, unsigned long long data) {
+    struct io_uring_sqe *sqe = _get_sqe();
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<unsigned long>(buf);
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = data;
+}
+
+void IoUring::pollIn(int fd, unsigned long long data) {
+    struct io_uring_sqe *sqe = _get_sqe();
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = data;
+}
+
+void IoUring::cancel(unsigned long long target, unsigned long long data) {
+    struct io_uring_sqe *sqe = _get_sqe();
+    if (!sqe)
+        return;
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = data;
+}
+
+/** close() en el siguiente envío, junto con el resto de operaciones. */
+void IoUring::close(int fd, unsigned long long data) {
+    struct io_uring_sqe *sqe = _get_sqe();
+    if (!sqe) {
+        ::close(fd);
+        return;
+    }
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = data;
+}
+
+/**
+ * Envía lo preparado y espera a que haya al menos una CQE o pase
+ * timeout_ms, todo en una sola llamada. Devuelve -errno (EINTR si llega
+ * una señal, ETIME si vence el plazo).
+ */
+int IoUring::submitAndWait(int timeout_ms) {
+    __atomic_store_n(_sq_tail, _sq_local_tail, __ATOMIC_RELEASE);
+    unsigned pending = _sq_local_tail - __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+    if (*_cq_head != __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE))
+        return pending ? _enter(pending, 0, 0, NULL) : 0; // ya hay trabajo: no esperar
+    struct timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    return _enter(pending, 1, IORING_ENTER_GETEVENTS, &ts);
+}
+
+bool IoUring::next(Completion &c) {
+    unsigned head = *_cq_head;
+    if (head == __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE))
+        return false;
+    const struct io_uring_cqe *cqe = &_cqes[head & _cq_mask];
+    c.data = cqe->user_data;
+    c.res = cqe->res;
+    c.flags = cqe->flags;
+    __atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+    if (!(c.flags & IORING_CQE_F_MORE) && _in_flight > 0)
+        --_in_flight;
+    return true;
+}
+
+/** Buffer del grupo que el kernel usó para un recv (flags de su CQE). */
+const char *IoUring::buffer(unsigned flags) const {
+    return _buffers + static_cast<size_t>(flags >> IORING_CQE_BUFFER_SHIFT) * URING_BUFFER_SIZE;
+}
+
+void IoUring::recycle(unsigned flags) {
+    if (flags & IORING_CQE_F_BUFFER)
+        _add_buffer(static_cast<unsigned short>(flags >> IORING_CQE_BUFFER_SHIFT));
+}
+
+/**
+ * Al salir: cancela todo y espera (como mucho URING_DRAIN_MS) a que el
+ * kernel termine, para que no escriba en memoria que ya se ha liberado.
+ */
+void IoUring::drain(unsigned long long data) {
+    struct io_uring_sqe *sqe = _get_sqe();
+    if (sqe) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+        sqe->user_data = data;
+    }
+    unsigned long long deadline = Metrics::now() + URING_DRAIN_MS * 1000ULL;
+    Completion c;
+    while (_in_flight > 0 && Metrics::now() < deadline) {
+        int ret = submitAndWait(10);
+        if (ret < 0 && ret != -ETIME && ret != -EINTR)
+            break;
+        while (next(c))
+            recycle(c.flags);
+    }
+}
+
+size_t IoUring::inFlight() const {
+    return _in_flight;
+}
@@ -10,6 +10,12 @@ Location::Location()
 	this->_return = "";
 	this->_alias = "";
 	this->_client_max_body_size = MAX_CONTENT_LENGTH;
+	this->_fastcgi_pass = "";
+	this->_fastcgi_pool = FASTCGI_DEFAULT_POOL;
+	this->_fastcgi_queue = FASTCGI_DEFAULT_QUEUE;
+	this->_fastcgi_spawn = "";
+	this->_fastcgi_workers = 0;
+	this->_status = false;
 	this->_methods.reserve(5);
 	this->_methods.push_back(1); // GET enabled by default
 	this->_methods.push_back(0);
@@ -29,6 +35,12 @@ Location::Location(const Location &other)
     this->_methods = other._methods;
 	this->_cgi_ext_map = other._cgi_ext_map;
 	this->_client_max_body_size = other._client_max_body_size;
+	this->_fastcgi_pass = other._fastcgi_pass;
+	this->_fastcgi_pool = other._fastcgi_pool;
+	this->_fastcgi_queue = other._fastcgi_queue;
+	this->_fastcgi_spawn = other._fastcgi_spawn;
+	this->_fastcgi_workers = other._fastcgi_workers;
+	this->_status = other._status;
 }
 
 Location &Location::operator=(const Location &rhs)
@@ -44,6 +56,12 @@ Location &Location::operator=(const Location &rhs)
 		this->_methods = rhs._methods;
 		this->_cgi_ext_map = rhs._cgi_ext_map;
 		this->_client_max_body_size = rhs._client_max_body_size;
+		this->_fastcgi_pass = rhs._fastcgi_pass;
+		this->_fastcgi_pool = rhs._fastcgi_pool;
+		this->_fastcgi_queue = rhs._fastcgi_queue;
+		this->_fastcgi_spawn = rhs._fastcgi_spawn;
+		this->_fastcgi_workers = rhs._fastcgi_workers;
+		this->_status = rhs._status;
     }
 	return (*this);
 }
@@ -101,6 +119,14 @@ void Location::setAutoindex(std::string token)
 		throw ServerUnit::ErrorException(AUTOINDEX_ERR ": must be 'on' or 'off'");
 }
 
+void Location::setStatus(std::string token)
+{
+	if (token == "on" || token == "off")
+		this->_status = (token == "on");
+	else
+		throw ServerUnit::ErrorException(SYNTAX_ERR_STATUS ": must be 'on' or 'off'");
+}
+
 void Location::setIndexLocation(std::string token)
 {
 	this->_index = token;
@@ -138,6 +164,49 @@ void Location::setMaxBodySize(unsigned long token)
 	this->_client_max_body_size = token;
 }
 
+static size_t parse_fastcgi_number(const std::string &token)
+{
+	if (token.empty())
+		throw ServerUnit::ErrorException(ERR_FASTCGI_NUMBER);
+	for (size_t i = 0; i < token.length(); i++)
+	{
+		if (token[i] < '0' || token[i] > '9')
+			throw ServerUnit::ErrorException(ERR_FASTCGI_NUMBER);
+	}
+	int n = ft_stoi(token);
+	if (n <= 0)
+		throw ServerUnit::ErrorException(ERR_FASTCGI_NUMBER);
+	return (static_cast<size_t>(n));
+}
+
+/**
+ * Acepta `unix:/ruta/al.sock` o directamente `/ruta/al.sock`.
+ */
+void Location::setFastCgiPass(std::string token)
+{
+	if (token.compare(0, 5, "unix:") == 0)
+		token = token.substr(5);
+	if (token.empty())
+		throw ServerUnit::ErrorException(SYNTAX_ERR_FASTCGI_PASS);
+	this->_fastcgi_pass = token;
+}
+
+void Location::setFastCgiPool(std::string token)
+{
+	this->_fastcgi_pool = parse_fastcgi_number(token);
+}
+
+void Location::setFastCgiQueue(std::string token)
+{
+	this->_fastcgi_queue = parse_fastcgi_number(token);
+}
+
+void Location::setFastCgiSpawn(std::string exec, std::string workers)
+{
+	this->_fastcgi_spawn = exec;
+	this->_fastcgi_workers = parse_fastcgi_number(workers);
+}
+
 const std::string &Location::getPathLocation() const
 {
 	return (this->_path);
@@ -163,6 +232,11 @@ const bool &Location::getAutoindex() const
 	return (this->_autoindex);
 }
 
+const bool &Location::getStatus() const
+{
+	return (this->_status);
+}
+
 const std::string &Location::getReturn() const
 {
 	return (this->_return);
@@ -183,6 +257,31 @@ const unsigned long &Location::getMaxBodySize() const
 	return (this->_client_max_body_size);
 }
 
+const std::string &Location::getFastCgiPass() const
+{
+	return (this->_fastcgi_pass);
+}
+
+const size_t &Location::getFastCgiPool() const
+{
+	return (this->_fastcgi_pool);
+}
+
+const size_t &Location::getFastCgiQueue() const
+{
+	return (this->_fastcgi_queue);
+}
+
+const std::string &Location::getFastCgiSpawn() const
+{
+	return (this->_fastcgi_spawn);
+}
+
+const size_t &Location::getFastCgiWorkers() const
+{
+	return (this->_fastcgi_workers);
+}
+
 std::string Location::getPrintMethods() const
 {
 	std::string res;
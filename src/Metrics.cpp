@@ -0,0 +1,365 @@
+#include "../include/WebServ.hpp"
+
+/*** HISTOGRAMA ***/
+
+LatencyHistogram::LatencyHistogram() : _count(0), _sum(0), _max(0) {
+    memset(_counts, 0, sizeof(_counts));
+}
+
+/**
+ * Los valores menores que 2^(SUB_BITS + 1) tienen cubo propio; a partir de
+ * ahí cada potencia de 2 se reparte en 2^SUB_BITS cubos de igual anchura.
+ */
+size_t LatencyHistogram::_index(unsigned long long value) {
+    const unsigned long long cap = (1ULL << (HIST_MAX_EXP + HIST_SUB_BITS + 1)) - 1;
+    if (value > cap)
+        value = cap;
+    if (value < (1ULL << (HIST_SUB_BITS + 1)))
+        return static_cast<size_t>(value);
+    int exp = (63 - __builtin_clzll(value)) - HIST_SUB_BITS;
+    return (static_cast<size_t>(exp) << HIST_SUB_BITS) + static_cast<size_t>(value >> exp);
+}
+
+/** Mayor valor que cae en el cubo `index`. */
+unsigned long long LatencyHistogram::_upper(size_t index) {
+    if (index < (1U << (HIST_SUB_BITS + 1)))
+        return index;
+    int exp = static_cast<int>(index >> HIST_SUB_BITS) - 1;
+    unsigned long long mantissa = index - (static_cast<size_t>(exp) << HIST_SUB_BITS);
+    return ((mantissa + 1) << exp) - 1;
+}
+
+void LatencyHistogram::record(unsigned long long usec) {
+    __sync_fetch_and_add(&_counts[_index(usec)], 1ULL);
+    __sync_fetch_and_add(&_count, 1ULL);
+    __sync_fetch_and_add(&_sum, usec);
+    unsigned long long current = _max;
+    while (usec > current && !__sync_bool_compare_and_swap(&_max, current, usec))
+        current = _max;
+}
+
+unsigned long long LatencyHistogram::count() const {
+    return _count;
+}
+
+unsigned long long LatencyHistogram::sum() const {
+    return _sum;
+}
+
+/** Valor bajo el que queda la fracción q de las muestras (cota superior del cubo). */
+unsigned long long LatencyHistogram::percentile(double q) const {
+    if (_count == 0)
+        return 0;
+    unsigned long long target = static_cast<unsigned long long>(q * _count + 0.999999);
+    if (target == 0)
+        target = 1;
+    unsigned long long seen = 0;
+    for (size_t i = 0; i < HIST_BUCKETS; ++i) {
+        seen += _counts[i];
+        if (seen >= target)
+            return std::min(_upper(i), _max);
+    }
+    return _max;
+}
+
+/**
+ * Muestras cuyo cubo entero queda por debajo de `usec`: las del cubo que
+ * cruza el límite no se cuentan, así que el "le" de Prometheus nunca miente
+ * por arriba.
+ */
+unsigned long long LatencyHistogram::countAtMost(unsigned long long usec) const {
+    unsigned long long total = 0;
+    for (size_t i = 0; i < HIST_BUCKETS && _upper(i) <= usec; ++i)
+        total += _counts[i];
+    return total;
+}
+
+/*** CONTADORES ***/
+
+unsigned long long	Metrics::_connections_active = 0;
+unsigned long long	Metrics::_connections_total = 0;
+unsigned long long	Metrics::_bytes_in = 0;
+unsigned long long	Metrics::_bytes_out = 0;
+unsigned long long	Metrics::_requests[METRICS_METHODS][METRICS_STATUS_MAX - METRICS_STATUS_MIN + 1];
+unsigned long long	Metrics::_cgi_spawns[2] = {0, 0};
+unsigned long long	Metrics::_cgi_failures[2] = {0, 0};
+unsigned long long	Metrics::_accept_failures = 0;
+unsigned long long	Metrics::_socket_writes = 0;
+unsigned long long	Metrics::_socket_short_writes = 0;
+unsigned long long	Metrics::_socket_corked_writes = 0;
+unsigned long long	Metrics::_tcp_retransmits = 0;
+unsigned long long	Metrics::_tcp_fastopen = 0;
+LatencyHistogram	Metrics::_tcp_rtt;
+const char			*Metrics::_io_backend = "select";
+unsigned long long	Metrics::_uring_enters = 0;
+unsigned long long	Metrics::_uring_sqes = 0;
+std::map<std::string, unsigned long long>	Metrics::_cache_hits;
+std::map<std::string, unsigned long long>	Metrics::_cache_misses;
+std::map<std::string, LatencyHistogram*>	Metrics::_latency;
+LatencyHistogram	Metrics::_cgi_latency[2];
+time_t				Metrics::_started = time(NULL);
+
+static const char *g_method_names[METRICS_METHODS] = {
+    "GET", "POST", "DELETE", "PUT", "HEAD", "OTHER"
+};
+
+static const char *g_cgi_kinds[2] = { "cgi", "fastcgi" };
+
+// límites "le" del histograma exportado, en microsegundos
+static const unsigned long long g_le_usec[] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000,
+    100000, 250000, 500000, 1000000, 2500000, 5000000, 10000000
+};
+
+/** Reloj monotónico en microsegundos: no salta si cambia la hora del sistema. */
+unsigned long long Metrics::now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<unsigned long long>(ts.tv_sec) * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+void Metrics::connectionOpened() {
+    __sync_fetch_and_add(&_connections_active, 1ULL);
+    __sync_fetch_and_add(&_connections_total, 1ULL);
+}
+
+void Metrics::connectionClosed() {
+    __sync_fetch_and_sub(&_connections_active, 1ULL);
+}
+
+/** accept() falló o la conexión se rechazó por falta de descriptores. */
+void Metrics::acceptFailed() {
+    __sync_fetch_and_add(&_accept_failures, 1ULL);
+}
+
+void Metrics::bytesIn(size_t n) {
+    __sync_fetch_and_add(&_bytes_in, static_cast<unsigned long long>(n));
+}
+
+void Metrics::bytesOut(size_t n) {
+    __sync_fetch_and_add(&_bytes_out, static_cast<unsigned long long>(n));
+}
+
+/** Un writev() a un cliente: corto si no cupo todo en el buffer del socket. */
+void Metrics::socketWrite(bool short_write, bool corked) {
+    __sync_fetch_and_add(&_socket_writes, 1ULL);
+    if (short_write)
+        __sync_fetch_and_add(&_socket_short_writes, 1ULL);
+    if (corked)
+        __sync_fetch_and_add(&_socket_corked_writes, 1ULL);
+}
+
+/** TCP_INFO de una conexión al cerrarla: RTT suavizado, retransmisiones y si el SYN traía datos (TFO). */
+void Metrics::tcpInfo(unsigned long long rtt_usec, unsigned long long retransmits, bool syn_data) {
+    _tcp_rtt.record(rtt_usec);
+    __sync_fetch_and_add(&_tcp_retransmits, retransmits);
+    if (syn_data)
+        __sync_fetch_and_add(&_tcp_fastopen, 1ULL);
+}
+
+/**
+ * Una respuesta encolada: cuenta por método y código y guarda la latencia
+ * (desde el primer byte de la petición) en el histograma de su server.
+ */
+void Metrics::request(const std::string &server, const std::string &method,
+                      int status, unsigned long long usec) {
+    int m = METRICS_METHODS - 1;
+    for (int i = 0; i < METRICS_METHODS - 1; ++i) {
+        if (method == g_method_names[i]) {
+            m = i;
+            break;
+        }
+    }
+    if (status >= METRICS_STATUS_MIN && status <= METRICS_STATUS_MAX)
+        __sync_fetch_and_add(&_requests[m][status - METRICS_STATUS_MIN], 1ULL);
+
+    std::map<std::string, LatencyHistogram*>::iterator it = _latency.find(server);
+    if (it == _latency.end())
+        it = _latency.insert(std::make_pair(server, new LatencyHistogram())).first;
+    it->second->record(usec);
+}
+
+/** Un proceso lanzado: uno por petición con CGI, uno por worker con fastcgi_spawn. */
+void Metrics::cgiSpawned(e_cgi_kind kind) {
+    __sync_fetch_and_add(&_cgi_spawns[kind], 1ULL);
+}
+
+void Metrics::cgiFinished(e_cgi_kind kind, unsigned long long usec, bool ok) {
+    _cgi_latency[kind].record(usec);
+    if (!ok)
+        __sync_fetch_and_add(&_cgi_failures[kind], 1ULL);
+}
+
+void Metrics::cacheLookup(const std::string &cache, bool hit) {
+    // las dos claves existen siempre, así el ratio sale aunque aún no haya fallos
+    unsigned long long &hits = _cache_hits[cache];
+    unsigned long long &misses = _cache_misses[cache];
+    __sync_fetch_and_add(hit ? &hits : &misses, 1ULL);
+}
+
+/*** EXPOSICIÓN ***/
+
+static std::string seconds(unsigned long long usec) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.6f", usec / 1000000.0);
+    return buf;
+}
+
+void Metrics::_render_histogram(std::ostringstream &out, const char *name,
+                                const std::string &labels, const LatencyHistogram &h) {
+    std::string sep = labels.empty() ? "" : ",";
+    for (size_t i = 0; i < sizeof(g_le_usec) / sizeof(*g_le_usec); ++i) {
+        out << name << "_bucket{" << labels << sep << "le=\"" << seconds(g_le_usec[i])
+            << "\"} " << h.countAtMost(g_le_usec[i]) << "\n";
+    }
+    out << name << "_bucket{" << labels << sep << "le=\"+Inf\"} " << h.count() << "\n";
+    std::string braced = labels.empty() ? "" : "{" + labels + "}";
+    out << name << "_sum" << braced << " " << seconds(h.sum()) << "\n";
+    out << name << "_count" << braced << " " << h.count() << "\n";
+}
+
+/**
+ * Desbordamientos de la cola de accept() según el kernel (ListenOverflows y
+ * ListenDrops de /proc/net/netstat). Son de todo el sistema, no por socket.
+ */
+void Metrics::_render_listen_overflows(std::ostringstream &out) {
+    std::ifstream netstat("/proc/net/netstat");
+    std::string names;
+    std::string values;
+    while (std::getline(netstat, names) && std::getline(netstat, values)) {
+        if (names.compare(0, 7, "TcpExt:") != 0)
+            continue;
+        std::vector<std::string> keys = split(names, ' ');
+        std::vector<std::string> vals = split(values, ' ');
+        for (size_t i = 1; i < keys.size() && i < vals.size(); ++i) {
+            if (keys[i] == "ListenOverflows" || keys[i] == "ListenDrops") {
+                std::string metric = keys[i] == "ListenOverflows" ? "webserv_listen_overflows_total"
+                                                                  : "webserv_listen_drops_total";
+                out << "# HELP " << metric << " Kernel " << keys[i] << " counter (system-wide).\n"
+                    << "# TYPE " << metric << " counter\n"
+                    << metric << " " << vals[i] << "\n";
+            }
+        }
+        return;
+    }
+}
+
+/** Backend del bucle de eventos elegido al arrancar ("select" o "io_uring"). */
+void Metrics::ioBackend(const char *name) {
+    _io_backend = name;
+}
+
+/** Una llamada a io_uring_enter() y las SQEs que envió. */
+void Metrics::ioUringEnter(unsigned submitted) {
+    __sync_fetch_and_add(&_uring_enters, 1ULL);
+    __sync_fetch_and_add(&_uring_sqes, static_cast<unsigned long long>(submitted));
+}
+
+/** Texto de exposición de Prometheus (version 0.0.4). */
+std::string Metrics::render() {
+    std::ostringstream out;
+
+    out << "# HELP webserv_uptime_seconds Seconds since the server started.\n"
+        << "# TYPE webserv_uptime_seconds gauge\n"
+        << "webserv_uptime_seconds " << (time(NULL) - _started) << "\n";
+    out << "# HELP webserv_connections_active Open client connections.\n"
+        << "# TYPE webserv_connections_active gauge\n"
+        << "webserv_connections_active " << _connections_active << "\n";
+    out << "# HELP webserv_connections_total Accepted client connections.\n"
+        << "# TYPE webserv_connections_total counter\n"
+        << "webserv_connections_total " << _connections_total << "\n";
+    out << "# HELP webserv_accept_failures_total Connections lost in accept() or rejected for lack of descriptors.\n"
+        << "# TYPE webserv_accept_failures_total counter\n"
+        << "webserv_accept_failures_total " << _accept_failures << "\n";
+    _render_listen_overflows(out);
+    out << "# HELP webserv_bytes_received_total Bytes read from clients.\n"
+        << "# TYPE webserv_bytes_received_total counter\n"
+        << "webserv_bytes_received_total " << _bytes_in << "\n";
+    out << "# HELP webserv_bytes_sent_total Bytes written to clients.\n"
+        << "# TYPE webserv_bytes_sent_total counter\n"
+        << "webserv_bytes_sent_total " << _bytes_out << "\n";
+
+    out << "# HELP webserv_socket_writes_total writev() calls to clients.\n"
+        << "# TYPE webserv_socket_writes_total counter\n"
+        << "webserv_socket_writes_total " << _socket_writes << "\n";
+    out << "# HELP webserv_socket_short_writes_total Writes that did not fit in the socket send buffer.\n"
+        << "# TYPE webserv_socket_short_writes_total counter\n"
+        << "webserv_socket_short_writes_total " << _socket_short_writes << "\n";
+    out << "# HELP webserv_socket_corked_writes_total Writes sent while the socket was corked (tcp_cork).\n"
+        << "# TYPE webserv_socket_corked_writes_total counter\n"
+        << "webserv_socket_corked_writes_total " << _socket_corked_writes << "\n";
+    out << "# HELP webserv_tcp_retransmits_total Segments retransmitted on closed connections (TCP_INFO).\n"
+        << "# TYPE webserv_tcp_retransmits_total counter\n"
+        << "webserv_tcp_retransmits_total " << _tcp_retransmits << "\n";
+    out << "# HELP webserv_tcp_fastopen_total Closed connections whose SYN carried data (TCP Fast Open).\n"
+        << "# TYPE webserv_tcp_fastopen_total counter\n"
+        << "webserv_tcp_fastopen_total " << _tcp_fastopen << "\n";
+    out << "# HELP webserv_tcp_rtt_seconds Smoothed RTT of connections when they close (TCP_INFO).\n"
+        << "# TYPE webserv_tcp_rtt_seconds histogram\n";
+    _render_histogram(out, "webserv_tcp_rtt_seconds", "", _tcp_rtt);
+    out << "# HELP webserv_io_backend Event loop backend in use.\n"
+        << "# TYPE webserv_io_backend gauge\n"
+        << "webserv_io_backend{backend=\"" << _io_backend << "\"} 1\n";
+    out << "# HELP webserv_io_uring_enter_total io_uring_enter() calls.\n"
+        << "# TYPE webserv_io_uring_enter_total counter\n"
+        << "webserv_io_uring_enter_total " << _uring_enters << "\n";
+    out << "# HELP webserv_io_uring_sqes_total Operations submitted to io_uring.\n"
+        << "# TYPE webserv_io_uring_sqes_total counter\n"
+        << "webserv_io_uring_sqes_total " << _uring_sqes << "\n";
+
+    out << "# HELP webserv_requests_total Responses by request method and status code.\n"
+        << "# TYPE webserv_requests_total counter\n";
+    for (int m = 0; m < METRICS_METHODS; ++m) {
+        for (int s = 0; s <= METRICS_STATUS_MAX - METRICS_STATUS_MIN; ++s) {
+            if (_requests[m][s])
+                out << "webserv_requests_total{method=\"" << g_method_names[m] << "\",code=\""
+                    << (s + METRICS_STATUS_MIN) << "\"} " << _requests[m][s] << "\n";
+        }
+    }
+
+    out << "# HELP webserv_request_duration_seconds Time from the first request byte to the queued response.\n"
+        << "# TYPE webserv_request_duration_seconds histogram\n";
+    std::map<std::string, LatencyHistogram*>::const_iterator it;
+    for (it = _latency.begin(); it != _latency.end(); ++it)
+        _render_histogram(out, "webserv_request_duration_seconds", "server=\"" + it->first + "\"", *it->second);
+    out << "# HELP webserv_request_duration_quantile_seconds Request latency percentiles (HDR histogram).\n"
+        << "# TYPE webserv_request_duration_quantile_seconds gauge\n";
+    const char *quantiles[] = { "0.5", "0.9", "0.99", "0.999" };
+    for (it = _latency.begin(); it != _latency.end(); ++it) {
+        for (size_t q = 0; q < sizeof(quantiles) / sizeof(*quantiles); ++q)
+            out << "webserv_request_duration_quantile_seconds{server=\"" << it->first << "\",quantile=\""
+                << quantiles[q] << "\"} " << seconds(it->second->percentile(atof(quantiles[q]))) << "\n";
+    }
+
+    out << "# HELP webserv_cgi_spawns_total Processes started (one per CGI request, one per FastCGI worker).\n"
+        << "# TYPE webserv_cgi_spawns_total counter\n";
+    for (int k = 0; k < 2; ++k)
+        out << "webserv_cgi_spawns_total{kind=\"" << g_cgi_kinds[k] << "\"} " << _cgi_spawns[k] << "\n";
+    out << "# HELP webserv_cgi_failures_total CGI runs that failed or exited with an error.\n"
+        << "# TYPE webserv_cgi_failures_total counter\n";
+    for (int k = 0; k < 2; ++k)
+        out << "webserv_cgi_failures_total{kind=\"" << g_cgi_kinds[k] << "\"} " << _cgi_failures[k] << "\n";
+    out << "# HELP webserv_cgi_duration_seconds CGI execution time.\n"
+        << "# TYPE webserv_cgi_duration_seconds histogram\n";
+    for (int k = 0; k < 2; ++k)
+        _render_histogram(out, "webserv_cgi_duration_seconds", std::string("kind=\"") + g_cgi_kinds[k] + "\"", _cgi_latency[k]);
+
+    out << "# HELP webserv_cache_hits_total Cache lookups served from the cache.\n"
+        << "# TYPE webserv_cache_hits_total counter\n";
+    std::map<std::string, unsigned long long>::const_iterator c;
+    for (c = _cache_hits.begin(); c != _cache_hits.end(); ++c)
+        out << "webserv_cache_hits_total{cache=\"" << c->first << "\"} " << c->second << "\n";
+    out << "# HELP webserv_cache_misses_total Cache lookups that missed.\n"
+        << "# TYPE webserv_cache_misses_total counter\n";
+    for (c = _cache_misses.begin(); c != _cache_misses.end(); ++c)
+        out << "webserv_cache_misses_total{cache=\"" << c->first << "\"} " << c->second << "\n";
+    out << "# HELP webserv_cache_hit_ratio Hits over lookups since start.\n"
+        << "# TYPE webserv_cache_hit_ratio gauge\n";
+    for (c = _cache_hits.begin(); c != _cache_hits.end(); ++c) {
+        unsigned long long lookups = c->second + _cache_misses[c->first];
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.4f", lookups ? static_cast<double>(c->second) / lookups : 0.0);
+        out << "webserv_cache_hit_ratio{cache=\"" << c->first << "\"} " << buf << "\n";
+    }
+    return out.str();
+}
@@ -0,0 +1,288 @@
+#include "../include/WebServ.hpp"
+#include <cerrno>
+
+MultipartParser::MultipartParser(const std::string &boundary, const std::string &upload_dir)
+    : _delimiter("\r\n--" + boundary), _upload_dir(upload_dir), _state(MP_BODY),
+      _carry("\r\n"), _headers(""), _fd(-1)
+{
+    // El primer delimitador no va precedido de CRLF: se simula con _carry
+    // y el preámbulo se trata como el cuerpo de una parte que se descarta.
+    const size_t m = _delimiter.size();
+    for (size_t i = 0; i < 256; ++i)
+        _skip[i] = m;
+    for (size_t i = 0; i + 1 < m; ++i)
+        _skip[static_cast<unsigned char>(_delimiter[i])] = m - 1 - i;
+}
+
+MultipartParser::~MultipartParser()
+{
+    _abort_part();
+}
+
+/**
+ * Extrae el boundary de "multipart/form-data; boundary=...".
+ * Devuelve "" si no es multipart/form-data o el boundary no es válido.
+ */
+std::string MultipartParser::boundaryFromContentType(const std::string &content_type)
+{
+    std::string lower = content_type;
+    to_lower(lower);
+    if (lower.compare(0, 19, "multipart/form-data") != 0)
+        return "";
+    size_t pos = lower.find("boundary=");
+    if (pos == std::string::npos)
+        return "";
+    std::string boundary = content_type.substr(pos + 9);
+    size_t end = boundary.find(';');
+    if (end != std::string::npos)
+        boundary.erase(end);
+    strip(boundary, ' ');
+    if (boundary.size() >= 2 && boundary[0] == '"' && boundary[boundary.size() - 1] == '"')
+        boundary = boundary.substr(1, boundary.size() - 2);
+    if (boundary.empty() || boundary.size() > 70)
+        return "";
+    return boundary;
+}
+
+/** Boyer-Moore-Horspool. Devuelve npos si no hay coincidencia completa. */
+size_t MultipartParser::_find_delimiter(const char *hay, size_t len) const
+{
+    const size_t m = _delimiter.size();
+    const char *needle = _delimiter.data();
+
+    if (len < m)
+        return std::string::npos;
+    size_t i = 0;
+    while (i <= len - m) {
+        const char last = hay[i + m - 1];
+        if (last == needle[m - 1] && memcmp(hay + i, needle, m - 1) == 0)
+            return i;
+        i += _skip[static_cast<unsigned char>(last)];
+    }
+    return std::string::npos;
+}
+
+bool MultipartParser::feed(const char *data, size_t len)
+{
+    size_t pos = 0;
+
+    while (pos < len && _state != MP_DONE && _state != MP_ERROR) {
+        if (_state == MP_BODY)
+            pos += _consume_body(data + pos, len - pos);
+        else if (_state == MP_AFTER_BOUNDARY)
+            pos += _consume_after_boundary(data + pos, len - pos);
+        else if (_state == MP_HEADERS)
+            pos += _consume_headers(data + pos, len - pos);
+    }
+    return _state != MP_ERROR;
+}
+
+/**
+ * Escribe los datos de la parte actual hasta encontrar el delimitador.
+ * Los últimos (len(delimitador) - 1) bytes se retienen en _carry por si el
+ * delimitador queda partido entre dos lecturas.
+ */
+size_t MultipartParser::_consume_body(const char *data, size_t len)
+{
+    const size_t m = _delimiter.size();
+
+    if (!_carry.empty()) {
+        const size_t k = _carry.size();
+        const size_t take = std::min(len, m - 1);
+        _carry.append(data, take);
+        size_t p = _find_delimiter(_carry.data(), _carry.size());
+        if (p != std::string::npos) {
+            _write(_carry.data(), p);
+            size_t consumed = p + m - k;
+            _carry.clear();
+            _boundary_found();
+            return consumed;
+        }
+        if (take == len) {
+            // trozo pequeño: todo está en _carry, conservar solo la cola
+            size_t keep = std::min(_carry.size(), m - 1);
+            _write(_carry.data(), _carry.size() - keep);
+            _carry.erase(0, _carry.size() - keep);
+            return len;
+        }
+        // ningún delimitador empieza dentro de la cola anterior
+        _write(_carry.data(), k);
+        _carry.clear();
+    }
+
+    size_t p = _find_delimiter(data, len);
+    if (p != std::string::npos) {
+        _write(data, p);
+        _boundary_found();
+        return p + m;
+    }
+    size_t keep = std::min(len, m - 1);
+    _write(data, len - keep);
+    _carry.assign(data + len - keep, keep);
+    return len;
+}
+
+size_t MultipartParser::_consume_after_boundary(const char *data, size_t len)
+{
+    size_t i = 0;
+    while (i < len && _headers.size() < 2)
+        _headers += data[i++];
+    if (_headers.size() < 2)
+        return i;
+    if (_headers == "--")
+        _state = MP_DONE; // el epílogo se ignora
+    else if (_headers == "\r\n")
+        _state = MP_HEADERS;
+    else
+        _state = MP_ERROR;
+    _headers.clear();
+    return (_state == MP_DONE) ? len : i;
+}
+
+size_t MultipartParser::_consume_headers(const char *data, size_t len)
+{
+    size_t old = _headers.size();
+    size_t take = std::min(len, static_cast<size_t>(MULTIPART_MAX_HEADERS) + 4 - old);
+    _headers.append(data, take);
+
+    size_t end = _headers.find("\r\n\r\n", old >= 3 ? old - 3 : 0);
+    if (end == std::string::npos) {
+        if (_headers.size() > MULTIPART_MAX_HEADERS) {
+            logError("Multipart: part headers too large");
+            _state = MP_ERROR;
+        }
+        return take;
+    }
+    size_t consumed = end + 4 - old;
+    _headers.erase(end);
+    if (!_open_part(_headers)) {
+        _state = MP_ERROR;
+        return consumed;
+    }
+    _headers.clear();
+    _state = MP_BODY;
+    return consumed;
+}
+
+/**
+ * Abre el fichero de destino si la parte trae `filename`. Se escribe en un
+ * temporal oculto que se renombra al cerrar la parte correctamente.
+ */
+bool MultipartParser::_open_part(const std::string &headers)
+{
+    std::vector<std::string> lines = split(headers, '\n');
+    std::string filename;
+    bool has_filename = false;
+
+    for (size_t i = 0; i < lines.size(); ++i) {
+        std::string line = lines[i];
+        strip(line, '\r');
+        if (readKey(line) != "Content-Disposition")
+            continue;
+        std::string value = readValue(line);
+        size_t pos = value.find("filename=");
+        if (pos == std::string::npos)
+            continue;
+        has_filename = true;
+        filename = value.substr(pos + 9);
+        if (!filename.empty() && filename[0] == '"') {
+            size_t close = filename.find('"', 1);
+            filename = filename.substr(1, close == std::string::npos ? std::string::npos : close - 1);
+        } else {
+            size_t semi = filename.find(';');
+            if (semi != std::string::npos)
+                filename.erase(semi);
+        }
+    }
+    if (!has_filename)
+        return true; // campo normal del formulario: se descarta
+
+    size_t slash = filename.find_last_of("/\\");
+    if (slash != std::string::npos)
+        filename = filename.substr(slash + 1);
+    if (filename.empty() || filename == "." || filename == "..") {
+        logError("Multipart: invalid upload filename");
+        return false;
+    }
+
+    // nombre temporal único: dos subidas del mismo fichero no se pisan
+    _final_path = _upload_dir + filename;
+    std::string tmpl = _upload_dir + "." + filename + ".XXXXXX";
+    std::vector<char> path(tmpl.begin(), tmpl.end());
+    path.push_back('\0');
+    _fd = mkostemp(&path[0], O_CLOEXEC);
+    if (_fd < 0) {
+        logError("Multipart: cannot create %s: %s", tmpl.c_str(), strerror(errno));
+        return false;
+    }
+    _tmp_path = &path[0];
+    fchmod(_fd, 0644); // mkstemp crea con 0600
+    return true;
+}
+
+void MultipartParser::_write(const char *data, size_t len)
+{
+    if (_fd < 0)
+        return;
+    size_t written = 0;
+    while (written < len) {
+        ssize_t n = write(_fd, data + written, len - written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            logError("Multipart: write to %s failed: %s", _tmp_path.c_str(), strerror(errno));
+            _abort_part();
+            _state = MP_ERROR;
+            return;
+        }
+        written += static_cast<size_t>(n);
+    }
+}
+
+void MultipartParser::_end_part()
+{
+    if (_fd < 0)
+        return;
+    close(_fd);
+    _fd = -1;
+    if (rename(_tmp_path.c_str(), _final_path.c_str()) != 0) {
+        logError("Multipart: rename to %s failed: %s", _final_path.c_str(), strerror(errno));
+        unlink(_tmp_path.c_str());
+        _state = MP_ERROR;
+        return;
+    }
+    logInfo("📦 Upload saved: %s", _final_path.c_str());
+    invalidate_path(_final_path);
+    _saved.push_back(_final_path);
+}
+
+void MultipartParser::_boundary_found()
+{
+    _end_part();
+    if (_state != MP_ERROR)
+        _state = MP_AFTER_BOUNDARY;
+}
+
+void MultipartParser::_abort_part()
+{
+    if (_fd < 0)
+        return;
+    close(_fd);
+    _fd = -1;
+    unlink(_tmp_path.c_str());
+}
+
+bool MultipartParser::finished() const
+{
+    return _state == MP_DONE;
+}
+
+bool MultipartParser::failed() const
+{
+    return _state == MP_ERROR;
+}
+
+const std::vector<std::string> &MultipartParser::savedFiles() const
+{
+    return _saved;
+}
@@ -19,148 +19,143 @@ int ReadConfig::createServerGroup(const std::string &config_file)
 	content = file.readFile(config_file);
 	if (content.empty())
 		throw ErrorException(EMPTY_FILE_ERR);
-	removeComments(content);
-	removeWhiteSpace(content);
-	splitServers(content);
-	if (this->_server_config.size() != this->_nb_server)
-		throw ErrorException(SIZE_FILE_ERR);
-	for (size_t i = 0; i < this->_nb_server; i++)
+	tokenize(content);
+	splitServers();
+	ConfigFile::beginBatch();
+	try
 	{
-		ServerUnit server;
-		createServer(this->_server_config[i], server);
-		logDebug("🍉 Server #%i created", i);
-		this->_servers.push_back(server);
+		for (size_t i = 0; i < this->_nb_server; i++)
+		{
+			ServerUnit server;
+			this->_at = this->_server_blocks[i].first - 1;
+			try
+			{
+				createServer(this->_server_blocks[i].first, this->_server_blocks[i].second, server);
+			}
+			catch (const std::exception &e)
+			{
+				throw ErrorException(e.what(), this->_positions[this->_at]);
+			}
+			logDebug("🍉 Server #%i created", i);
+			this->_servers.push_back(server);
+		}
+		if (this->_nb_server > 1)
+			checkServers();
 	}
-	if (this->_nb_server > 1)
-		checkServers();
-	return (0);
-}
-
-void ReadConfig::removeComments(std::string &content)
-{
-	size_t pos;
-
-	pos = content.find('#');
-	while (pos != std::string::npos)
+	catch (...)
 	{
-		size_t pos_end;
-		pos_end = content.find('\n', pos);
-		content.erase(pos, pos_end - pos);
-		pos = content.find('#');
+		ConfigFile::endBatch();
+		throw;
 	}
+	ConfigFile::endBatch();
+	return (0);
 }
 
-void ReadConfig::removeWhiteSpace(std::string &content)
-{
-	size_t	i = 0;
-
-	while (content[i] && isspace(content[i]))
-		i++;
-	content = content.substr(i);
-	i = content.length() - 1;
-	while (i > 0 && isspace(content[i]))
-		i--;
-	content = content.substr(0, i + 1);
-}
-
-void ReadConfig::splitServers(std::string &content)
+/**
+ * Parte el fichero en tokens: palabras separadas por espacios, y '{' y '}'
+ * siempre como tokens propios. Un '#' descarta el resto de la línea.
+ * El ';' sigue pegado a la palabra, como esperan las directivas.
+ */
+void ReadConfig::tokenize(const std::string &content)
 {
-	size_t start = 0;
-	size_t end = 1;
+	unsigned	line = 1;
+	size_t		line_start = 0;
+	size_t		i = 0;
 
-	if (content.find("server", 0) == std::string::npos)
-		throw ErrorException(FIND_FILE_ERR);
-	while (start != end && start < content.length())
+	while (i < content.size())
 	{
-		start = findStartServer(start, content);
-		end = findEndServer(start, content);
-		if (start == end)
-			throw ErrorException(SCOPE_FILE_ERR);
-		this->_server_config.push_back(content.substr(start, end - start + 1));
-		this->_nb_server++;
-		start = end + 1;
+		char c = content[i];
+		if (c == '\n')
+		{
+			line++;
+			line_start = ++i;
+			continue ;
+		}
+		if (isspace(static_cast<unsigned char>(c)))
+		{
+			i++;
+			continue ;
+		}
+		if (c == '#')
+		{
+			while (i < content.size() && content[i] != '\n')
+				i++;
+			continue ;
+		}
+		size_t start = i;
+		if (c == '{' || c == '}')
+			i++;
+		else
+		{
+			while (i < content.size() && !isspace(static_cast<unsigned char>(content[i]))
+				&& content[i] != '#' && content[i] != '{' && content[i] != '}')
+				i++;
+		}
+		ConfigPos pos;
+		pos.line = line;
+		pos.column = start - line_start + 1;
+		this->_tokens.push_back(content.substr(start, i - start));
+		this->_positions.push_back(pos);
 	}
 }
 
-size_t ReadConfig::findStartServer (size_t start, std::string &content)
+/** Cada bloque es `server {` ... `}` con las llaves equilibradas. */
+void ReadConfig::splitServers()
 {
-	size_t i;
+	size_t i = 0;
 
-	for (i = start; content[i]; i++)
-	{
-		if (content[i] == 's')
-			break ;
-		if (!isspace(content[i]))
-			throw ErrorException(SERVER_SCOPE_ERR);
-	}
-	if (!content[i])
-		return (start);
-	if (content.compare(i, 6, "server") != 0)
-		throw ErrorException(SERVER_SCOPE_ERR);
-	i += 6;
-	while (content[i] && isspace(content[i]))
-		i++;
-	if (content[i] == '{')
-		return (i);
-	else
-		throw ErrorException(SERVER_SCOPE_ERR);
-
-}
-
-size_t ReadConfig::findEndServer (size_t start, std::string &content)
-{
-	size_t	i;
-	size_t	scope;
-	
-	scope = 0;
-	for (i = start + 1; content[i]; i++)
+	if (std::find(this->_tokens.begin(), this->_tokens.end(), "server") == this->_tokens.end())
+		throw ErrorException(FIND_FILE_ERR);
+	while (i < this->_tokens.size())
 	{
-		if (content[i] == '{')
-			scope++;
-		if (content[i] == '}')
+		if (this->_tokens[i] != "server" || i + 1 >= this->_tokens.size() || this->_tokens[i + 1] != "{")
+			throw ErrorException(READ_CONFIG_ERR SERVER_SCOPE_ERR, this->_positions[i]);
+		size_t	start = i + 1;
+		size_t	scope = 0;
+		for (i = start + 1; i < this->_tokens.size(); i++)
 		{
-			if (!scope)
-				return (i);
-			scope--;
+			if (this->_tokens[i] == "{")
+				scope++;
+			else if (this->_tokens[i] == "}")
+			{
+				if (!scope)
+					break ;
+				scope--;
+			}
 		}
+		if (i == this->_tokens.size())
+			throw ErrorException(READ_CONFIG_ERR SCOPE_FILE_ERR, this->_positions[start]);
+		this->_server_blocks.push_back(std::make_pair(start, i));
+		this->_nb_server++;
+		i++;
 	}
-	return (start);
 }
 
-std::vector<std::string> splitTokens(const std::string& line, const std::string& separators) 
+/** Directivas de un bloque server: los tokens entre 'begin' ('{') y 'end' ('}'). */
+void ReadConfig::createServer(size_t begin, size_t end, ServerUnit &server)
 {
-    std::vector<std::string> tokens;
-    size_t start = line.find_first_not_of(separators), end = 0;
-    while ((end = line.find_first_of(separators, start)) != std::string::npos) {
-        tokens.push_back(line.substr(start, end - start));
-        start = line.find_first_not_of(separators, end);
-    }
-    if (start != std::string::npos)
-        tokens.push_back(line.substr(start));
-    return tokens;
-}
-
-
-void ReadConfig::createServer(std::string &config, ServerUnit &server)
-{
-	std::vector<std::string>	tokens;
+	const std::vector<std::string>	&tokens = this->_tokens;
 	std::vector<std::string>	error_codes;
 	int		flag_loc = 1;
 	bool	flag_autoindex = false;
 	bool	flag_max_size = false;
+	bool	flag_keepalive = false;
+	bool	flag_backlog = false;
+	bool	flag_defer_accept = false;
+	std::set<std::string>	socket_options;
 
-	tokens = splitTokens(config += ' ', std::string(" \n\t"));
-	if (tokens.size() < 3)
+	if (end - begin < 2)
 		throw ErrorException(SERVER_VALIDATION_ERR);
-	for (size_t i = 0; i < tokens.size(); i++)
+	for (size_t i = begin + 1; i < end; i++)
 	{
-		if (tokens[i] == "listen" && (i + 1) < tokens.size() && flag_loc)
+		this->_at = i;
+		if (tokens[i] == "listen" && (i + 1) < end && flag_loc)
 		{
 			if (server.getPort())
 				throw ErrorException(PORT_ERR);
 			server.setPort(tokens[++i]);
 		}
-		else if (tokens[i] == "location" && (i + 1) < tokens.size())
+		else if (tokens[i] == "location" && (i + 1) < end)
 		{
 			std::string	path;
 			i++;
@@ -171,56 +166,84 @@ void ReadConfig::createServer(std::string &config, ServerUnit &server)
 			if (tokens[++i] != "{")
 				throw ErrorException(SERVER_SCOPE_ERR);
 			i++;
-			while (i < tokens.size() && tokens[i] != "}")
+			while (i < end && tokens[i] != "}")
 				codes.push_back(tokens[i++]);
 			server.setLocation(path, codes);
-			if (i < tokens.size() && tokens[i] != "}")
+			if (i < end && tokens[i] != "}")
 				throw ErrorException(SERVER_SCOPE_ERR);
 			flag_loc = 0;
 		}
-		else if (tokens[i] == "host" && (i + 1) < tokens.size() && flag_loc)
+		else if (tokens[i] == "host" && (i + 1) < end && flag_loc)
 		{
 			if (server.getHost())
 				throw ErrorException(HOST_ERR);
 			server.setHost(tokens[++i]);
 		}
-		else if (tokens[i] == "root" && (i + 1) < tokens.size() && flag_loc)
+		else if (tokens[i] == "root" && (i + 1) < end && flag_loc)
 		{
 			if (!server.getRoot().empty())
 				throw ErrorException(ROOT_ERR);
 			server.setRoot(tokens[++i]);
 		}
-		else if (tokens[i] == "error_page" && (i + 1) < tokens.size() && flag_loc)
+		else if (tokens[i] == "error_page" && (i + 1) < end && flag_loc)
 		{
-			while (++i < tokens.size())
+			while (++i < end)
 			{
 				error_codes.push_back(tokens[i]);
 				if (tokens[i].find(';') != std::string::npos)
 					break ;
-				if (i + 1 >= tokens.size())
+				if (i + 1 >= end)
 					throw ErrorException(SERVER_SCOPE_ERR);
 			}
 		}
-		else if (tokens[i] == "client_max_body_size" && (i + 1) < tokens.size() && flag_loc)
+		else if (tokens[i] == "client_max_body_size" && (i + 1) < end && flag_loc)
 		{
 			if (flag_max_size)
 				throw ErrorException(CLIENT_ERR);
 			server.setClientMaxBodySize(tokens[++i]);
 			flag_max_size = true;
 		}
-		else if (tokens[i] == "server_name" && (i + 1) < tokens.size() && flag_loc)
+		else if (tokens[i] == KEEPALIVE_REQUESTS && (i + 1) < end && flag_loc)
+		{
+			if (flag_keepalive)
+				throw ErrorException(KEEPALIVE_ERR);
+			server.setKeepaliveRequests(tokens[++i]);
+			flag_keepalive = true;
+		}
+		else if (tokens[i] == BACKLOG && (i + 1) < end && flag_loc)
+		{
+			if (flag_backlog)
+				throw ErrorException(BACKLOG_ERR);
+			server.setBacklog(tokens[++i]);
+			flag_backlog = true;
+		}
+		else if (tokens[i] == DEFER_ACCEPT && (i + 1) < end && flag_loc)
+		{
+			if (flag_defer_accept)
+				throw ErrorException(DEFER_ACCEPT_ERR);
+			server.setDeferAccept(tokens[++i]);
+			flag_defer_accept = true;
+		}
+		else if (ServerUnit::isSocketOption(tokens[i]) && (i + 1) < end && flag_loc)
+		{
+			if (!socket_options.insert(tokens[i]).second)
+				throw ErrorException(SOCKET_OPT_ERR + tokens[i]);
+			server.setSocketOption(tokens[i], tokens[i + 1]);
+			i++;
+		}
+		else if (tokens[i] == "server_name" && (i + 1) < end && flag_loc)
 		{
 			if (!server.getServerName().empty())
 				throw ErrorException(SERVER_NAME_ERR);
 			server.setServerName(tokens[++i]);
 		}
-		else if (tokens[i] == "index" && (i + 1) < tokens.size() && flag_loc)
+		else if (tokens[i] == "index" && (i + 1) < end && flag_loc)
 		{
 			if (!server.getIndex().empty())
 				throw ErrorException(INDEX_ERR);
 			server.setIndex(tokens[++i]);
 		}
-		else if (tokens[i] == "autoindex" && (i + 1) < tokens.size() && flag_loc)
+		else if (tokens[i] == "autoindex" && (i + 1) < end && flag_loc)
 		{
 			if (flag_autoindex)
 				throw ErrorException(AUTOINDEX_ERR ": is duplicated");
@@ -235,6 +258,7 @@ void ReadConfig::createServer(std::string &config, ServerUnit &server)
 				throw ErrorException(DIRECTIVE_ERR);
 		}
 	}
+	this->_at = begin - 1; // lo que sigue es del bloque entero
 	// set default values if not set
 	if (server.getRoot().empty())
 		server.setRoot("/;");
@@ -256,18 +280,16 @@ void ReadConfig::createServer(std::string &config, ServerUnit &server)
 		throw ErrorException(ERROR_PAGE_ERR);
 }
 
+/** Dos servidores no pueden compartir host, puerto y server_name. */
 void ReadConfig::checkServers()
 {
-	std::vector<ServerUnit>::iterator it1;
-	std::vector<ServerUnit>::iterator it2;
+	std::set<std::pair<std::pair<in_addr_t, uint16_t>, std::string> >	seen;
+	std::vector<ServerUnit>::const_iterator								it;
 
-	for (it1 = this->_servers.begin(); it1 != this->_servers.end() - 1; it1++)
+	for (it = this->_servers.begin(); it != this->_servers.end(); it++)
 	{
-		for (it2 = it1 + 1; it2 != this->_servers.end(); it2++)
-		{
-			if (it1->getPort() == it2->getPort() && it1->getHost() == it2->getHost() && it1->getServerName() == it2->getServerName())
-				throw ErrorException(SERVER_ERR);
-		}
+		if (!seen.insert(std::make_pair(std::make_pair(it->getHost(), it->getPort()), it->getServerName())).second)
+			throw ErrorException(SERVER_ERR);
 	}
 }
 
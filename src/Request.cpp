@@ -18,9 +18,12 @@ std::vector<std::string>		Request::init_methods()
 
 std::vector<std::string>	Request::methods = Request::init_methods();
 
-Request::Request(const std::string& str) :
-	_method (""), _version(""), _ret(200), _body(""), _port(80), _path(""), _query(""), _raw(str), _autoindex(false), _matched_location(NULL)
+Request::Request(const std::string& str, Arena *arena) :
+	_method (""), _version(""), _fields(NULL), _nfields(0), _fields_cap(0), _arena(arena), _own_arena(NULL),
+	_ret(200), _body(""), _body_fd(-1), _port(80), _path(""), _query(""), _raw(str), _autoindex(false), _matched_location(NULL), _root("")
 {
+	if (!this->_arena)
+		this->_arena = this->_own_arena = new Arena();
 	this->resetHeaders();
 	this->parse(str);
 	if (this->_ret != 200)
@@ -29,15 +32,22 @@ Request::Request(const std::string& str) :
 
 Request::~Request()
 {
+	delete this->_own_arena;
 }
 
 Request&	Request::operator=(const Request& obj)
 {
-	this->_headers = obj.getHeaders();
+	// las cabeceras apuntan al buffer y la arena de obj, que deben seguir vivos
+	this->_fields = obj._fields;
+	this->_nfields = obj._nfields;
+	this->_fields_cap = obj._nfields;
+	for (int id = 0; id < H_COUNT; ++id)
+		this->_known[id] = obj._known[id];
 	this->_method = obj.getMethod();
 	this->_version = obj.getVersion();
 	this->_ret = obj.getRet();
 	this->_body = obj.getBody();
+	this->_body_fd = obj.getBodyFile();
 	this->_port = obj.getPort();
 	this->_path = obj.getPath();
 	this->_query = obj.getQuery();
@@ -47,9 +57,60 @@ Request&	Request::operator=(const Request& obj)
 
 /*** GETTERS ***/
 
-const std::map<std::string, std::string>&	Request::getHeaders() const
+StrRef	Request::getHeader(e_header_id id) const
 {
-	return this->_headers;
+	if (id == H_UNKNOWN || this->_known[id] < 0)
+		return StrRef();
+	return this->_fields[this->_known[id]].value;
+}
+
+/**
+ * Busca una cabecera sin distinguir mayúsculas. Las conocidas salen del
+ * índice en O(1); el resto, recorriendo el array. Si se repite, gana la
+ * última.
+ */
+StrRef	Request::getHeader(const char *name) const
+{
+	e_header_id	id = HeaderIndex::lookup(name, strlen(name));
+
+	if (id != H_UNKNOWN)
+		return this->getHeader(id);
+	for (size_t i = this->_nfields; i > 0; --i)
+		if (this->_fields[i - 1].name.iequals(name))
+			return this->_fields[i - 1].value;
+	return StrRef();
+}
+
+bool	Request::hasHeader(e_header_id id) const
+{
+	return id != H_UNKNOWN && this->_known[id] >= 0;
+}
+
+bool	Request::hasHeader(const char *name) const
+{
+	e_header_id	id = HeaderIndex::lookup(name, strlen(name));
+
+	if (id != H_UNKNOWN)
+		return this->hasHeader(id);
+	for (size_t i = 0; i < this->_nfields; ++i)
+		if (this->_fields[i].name.iequals(name))
+			return true;
+	return false;
+}
+
+size_t	Request::getHeaderCount() const
+{
+	return this->_nfields;
+}
+
+const HeaderField&	Request::getHeaderField(size_t i) const
+{
+	return this->_fields[i];
+}
+
+Arena&	Request::getArena() const
+{
+	return *this->_arena;
 }
 
 const std::string&	Request::getMethod() const
@@ -72,6 +133,11 @@ const std::string&	Request::getBody() const
 	return this->_body;
 }
 
+int					Request::getBodyFile() const
+{
+	return this->_body_fd;
+}
+
 int					Request::getPort() const
 {
 	return this->_port;
@@ -102,17 +168,21 @@ const bool&	Request::getAutoindex() const
 	return this->_autoindex;
 }
 
-const Location* Request::getMatchedLocation() const
+const CompiledLocation* Request::getMatchedLocation() const
 {
 	return this->_matched_location;
 }
+const std::string&	Request::getRoot() const
+{
+	return this->_root;
+}
 /*** SETTERS ***/
 
-void	Request::setBody(const std::string& str)
+void	Request::setBody(const StrRef& str)
 {
 	char	strip[] = {'\n', '\r'};
 
-	this->_body.assign(str);
+	this->_body.assign(str.data, str.len);
 	for (int i = 0; i < 4; i++)
 		if (this->_body.size() > 0 && this->_body[this->_body.size() - 1] == strip[i % 2])
 			pop(this->_body);
@@ -120,6 +190,12 @@ void	Request::setBody(const std::string& str)
 			break ;
 }
 
+/** El cuerpo está en 'fd' (lo posee quien llama); Cgi lo usa como stdin sin copiarlo. */
+void	Request::setBodyFile(int fd)
+{
+	this->_body_fd = fd;
+}
+
 void	Request::setRet(int ret)
 {
 	this->_ret = ret;
@@ -145,102 +221,121 @@ void	Request::setAutoindex(bool ai)
 	this->_autoindex = ai;
 }
 
-void	Request::setMatchedLocation(const Location *loc)
+void	Request::setMatchedLocation(const CompiledLocation *loc)
 {
 	this->_matched_location = loc;
 }
+void	Request::setRoot(const std::string &root)
+{
+	this->_root = root;
+}
 void				Request::resetHeaders()
 {
-	this->_headers.clear();
-
-	this->_headers["Accept-Charsets"] = ""; //ya no se usa, esta obsoleto
-	this->_headers["Accept-Language"] = ""; // es, en, ... Client
-	this->_headers["Allow"] = ""; // "GET, POST, PUT, DELETE, OPTIONS, HEAD, TRACE"
-	this->_headers["Authorization"] = "";
-	this->_headers["Content-Language"] = ""; //es, en, ... Server
-	this->_headers["Content-Length"] = ""; //longitud del cuerpo de la peticion
-	this->_headers["Content-Location"] = ""; // la URL del recurso
-	this->_headers["Content-Type"] = ""; //MIME type, text/html, application/json, image/png, etc.
-	this->_headers["Date"] = ""; // Ayuda con cachés, sincronización y diagnóstico
-	this->_headers["Host"] = "";
-	this->_headers["Last-Modified"] = ""; // Fecha de la última modificación del recurso
-	this->_headers["Location"] = "";
-	this->_headers["Referer"] = ""; // URL de la página que envió la solicitud actual
-	this->_headers["Retry-After"] = ""; // Indica cuánto tiempo (en segundos) debe esperar el cliente antes de volver a enviar la solicitud
-	this->_headers["Server"] = ""; // Información sobre el servidor que maneja la solicitud
-	this->_headers["Transfer-Encoding"] = ""; // Indica cómo se codifica el cuerpo de la solicitud para la transmisión
-	this->_headers["User-Agent"] = ""; // Información sobre el cliente que realiza la solicitud
-	this->_headers["Www-Authenticate"] = ""; // Indica el esquema de autenticación que el servidor requiere para acceder al recurso
-	this->_headers["Connection"] = "Keep-Alive"; // por defecto los request son Keep-Alive
+	// Antes se rellenaba un map con ~20 cabeceras vacías en cada petición.
+	// Ahora solo se guardan las que llegan, como vistas sobre el buffer crudo.
+	this->_fields = NULL;
+	this->_nfields = 0;
+	this->_fields_cap = 0;
+	for (int id = 0; id < H_COUNT; ++id)
+		this->_known[id] = -1;
+}
+
+/**
+ * Añade una cabecera al array de la arena. Si se llena, se duplica: el
+ * array viejo se queda en la arena hasta el reset(), que es barato.
+ */
+void				Request::addHeader(const StrRef& name, const StrRef& value)
+{
+	if (this->_nfields == this->_fields_cap)
+	{
+		size_t			cap = this->_fields_cap ? this->_fields_cap * 2 : REQUEST_INITIAL_FIELDS;
+		HeaderField		*fields = static_cast<HeaderField*>(this->_arena->alloc(cap * sizeof(HeaderField)));
+
+		for (size_t i = 0; i < this->_nfields; ++i)
+			fields[i] = this->_fields[i];
+		this->_fields = fields;
+		this->_fields_cap = cap;
+	}
+	HeaderField	&field = this->_fields[this->_nfields];
+
+	field.name = name;
+	field.value = value;
+	field.id = HeaderIndex::lookup(name.data, name.len);
+	if (field.id != H_UNKNOWN)
+		this->_known[field.id] = static_cast<int>(this->_nfields);
+	this->_nfields++;
 }
 
 int					Request::parse(const std::string& str)
 {
-	std::string		key;
-	std::string		value;
-	std::string		line;
+	StrRef			raw(str);
+	StrRef			line;
 	size_t			i = 0;
+	size_t			colon;
 
-	this->read_first_line(nextLine(str, i));
-	while ((line = nextLine(str, i)) != "\r" && line != "" && this->_ret != 400)
+	this->read_first_line(nextLine(raw, i));
+	while (this->_ret != 400 && !(line = nextLine(raw, i)).empty())
 	{
-		key = readKey(line);
-        
-		value = readValue(line);
-		if (this->_headers.count(key))
-				this->_headers[key] = value;
+		if ((colon = line.find(':')) == std::string::npos)
+			continue ;
+		this->addHeader(line.sub(0, colon).trim(' '), line.sub(colon + 1).trim(' '));
 	}
 	this->setLang();
-	this->setBody(str.substr(i, std::string::npos));
+	if (i != std::string::npos)
+		this->setBody(raw.sub(i));
 	this->checkPort();
 	this->findQuery();
 	return this->_ret;
 }
 
-int					Request::read_first_line(const std::string& str)
+int					Request::read_first_line(const StrRef& line)
 {
-	size_t	i;
-	std::string	line;
-
-	i = str.find_first_of('\n');
-	line = str.substr(0, i);
-	i = line.find_first_of(' ');
+	size_t	i = line.find(' ');
 
 	if (i == std::string::npos)
 	{
 		this->_ret = 400;
-		logError("RFL no space after method. Line: <%s>", line.c_str());
+		logError("RFL no space after method. Line: <%s>", line.str().c_str());
 		return 400;
 	}
-	this->_method.assign(line, 0, i);
+	this->_method.assign(line.data, i);
 	return this->readPath(line, i);
 }
 
+/**
+ * Accept-Language: "es-ES, en;q=0.8" -> [(es, 1.0), (en, 0.8)], ordenado
+ * por peso. Se recorre la cabecera en sitio, sin split().
+ */
 void				Request::setLang()
 {
-	std::vector<std::string>	token;
-	std::string					header;
-	size_t						i;
+	StrRef		header = this->getHeader(H_ACCEPT_LANGUAGE);
+	size_t		start = 0;
 
-	if ((header = this->_headers["Accept-Language"]) != "")
+	if (header.empty())
+		return ;
+	while (start <= header.len)
 	{
-		token = split(header, ',');
-		for (std::vector<std::string>::iterator it = token.begin(); it != token.end(); it++)
+		size_t	end = header.find(',', start);
+		StrRef	token = header.sub(start, end == std::string::npos ? std::string::npos : end - start).trim(' ');
+		size_t	semi = token.find(';');
+		StrRef	tag = token.sub(0, semi).trim(' ');
+		float	weight = 1.0;
+
+		if (semi != std::string::npos)
 		{
-			float			weight = 0.0;
-			std::string		lang;
-
-			lang = (*it).substr(0, (*it).find_first_of('-'));
-			strip(lang, ' ');
-			if ( (i = lang.find_last_of(';') ) != std::string::npos)
-			{
-				weight = atof( (*it).substr(i + 4).c_str() );
-			}
-			lang.resize(i > 2 ? 2 : i);
-			this->_lang.push_back(std::pair<std::string, float>(lang, weight));
+			StrRef	param = token.sub(semi + 1).trim(' ');
+			if (param.len > 2 && param.data[0] == 'q' && param.data[1] == '=')
+				weight = atof(param.sub(2).str().c_str());
 		}
-		this->_lang.sort(compare_langs);
+		size_t	dash = tag.find('-');
+		tag = tag.sub(0, dash == std::string::npos ? 2 : std::min(dash, static_cast<size_t>(2)));
+		if (!tag.empty())
+			this->_lang.push_back(std::pair<std::string, float>(tag.str(), weight));
+		if (end == std::string::npos)
+			break ;
+		start = end + 1;
 	}
+	this->_lang.sort(compare_langs);
 }
 
 void				Request::stripAll()
@@ -256,22 +351,25 @@ void				Request::stripAll()
 	strip(this->_path, ' ');
 }
 
-std::string			Request::nextLine(const std::string &str, size_t& i)
+/**
+ * Devuelve la siguiente línea (sin CRLF) como vista sobre str y avanza i.
+ */
+StrRef				Request::nextLine(const StrRef &str, size_t& i)
 {
-	std::string		ret;
+	StrRef			ret;
 	size_t			j;
 
 	if (i == std::string::npos)
-		return "";
-	j = str.find_first_of('\n', i);
-	ret = str.substr(i, j - i);
-	if (ret[ret.size() - 1] == '\r')
-		pop(ret);
+		return StrRef();
+	j = str.find('\n', i);
+	ret = str.sub(i, j == std::string::npos ? std::string::npos : j - i);
+	if (ret.len && ret.data[ret.len - 1] == '\r')
+		ret.len--;
 	i = (j == std::string::npos ? j : j + 1);
 	return ret;
 }
 
-int					Request::readPath(const std::string& line, size_t size)
+int					Request::readPath(const StrRef& line, size_t size)
 {
 	size_t	n_spaces;
 
@@ -283,18 +381,18 @@ int					Request::readPath(const std::string& line, size_t size)
 		return 400;
 	}
 	// read path
-	if ((size = line.find_first_of(' ', n_spaces)) == std::string::npos)
+	if ((size = line.find(' ', n_spaces)) == std::string::npos)
 	{
 		this->_ret = 400;
 		std::cerr << RED << "No HTTP version" << RESET << std::endl;
 		return 400;
 	}
-	this->_path.assign(line, n_spaces, size - n_spaces);
+	this->_path.assign(line.data + n_spaces, size - n_spaces);
 	return this->readVersion(line, size);
 }
 
 
-int					Request::readVersion(const std::string& line, size_t i)
+int					Request::readVersion(const StrRef& line, size_t i)
 {
 	if ((i = line.find_first_not_of(' ', i)) == std::string::npos)
 	{
@@ -302,9 +400,8 @@ int					Request::readVersion(const std::string& line, size_t i)
 		std::cerr << RED << "No HTTP version" << RESET << std::endl;
 		return 400;
 	}
-	if (line[i] == 'H' && line[i + 1] == 'T' && line[i + 2] == 'T' &&
-			line[i + 3] == 'P' && line[i + 4] == '/')
-		this->_version.assign(line, i + 5, 3);
+	if (line.len - i >= 8 && memcmp(line.data + i, "HTTP/", 5) == 0)
+		this->_version.assign(line.data + i + 5, 3);
 	if (this->_version != "1.0" && this->_version != "1.1") // solo soportamos HTTP/1.1 o tambien HTTP/1.0
 	{
 		this->_ret = 400;
@@ -329,14 +426,16 @@ int					Request::checkMethod()
 
 int					Request::checkPort()
 {
-	size_t i = this->_headers["Host"].find_first_of(':');
+	StrRef	host = this->getHeader(H_HOST);
+	size_t	i = host.find(':');
 
 	if (i == std::string::npos)
 		this->_port = 8080; // por defecto
 	else
 	{
-		std::string tmp(this->_headers["Host"], i + 1);
-		this->_port = ft_atoi(tmp.c_str());
+		this->_port = 0;
+		for (++i; i < host.len && this->_port < 65536 && isdigit(static_cast<unsigned char>(host.data[i])); ++i)
+			this->_port = this->_port * 10 + (host.data[i] - '0');
 	}
 	return (this->_port);
 }
@@ -350,21 +449,19 @@ void				Request::findQuery()
 	{
 		logDebug("[DEBUG] Query found in path");
 		this->_query.assign(this->_path, i + 1, std::string::npos);
-		this->_path = this->_path.substr(0, i);
+		this->_path.erase(i);
 	}
 }
 
 std::ostream&		operator<<(std::ostream& os, const Request& re)
 {
-	std::map<std::string, std::string>::const_iterator	it;
-
 	os << "Method : " << re.getMethod() << " |\tHTTP version : ";
 	os << re.getVersion() << '\n';
 	os << "Port : " << re.getPort() << '\n';
 	os << "Path : " << re.getPath() << '\n';
 
-	for (it = re.getHeaders().begin(); it != re.getHeaders().end(); it++)
-		os << it->first << ": " << it->second << '\n';
+	for (size_t i = 0; i < re.getHeaderCount(); i++)
+		os << re.getHeaderField(i).name.str() << ": " << re.getHeaderField(i).value.str() << '\n';
 
 	os << '\n' << "Request body :\n" << re.getBody() << '\n';
 
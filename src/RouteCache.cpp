@@ -0,0 +1,73 @@
+#include "../include/WebServ.hpp"
+
+unsigned	RouteCache::_fs_epoch = 0;
+bool		RouteCache::_hooked = false;
+
+ResolvedRoute::ResolvedRoute() : status(0), location(NULL), autoindex(false), pending(false) {}
+
+bool RouteCache::Key::operator<(const Key &other) const {
+    if (server != other.server)
+        return server < other.server;
+    if (method != other.method)
+        return method < other.method;
+    return path < other.path;
+}
+
+RouteCache::RouteCache() : _epoch(_fs_epoch) {
+    if (!_hooked) {
+        add_invalidation_hook(&RouteCache::_on_invalidate);
+        _hooked = true;
+    }
+}
+
+/** Cualquier cambio en disco invalida todas las cachés de rutas. */
+void RouteCache::_on_invalidate(const std::string &) {
+    ++_fs_epoch;
+}
+
+/** Ruta resuelta vigente para la petición, o NULL si hay que resolverla. */
+const ResolvedRoute *RouteCache::find(const ServerUnit *server, int method, const std::string &path) {
+    if (_epoch != _fs_epoch) {
+        clear();
+        _epoch = _fs_epoch;
+    }
+    Key key;
+    key.server = server;
+    key.method = method;
+    key.path = path;
+    std::map<Key, Entry>::iterator it = _entries.find(key);
+    if (it == _entries.end() || Metrics::now() >= it->second.valid_until) {
+        Metrics::cacheLookup("route", false);
+        return NULL;
+    }
+    Metrics::cacheLookup("route", true);
+    _lru.splice(_lru.begin(), _lru, it->second.lru);
+    return &it->second.route;
+}
+
+const ResolvedRoute &RouteCache::store(const ServerUnit *server, int method, const std::string &path,
+                                       const ResolvedRoute &route) {
+    Key key;
+    key.server = server;
+    key.method = method;
+    key.path = path;
+    std::map<Key, Entry>::iterator it = _entries.find(key);
+    if (it == _entries.end()) {
+        it = _entries.insert(std::make_pair(key, Entry())).first;
+        it->second.lru = _lru.insert(_lru.begin(), &it->first);
+    } else
+        _lru.splice(_lru.begin(), _lru, it->second.lru);
+    it->second.route = route;
+    it->second.valid_until = Metrics::now() + OPEN_FILE_CACHE_VALID * 1000000ULL;
+    if (_entries.size() > ROUTE_CACHE_MAX) {
+        std::map<Key, Entry>::iterator last = _entries.find(*_lru.back());
+        _lru.pop_back();
+        _entries.erase(last);
+    }
+    return it->second.route;
+}
+
+void RouteCache::clear() {
+    _entries.clear();
+    _lru.clear();
+}
@@ -0,0 +1,199 @@
+#include "../include/WebServ.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+# define SCANNER_X86 1
+#endif
+
+/*** ESCALAR ***/
+
+static size_t scalar_find_byte(const char *p, size_t len, char c) {
+    for (size_t i = 0; i < len; ++i)
+        if (p[i] == c)
+            return i;
+    return std::string::npos;
+}
+
+static size_t scalar_find_crlf(const char *p, size_t len) {
+    for (size_t i = 0; i + 1 < len; ++i)
+        if (p[i] == '\r' && p[i + 1] == '\n')
+            return i;
+    return std::string::npos;
+}
+
+#ifdef SCANNER_X86
+
+/*** SSE2: 16 bytes por iteración ***/
+
+# ifdef __SSE2__
+static size_t sse2_find_byte(const char *p, size_t len, char c) {
+    const __m128i needle = _mm_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    size_t tail = scalar_find_byte(p + i, len - i, c);
+    return tail == std::string::npos ? tail : i + tail;
+}
+
+/** '\r' en la posición i y '\n' en i + 1: dos cargas desplazadas y un AND. */
+static size_t sse2_find_crlf(const char *p, size_t len) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 17 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 1));
+        int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, cr), _mm_cmpeq_epi8(b, lf)));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    size_t tail = scalar_find_crlf(p + i, len - i);
+    return tail == std::string::npos ? tail : i + tail;
+}
+# endif
+
+/*** AVX2: 32 bytes por iteración, compilado aparte con target("avx2") ***/
+
+__attribute__((target("avx2")))
+static size_t avx2_find_byte(const char *p, size_t len, char c) {
+    const __m256i needle = _mm256_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, needle));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    size_t tail = scalar_find_byte(p + i, len - i, c);
+    return tail == std::string::npos ? tail : i + tail;
+}
+
+__attribute__((target("avx2")))
+static size_t avx2_find_crlf(const char *p, size_t len) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 33 <= len; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i + 1));
+        unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, cr), _mm256_cmpeq_epi8(b, lf)));
+        if (mask)
+            return i + __builtin_ctz(mask);
+    }
+    size_t tail = scalar_find_crlf(p + i, len - i);
+    return tail == std::string::npos ? tail : i + tail;
+}
+
+#endif
+
+/*** DESPACHO ***/
+
+Scanner::t_find_byte    Scanner::_find_byte = scalar_find_byte;
+Scanner::t_find_crlf    Scanner::_find_crlf = scalar_find_crlf;
+e_scanner_impl          Scanner::_impl = SCAN_SCALAR;
+bool                    Scanner::_ready = false;
+
+void Scanner::_select() {
+    e_scanner_impl best = SCAN_SCALAR;
+#ifdef SCANNER_X86
+# ifdef __SSE2__
+    best = SCAN_SSE2;
+# endif
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        best = SCAN_AVX2;
+#endif
+    const char *env = getenv("WEBSERV_SCANNER");
+    if (env && strcmp(env, "scalar") == 0)
+        best = SCAN_SCALAR;
+    else if (env && strcmp(env, "sse2") == 0 && best >= SCAN_SSE2)
+        best = SCAN_SSE2;
+    force(best);
+}
+
+/**
+ * Fija la implementación (los benchmarks comparan las tres). Si la CPU o el
+ * compilador no soportan la pedida, se queda con la escalar.
+ */
+void Scanner::force(e_scanner_impl impl) {
+    _find_byte = scalar_find_byte;
+    _find_crlf = scalar_find_crlf;
+    _impl = SCAN_SCALAR;
+#ifdef SCANNER_X86
+# ifdef __SSE2__
+    if (impl == SCAN_SSE2) {
+        _find_byte = sse2_find_byte;
+        _find_crlf = sse2_find_crlf;
+        _impl = SCAN_SSE2;
+    }
+# endif
+    if (impl == SCAN_AVX2 && __builtin_cpu_supports("avx2")) {
+        _find_byte = avx2_find_byte;
+        _find_crlf = avx2_find_crlf;
+        _impl = SCAN_AVX2;
+    }
+#endif
+    _ready = true;
+}
+
+e_scanner_impl Scanner::impl() {
+    if (!_ready)
+        _select();
+    return _impl;
+}
+
+const char *Scanner::implName() {
+    switch (impl()) {
+        case SCAN_AVX2: return "avx2";
+        case SCAN_SSE2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+/*** BÚSQUEDAS ***/
+
+size_t Scanner::findByte(const char *p, size_t len, char c) {
+    if (!_ready)
+        _select();
+    return _find_byte(p, len, c);
+}
+
+size_t Scanner::findCrlf(const char *p, size_t len) {
+    if (!_ready)
+        _select();
+    return _find_crlf(p, len);
+}
+
+/**
+ * Busca "\r\n\r\n" empezando en `resume` y deja en `resume` desde dónde
+ * seguir la próxima vez que lleguen bytes (o, si lo encuentra, su
+ * posición), así cada byte del buffer se examina una sola vez aunque las
+ * cabeceras lleguen en muchos recv() o se pregunte varias veces.
+ * Devuelve la posición del primer '\r' o npos.
+ */
+size_t Scanner::findHeaderEnd(const char *p, size_t len, size_t &resume) {
+    size_t start = resume;
+
+    while (start < len) {
+        size_t k = findCrlf(p + start, len - start);
+        if (k == std::string::npos)
+            break;
+        size_t i = start + k;
+        if (i + 4 > len) {
+            resume = i; // CRLF al final: falta ver si le sigue otro
+            return std::string::npos;
+        }
+        if (p[i + 2] == '\r' && p[i + 3] == '\n') {
+            resume = i; // otra llamada lo vuelve a encontrar sin repasar nada
+            return i;
+        }
+        start = i + 2;
+    }
+    // un '\r' suelto al final puede ser el comienzo de un CRLF
+    resume = (len > 0 && p[len - 1] == '\r') ? len - 1 : len;
+    return std::string::npos;
+}
@@ -1,52 +1,204 @@
 #include "../include/WebServ.hpp"
 #include <stdexcept>
+#include <climits>
 
-bool ServerManager::_running = true; // Initialize the static running variable
+enum e_io_op { IO_ACCEPT = 1, IO_RECV, IO_SEND, IO_READ, IO_POLL, IO_CANCEL, IO_CLOSE };
+
+# define IO_PAYLOAD_MASK ((1ULL << 56) - 1)
+
+/** user_data de una operación de io_uring: la operación en los 8 bits altos. */
+static unsigned long long io_tag(e_io_op op, unsigned long long payload) {
+    return (static_cast<unsigned long long>(op) << 56) | payload;
+}
+
+/** Carga útil para un socket: serial de la conexión y fd (24 bits). */
+static unsigned long long io_socket(unsigned serial, int fd) {
+    return (static_cast<unsigned long long>(serial) << 24) | static_cast<unsigned>(fd);
+}
+
+/** Clave de _lookups de un intercambio FastCGI en curso. */
+static std::string fastcgi_key(const IoJob *job) {
+    char key[32];
+    snprintf(key, sizeof(key), "F%p", static_cast<const void*>(job));
+    return key;
+}
+
+volatile sig_atomic_t ServerManager::_running = 1; // Initialize the static running variable
+volatile sig_atomic_t ServerManager::_term_requested = 0;
+volatile sig_atomic_t ServerManager::_upgrade_requested = 0;
+volatile sig_atomic_t ServerManager::_reload_requested = 0;
 
 ClientRequest::ClientRequest()
-        : buffer(""), max_size(0), current_size(0), content_length(-1), is_chunked(false),
-            header_end(std::string::npos), body_start(0),
-            request_path(""), method(""), headers_parsed(false) {}
+        : buffer(""), max_size(0), current_size(0), content_length(-1), is_chunked(false), bad_framing(false),
+            chunk_pos(0), header_end(std::string::npos), scan_pos(0), body_start(0),
+            request_path(""), method(""), content_type(""), headers_parsed(false),
+            keep_alive(true), started(0) {}
+
+UringState::UringState()
+        : serial(0), recv_armed(false), polled(false), send_busy(false), more(false), corked(false), total(0) {}
 
 void ClientRequest::append_to_buffer(const std::string& chunk) {
     buffer += chunk;
     current_size += chunk.size();
 }
 
+/**
+ * Decodifica el cuerpo chunked que empieza en body_start, retomando donde
+ * se quedó la vez anterior. Completo (chunk final y trailers), el buffer
+ * pasa a llevar los datos decodificados y content_length su tamaño: la
+ * petición sigue como una con Content-Length y lo que venga detrás es la
+ * siguiente del pipeline, nunca parte del cuerpo. Devuelve 1 si está
+ * completo, 0 si falta cuerpo, -1 si está mal formado y -2 si supera
+ * max_size (se sabe en cuanto llega el tamaño del chunk).
+ */
+int ClientRequest::dechunk_body() {
+    if (chunk_pos < body_start)
+        chunk_pos = body_start;
+    for (;;) {
+        size_t eol = buffer.find("\r\n", chunk_pos);
+        if (eol == std::string::npos)
+            return 0;
+        size_t size = 0;
+        size_t i = chunk_pos;
+        for (; i < eol; ++i) {
+            char c = buffer[i];
+            int digit = (c >= '0' && c <= '9') ? c - '0'
+                      : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+                      : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+            if (digit < 0)
+                break;
+            if (size > (static_cast<size_t>(-1) >> 4))
+                return -1;
+            size = size << 4 | digit;
+        }
+        if (i == chunk_pos || (i < eol && buffer[i] != ';' && buffer[i] != ' ' && buffer[i] != '\t'))
+            return -1; // sin tamaño, o basura antes de las extensiones
+        if (size == 0)
+            break;
+        if (max_size > 0 && size > max_size - std::min(max_size, chunk_data.size()))
+            return -2;
+        size_t data = eol + 2;
+        if (buffer.size() - data < size + 2)
+            return 0;
+        if (buffer.compare(data + size, 2, "\r\n") != 0)
+            return -1;
+        chunk_data.append(buffer, data, size);
+        chunk_pos = data + size + 2;
+    }
+    // chunk final: trailers (ignorados) hasta una línea vacía
+    size_t line = buffer.find("\r\n", chunk_pos) + 2;
+    for (;;) {
+        size_t eol = buffer.find("\r\n", line);
+        if (eol == std::string::npos)
+            return 0;
+        if (eol == line)
+            break;
+        line = eol + 2;
+    }
+    buffer.replace(body_start, line + 2 - body_start, chunk_data);
+    current_size = buffer.size();
+    content_length = static_cast<long>(chunk_data.size());
+    std::string().swap(chunk_data);
+    return 1;
+}
+
 ServerManager::ServerManager()
-  : _max_fd(0)
+  : _config(NULL), _max_fd(0), _draining(false), _drain_deadline(0), _argv(NULL),
+    _upgrade_pid(-1), _upgrade_fd(-1), _uring(NULL), _io_serial(0), _file_read_seq(0),
+    _body_fd(-1), _body_size(0), _io_pool(NULL), _fcgi_pool(NULL)
 {
+    _splice_pipe[0] = -1;
+    _splice_pipe[1] = -1;
 }
 
-ServerManager::~ServerManager(){}
+/**
+ * Guarda argv para que SIGUSR2 pueda volver a ejecutar el binario. La ruta
+ * se resuelve ahora: si luego se sustituye el fichero, se lanza el nuevo.
+ */
+void ServerManager::setCommandLine(char **argv) {
+    _argv = argv;
+    char resolved[PATH_MAX];
+    if (argv && argv[0] && strchr(argv[0], '/') && realpath(argv[0], resolved))
+        _exe_path = resolved;
+    else if (argv && argv[0])
+        _exe_path = argv[0];
+}
+
+/** Fichero que se vuelve a leer con SIGHUP. */
+void ServerManager::setConfigPath(const std::string &path) {
+    _config_path = path;
+}
+
+ServerManager::~ServerManager(){
+    std::map<int, MultipartParser*>::iterator it;
+    for (it = _uploads.begin(); it != _uploads.end(); ++it)
+        delete it->second;
+    for (std::map<int, int>::iterator body = _cgi_bodies.begin(); body != _cgi_bodies.end(); ++body)
+        close(body->second);
+    if (_splice_pipe[0] >= 0) {
+        close(_splice_pipe[0]);
+        close(_splice_pipe[1]);
+    }
+    std::map<int, Arena*>::iterator ar;
+    for (ar = _arenas.begin(); ar != _arenas.end(); ++ar)
+        delete ar->second;
+    std::map<int, ConfigSnapshot*>::iterator cfg;
+    for (cfg = _client_config.begin(); cfg != _client_config.end(); ++cfg)
+        cfg->second->release();
+    if (_config)
+        _config->release();
+    delete _io_pool; // antes que _file_reads: sus hilos pueden estar escribiendo en ellas
+    delete _fcgi_pool;
+    delete _uring;
+}
 
 void ServerManager::setup(const std::vector<ServerUnit>& configs) {
 
-    _servers = configs;
-    logDebug("Setting up %zu server(s)", _servers.size());
-    
-    for (size_t i = 0; i < _servers.size(); ++i) 
+    std::vector<ServerUnit> servers(configs);
+    std::vector<int> opened;
+    logDebug("Setting up %zu server(s)", servers.size());
+    _load_inherited_fds();
+    _bind_servers(servers, opened);
+
+    // heredados que la configuración ya no usa
+    std::map<std::pair<in_addr_t, int>, int>::iterator it;
+    for (it = _inherited.begin(); it != _inherited.end(); ++it) {
+        logInfo("Closing inherited socket %d: no server listens on port %d", it->second, it->first.second);
+        close(it->second);
+    }
+    _inherited.clear();
+    _config = new ConfigSnapshot(servers, 1);
+}
+
+/**
+ * Asigna a cada server su socket de escucha: el que ya exista para el mismo
+ * host:port (de esta configuración o de la anterior, en una recarga), uno
+ * heredado del proceso viejo tras SIGUSR2 o, si no, uno nuevo. Los nuevos
+ * se añaden a `opened` para poder deshacerlos si la recarga falla.
+ */
+void ServerManager::_bind_servers(std::vector<ServerUnit> &servers, std::vector<int> &opened) {
+    for (size_t i = 0; i < servers.size(); ++i)
     {
-        ServerUnit &server = _servers[i];
+        ServerUnit &server = servers[i];
+        std::pair<in_addr_t, int> addr(server.getHost(), server.getPort());
         bool reused = false;
 
-        for (size_t j = 0; j < i; ++j) {
-            const ServerUnit &prev = _servers[j];
-            if (prev.getHost() == server.getHost() &&
-                prev.getPort() == server.getPort())
-            {
-                server.setFd(prev.getFd());
+        std::map<int, std::pair<in_addr_t, int> >::iterator ls;
+        for (ls = _listeners.begin(); ls != _listeners.end(); ++ls) {
+            if (ls->second == addr) {
+                server.setFd(ls->first);
                 reused = true;
                 break;
             }
         }
 
         if (!reused) {
-            server.setUpIndividualServer();
+            if (!_adopt_inherited_fd(server))
+                server.setUpIndividualServer();
+            _listeners[server.getFd()] = addr;
+            opened.push_back(server.getFd());
         }
 
-        _servers_map[server.getFd()] = server;
-
         char ipbuf[INET_ADDRSTRLEN];
         inet_ntop(AF_INET, &server.getHost(), ipbuf, sizeof(ipbuf));
         logInfo(
@@ -58,21 +210,208 @@ void ServerManager::setup(const std::vector<ServerUnit>& configs) {
         );
     }
 }
-void ServerManager::_init_server_unit(ServerUnit &server) {
-    const int fd = server.getFd();
-    if (listen(fd, BACKLOG_SIZE) < 0) {
+
+/**
+ * Tras un SIGUSR2 el proceso nuevo recibe en ENV_LISTEN_FDS la lista de
+ * sockets de escucha del viejo ("3,4,7"). La dirección de cada uno se
+ * consulta con getsockname() para asignarlo al server con el mismo host:port.
+ */
+void ServerManager::_load_inherited_fds() {
+    const char *env = getenv(ENV_LISTEN_FDS);
+    if (!env)
+        return;
+    std::string list(env);
+    unsetenv(ENV_LISTEN_FDS); // que no lo hereden los CGI
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        int fd = atoi(item.c_str());
+        sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        if (fd <= 2 || getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) < 0
+            || addr.sin_family != AF_INET) {
+            logError("Ignoring inherited fd '%s': not an IPv4 socket", item.c_str());
+            continue;
+        }
+        _inherited[std::make_pair(addr.sin_addr.s_addr, static_cast<int>(ntohs(addr.sin_port)))] = fd;
+    }
+}
+
+bool ServerManager::_adopt_inherited_fd(ServerUnit &server) {
+    std::map<std::pair<in_addr_t, int>, int>::iterator it =
+        _inherited.find(std::make_pair(server.getHost(), static_cast<int>(server.getPort())));
+    if (it == _inherited.end())
+        return false;
+    server.setFd(it->second);
+    set_nonblocking(it->second);
+    fcntl(it->second, F_SETFD, FD_CLOEXEC);
+    logInfo("Reusing inherited listening socket %d for port %d", it->second, server.getPort());
+    _inherited.erase(it);
+    return true;
+}
+
+/** Avisa al proceso que nos lanzó de que ya estamos escuchando. */
+void ServerManager::_notify_ready() {
+    const char *env = getenv(ENV_READY_FD);
+    if (!env)
+        return;
+    int fd = atoi(env);
+    unsetenv(ENV_READY_FD);
+    if (write(fd, "1", 1) != 1)
+        logError("Failed to notify parent process: %s", strerror(errno));
+    close(fd);
+}
+/**
+ * Registra los backends FastCGI de las locations del server y,
+ * si tienen `fastcgi_spawn`, lanza sus workers persistentes.
+ */
+void ServerManager::_setup_fastcgi(const ServerUnit &server) {
+    const std::vector<Location> &locations = server.getLocations();
+    for (size_t i = 0; i < locations.size(); ++i) {
+        const Location &loc = locations[i];
+        if (loc.getFastCgiPass().empty())
+            continue;
+        FastCgiPool::configure(loc.getFastCgiPass(), loc.getFastCgiPool(), loc.getFastCgiQueue());
+        if (!_fcgi_pool)
+            _start_fastcgi_pool();
+        if (!loc.getFastCgiSpawn().empty() && !FastCgiPool::hasWorkers(loc.getFastCgiPass()))
+            FastCgiPool::spawnWorkers(loc.getFastCgiPass(), loc.getFastCgiSpawn(), loc.getFastCgiWorkers());
+    }
+}
+
+/**
+ * listen() con el `backlog` y `defer_accept` de los servers que comparten
+ * el socket (el mayor de cada uno). Se vuelve a llamar en cada recarga:
+ * listen() sobre un socket que ya escucha solo cambia la longitud de la cola.
+ */
+void ServerManager::_init_listener(int fd, const std::vector<ServerUnit> &servers) {
+    int backlog = 0;
+    int defer = 0;
+    for (size_t i = 0; i < servers.size(); ++i) {
+        if (servers[i].getFd() != fd)
+            continue;
+        backlog = std::max(backlog, servers[i].getBacklog());
+        defer = std::max(defer, servers[i].getDeferAccept());
+    }
+    if (backlog == 0)
+        backlog = BACKLOG_SIZE;
+    if (listen(fd, backlog) < 0) {
         const int err = errno;
         logError("listen(%d) failed: %s", fd, strerror(err));
-        close(fd);
-        _servers_map.erase(fd);
         throw std::runtime_error("listen failed");
     }
+    if (setsockopt(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer, sizeof(defer)) < 0)
+        logError("TCP_DEFER_ACCEPT on %d failed: %s", fd, strerror(errno));
+    _apply_listener_options(fd, servers);
 
-    FD_SET(fd, &_read_fds);
-    if (fd > _max_fd)
-        _max_fd = fd;
+    if (FD_ISSET(fd, &_read_fds))
+        return;
+    _watch_listener(fd);
+
+    logInfo("🐡 Server started on port %d (backlog %d%s)", _listeners[fd].second, backlog,
+            defer ? ", deferred accept" : "");
+}
+
+void ServerManager::_close_listener(int fd) {
+    _unwatch_listener(fd);
+    close(fd);
+    _listeners.erase(fd);
+}
+
+/**
+ * Server que atiende la conexión según la configuración que retiene
+ * (ver _refresh_config). NULL si la conexión no existe.
+ */
+const ServerUnit *ServerManager::_server_for(int client_sock) const {
+    std::map<int, ConfigSnapshot*>::const_iterator cfg = _client_config.find(client_sock);
+    int server_fd = _get_client_server_fd(client_sock);
+    if (cfg == _client_config.end() || server_fd < 0)
+        return NULL;
+    return cfg->second->serverFor(server_fd);
+}
+
+/** Configuración que retiene la conexión, o la vigente si no tiene. */
+const ConfigSnapshot *ServerManager::_config_for(int client_sock) const {
+    std::map<int, ConfigSnapshot*>::const_iterator cfg = _client_config.find(client_sock);
+    return cfg == _client_config.end() ? _config : cfg->second;
+}
+
+/**
+ * Al empezar cada petición la conexión pasa a la configuración vigente;
+ * mientras dura, sigue con la que tenía aunque llegue un SIGHUP.
+ */
+void ServerManager::_refresh_config(int client_sock) {
+    ConfigSnapshot *&cfg = _client_config[client_sock];
+    if (cfg == _config)
+        return;
+    if (cfg)
+        cfg->release();
+    cfg = _config->retain();
+}
+
+/**
+ * SIGHUP: relee el fichero de configuración. Los sockets de escucha con el
+ * mismo host:port se conservan (no se pierde ninguna conexión en cola); se
+ * abren los que faltan y se cierran los que ya no se usan. Si algo falla,
+ * sigue la configuración anterior.
+ */
+void ServerManager::_reload() {
+    if (_draining || _config_path.empty())
+        return;
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    logInfo("SIGHUP received: reloading %s", _config_path.c_str());
+
+    std::vector<ServerUnit> servers;
+    std::vector<int> opened;
+    try {
+        ReadConfig reader;
+        reader.createServerGroup(_config_path);
+        servers = reader.getServers();
+        _bind_servers(servers, opened);
+        std::set<int> fds;
+        for (size_t i = 0; i < servers.size(); ++i) {
+            if (fds.insert(servers[i].getFd()).second)
+                _init_listener(servers[i].getFd(), servers);
+        }
+    } catch (const std::exception &e) {
+        logError("Reload failed, keeping generation %u: %s", _config->getGeneration(), e.what());
+        for (size_t i = 0; i < opened.size(); ++i) {
+            if (_listeners.count(opened[i]))
+                _close_listener(opened[i]);
+        }
+        return;
+    }
+
+    std::set<int> used;
+    for (size_t i = 0; i < servers.size(); ++i)
+        used.insert(servers[i].getFd());
+    std::vector<int> unused;
+    std::map<int, std::pair<in_addr_t, int> >::iterator ls;
+    for (ls = _listeners.begin(); ls != _listeners.end(); ++ls) {
+        if (!used.count(ls->first))
+            unused.push_back(ls->first);
+    }
+    for (size_t i = 0; i < unused.size(); ++i) {
+        logInfo("Closing listener on port %d: no longer configured", _listeners[unused[i]].second);
+        _close_listener(unused[i]);
+    }
+
+    ConfigSnapshot *old = _config;
+    _config = new ConfigSnapshot(servers, old->getGeneration() + 1);
+    old->release();
+    FileCache::clear(); // las rutas pueden servirse ahora desde otro root o alias
+    try {
+        for (size_t i = 0; i < servers.size(); ++i)
+            _setup_fastcgi(servers[i]);
+    } catch (const std::exception &e) {
+        logError("Reload: FastCGI setup failed: %s", e.what());
+    }
 
-    logInfo("🐡 Server started on port %d", server.getPort());
+    gettimeofday(&end, NULL);
+    logInfo("Configuration generation %u loaded: %zu server(s) in %.2f ms",
+            _config->getGeneration(), servers.size(),
+            (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_usec - start.tv_usec) / 1000.0);
 }
 
 int ServerManager::_get_client_server_fd(int client_socket) const {
@@ -86,22 +425,109 @@ int ServerManager::_get_client_server_fd(int client_socket) const {
 
 void ServerManager::init()
 {
-    _running = true;
+    _running = 1;
     signal(SIGINT, ServerManager::_handle_signal); // Handle Ctrl+C
+    signal(SIGTERM, ServerManager::_handle_signal); // apagado ordenado
+    signal(SIGUSR2, ServerManager::_handle_signal); // cambio de binario
+    signal(SIGHUP, ServerManager::_handle_signal); // recargar configuración
+    signal(SIGPIPE, SIG_IGN); // un cliente que cierra a mitad de writev() no debe tumbar el servidor
 
     FD_ZERO(&_read_fds);
 	FD_ZERO(&_write_fds);
+    _select_backend();
+
+    const std::vector<ServerUnit> &servers = _config->getServers();
+    for (size_t i = 0; i < servers.size(); ++i)
+        _setup_fastcgi(servers[i]);
+    std::map<int, std::pair<in_addr_t, int> >::iterator ls;
+    for (ls = _listeners.begin(); ls != _listeners.end(); ++ls)
+        _init_listener(ls->first, servers); // Initialize each listening socket
+    _notify_ready();
+
+    if (_uring)
+        _run_uring();
+    else
+        _run_select();
+    logInfo("\nServers shutting down...");
+    _close_all();
+    FastCgiPool::shutdown();
+}
 
-    for (size_t i = 0; i < _servers.size(); ++i)
-        _init_server_unit(_servers[i]); // Initialize each server unit
+/**
+ * io_uring si el kernel lo permite (ver IoUring::init), salvo que
+ * WEBSERV_IO_BACKEND=select pida el bucle de siempre. Con cualquiera de
+ * los dos, stat/open/readdir van al IoPool (WEBSERV_IO_THREADS hilos) y,
+ * sin io_uring, también la lectura de los cuerpos.
+ */
+void ServerManager::_select_backend() {
+    const char *wanted = getenv(ENV_IO_BACKEND);
+    if (!wanted || std::string(wanted) != "select") {
+        _uring = new IoUring();
+        if (!_uring->init()) {
+            delete _uring;
+            _uring = NULL;
+        }
+    }
+    const char *threads = getenv(ENV_IO_THREADS);
+    long count = threads ? std::min(strtol(threads, NULL, 10), 64L) : IO_POOL_THREADS;
+    if (count > 0) {
+        _io_pool = new IoPool();
+        if (!_io_pool->start(count)) {
+            delete _io_pool;
+            _io_pool = NULL;
+        }
+    }
+    if (_io_pool)
+        _watch_pool(_io_pool);
+    FileCache::setDeferred(_io_pool != NULL);
+    HttpResponse::setAsyncFileBodies(_uring || _io_pool);
+    Metrics::ioBackend(_uring ? "io_uring" : "select");
+    logInfo("Event loop backend: %s, %zu disk I/O thread(s)", _uring ? "io_uring" : "select",
+            _io_pool ? _io_pool->threads() : 0);
+}
 
+/** El bucle vigila el eventfd del pool como un descriptor más. */
+void ServerManager::_watch_pool(IoPool *pool) {
+    int fd = pool->fd();
+    FD_SET(fd, &_read_fds);
+    if (fd > _max_fd)
+        _max_fd = fd;
+    if (_uring)
+        _uring->pollIn(fd, io_tag(IO_POLL, io_socket(0, fd)));
+}
+
+/**
+ * Hilos para los backends FastCGI, con el primero que se configura. Son un
+ * IoPool aparte para que un backend lento no deje en cola los stat/pread
+ * del disco; si no arrancan, el intercambio se hace en el bucle.
+ */
+void ServerManager::_start_fastcgi_pool() {
+    _fcgi_pool = new IoPool();
+    if (!_fcgi_pool->start(FASTCGI_THREADS)) {
+        delete _fcgi_pool;
+        _fcgi_pool = NULL;
+        return;
+    }
+    _watch_pool(_fcgi_pool);
+    FastCgiPool::setDeferred(true);
+    logInfo("FastCGI: %zu exchange thread(s)", _fcgi_pool->threads());
+}
+
+void ServerManager::_run_select() {
     fd_set temp_read_fds;
     fd_set temp_write_fds;
     while (_running) {
+        _handle_pending_signals();
+        if (_draining && _drain_finished())
+            break;
         temp_read_fds = _read_fds;
         temp_write_fds = _write_fds;
 
-        int activity = select(_max_fd + 1, &temp_read_fds, &temp_write_fds, NULL, NULL);
+        // con timeout: las señales y el plazo de drenado se revisan al menos cada segundo
+        struct timeval tv;
+        tv.tv_sec = 1;
+        tv.tv_usec = 0;
+        int activity = select(_max_fd + 1, &temp_read_fds, &temp_write_fds, NULL, &tv);
         if (activity < 0) {
             if (errno == EINTR) continue; // Interrupted by signal
             logInfo("Failed to select on sockets");
@@ -109,7 +535,13 @@ void ServerManager::init()
 
         for (int fd = 0; fd <= _max_fd; ++fd) {
             if (FD_ISSET(fd, &temp_read_fds)) {
-                if (_servers_map.find(fd) != _servers_map.end()) {
+                if (fd == _upgrade_fd) {
+                    _handle_upgrade_ready();
+                } else if (_io_pool && fd == _io_pool->fd()) {
+                    _on_io_complete(_io_pool);
+                } else if (_fcgi_pool && fd == _fcgi_pool->fd()) {
+                    _on_io_complete(_fcgi_pool);
+                } else if (!_draining && _listeners.count(fd)) {
                     // The fd belongs to a server that has a new connection
                     _handle_new_connection(fd);
                 } else {
@@ -123,145 +555,938 @@ void ServerManager::init()
             }
         }
     }
-    logInfo("\nServers shutting down...");
 }
 
-void ServerManager::_handle_new_connection(int listening_socket) {
-    int client_sock = accept(listening_socket, NULL, NULL);
-    if (client_sock < 0) {
-        logError("Failed to accept new connection on socket %d: %s", listening_socket, strerror(errno));
+/**
+ * Bucle con io_uring: en cada vuelta una sola llamada envía todo lo
+ * preparado (recv, writev, lecturas de disco) y espera la primera
+ * finalización; después se atienden todas las CQEs. Los accept multishot
+ * y los recv con buffers del kernel ahorran las llamadas de uno en uno.
+ */
+void ServerManager::_run_uring() {
+    IoUring::Completion c;
+    while (_running) {
+        _handle_pending_signals();
+        if (_draining && _drain_finished())
+            break;
+        _rearm_reads();
+        int ret = _uring->submitAndWait(1000);
+        if (ret < 0 && ret != -EINTR && ret != -ETIME)
+            logError("io_uring_enter failed: %s", strerror(-ret));
+        while (_uring->next(c))
+            _handle_completion(c);
+    }
+}
+
+/**
+ * Arma un recv en las conexiones que volvieron a modo lectura en esta
+ * vuelta. Las que reciben el cuerpo de un CGI con splice() solo esperan a
+ * que el socket sea legible: los datos no pasan por los buffers del anillo.
+ */
+void ServerManager::_rearm_reads() {
+    for (std::set<int>::iterator it = _rearm.begin(); it != _rearm.end(); ++it) {
+        std::map<int, UringState>::iterator st = _uring_state.find(*it);
+        if (st == _uring_state.end() || st->second.recv_armed || !FD_ISSET(*it, &_read_fds))
+            continue;
+        st->second.polled = _cgi_bodies.count(*it) > 0;
+        if (st->second.polled)
+            _uring->pollIn(*it, io_tag(IO_POLL, io_socket(st->second.serial, *it)));
+        else
+            _uring->recv(*it, io_tag(IO_RECV, io_socket(st->second.serial, *it)));
+        st->second.recv_armed = true;
+    }
+    _rearm.clear();
+}
+
+/**
+ * Reparte una CQE. Las de un fd ya cerrado (otro serial) solo liberan lo
+ * que retenían: el buffer del recv o la cola huérfana del writev.
+ */
+void ServerManager::_handle_completion(const IoUring::Completion &c) {
+    e_io_op op = static_cast<e_io_op>(c.data >> 56);
+    if (op == IO_READ) {
+        _on_file_read(c.data & IO_PAYLOAD_MASK, c.res);
+        return;
+    }
+    if (op == IO_CANCEL || op == IO_CLOSE)
+        return;
+    int fd = static_cast<int>(c.data & 0xffffff);
+    unsigned serial = static_cast<unsigned>((c.data >> 24) & 0xffffffffULL);
+    std::map<int, UringState>::iterator st = _uring_state.find(fd);
+    bool live = st != _uring_state.end() && st->second.serial == serial;
+    if (op == IO_POLL) {
+        if (fd == _upgrade_fd)
+            _handle_upgrade_ready();
+        else if (_io_pool && fd == _io_pool->fd())
+            _on_io_complete(_io_pool);
+        else if (_fcgi_pool && fd == _fcgi_pool->fd())
+            _on_io_complete(_fcgi_pool);
+        else if (live) {
+            st->second.recv_armed = false;
+            _rearm.insert(fd);
+            if (_cgi_bodies.count(fd))
+                _splice_cgi_body(fd);
+        }
+        return;
+    }
+    if (op == IO_ACCEPT) {
+        if (live)
+            _on_accept(fd, c);
+        else if (c.res >= 0)
+            close(c.res);
+    } else if (op == IO_RECV) {
+        if (live)
+            _on_recv(fd, c);
+        else
+            _uring->recycle(c.flags);
+    } else if (op == IO_SEND) {
+        if (live)
+            _on_send(fd, c.res);
+        else
+            _orphaned_sends.erase(serial);
+    }
+}
+
+void ServerManager::_on_accept(int listening_socket, const IoUring::Completion &c) {
+    if (!(c.flags & IORING_CQE_F_MORE)) // el multishot terminó: volver a armarlo
+        _uring->accept(listening_socket, io_tag(IO_ACCEPT, io_socket(_uring_state[listening_socket].serial, listening_socket)));
+    if (c.res < 0) {
+        if (c.res != -ECONNABORTED && c.res != -EINTR && c.res != -EAGAIN) {
+            Metrics::acceptFailed();
+            logError("Failed to accept new connection on socket %d: %s", listening_socket, strerror(-c.res));
+        }
+        return;
+    }
+    if (c.res >= FD_SETSIZE) {
+        logError("Too many open files, cannot accept new connection on socket %d", listening_socket);
+        Metrics::acceptFailed();
+        close(c.res);
+        return;
+    }
+    _register_client(c.res, listening_socket);
+}
+
+void ServerManager::_on_recv(int client_sock, const IoUring::Completion &c) {
+    _uring_state[client_sock].recv_armed = false;
+    _rearm.insert(client_sock);
+    if (c.res == -ENOBUFS)
+        return; // todos los buffers en uso: se reintenta en la siguiente vuelta
+    if (c.res > 0) {
+        _on_received(client_sock, _uring->buffer(c.flags), c.res);
+        _uring->recycle(c.flags);
         return;
     }
+    if (c.res < 0)
+        errno = -c.res;
+    _on_received(client_sock, NULL, c.res < 0 ? -1 : 0);
+}
+
+void ServerManager::_on_send(int client_sock, int res) {
+    UringState &st = _uring_state[client_sock];
+    st.send_busy = false;
+    bool &corked = _corked[client_sock];
+    if (!st.more && corked)
+        corked = !_set_cork(client_sock, false);
+    if (res < 0)
+        errno = -res;
+    _on_written(client_sock, res, st.total, st.corked);
+}
+
+/**
+ * Envía con un writev de io_uring las respuestas listas de la cola. Solo
+ * hay uno en curso por conexión; al completarse, _on_written sigue igual
+ * que con select.
+ */
+void ServerManager::_submit_send(int client_sock) {
+    std::map<int, UringState>::iterator it = _uring_state.find(client_sock);
+    if (it == _uring_state.end() || it->second.send_busy)
+        return;
+    UringState &st = it->second;
+    int count = _fill_iov(client_sock, st.iov, st.total);
+    if (count == 0)
+        return; // la primera respuesta aún espera su cuerpo de disco
+    logInfo("🐠 Sending %d response(s) to client socket %d", count, client_sock);
+    st.more = _more_responses_pending(client_sock, count);
+    bool &corked = _corked[client_sock];
+    if (st.more && !corked)
+        corked = _set_cork(client_sock, true);
+    st.corked = corked;
+    _uring->writev(client_sock, st.iov, count, io_tag(IO_SEND, io_socket(st.serial, client_sock)));
+    st.send_busy = true;
+}
+
+/**
+ * Con io_uring (o el IoPool), el cuerpo de un fichero estático se lee de
+ * disco sin bloquear el bucle: la respuesta ya encolada (solo la cabecera)
+ * queda en _filling y _fill_iov no la envía hasta que _on_file_read la
+ * completa.
+ */
+void ServerManager::_read_body_async(int client_sock) {
+    if (_body_fd < 0)
+        return;
+    const std::string &slot = _write_queue[client_sock].back();
+    unsigned long long id = ++_file_read_seq;
+    FileRead &op = _file_reads[id];
+    op.client = client_sock;
+    op.fd = _body_fd;
+    op.head = slot.size();
+    op.done = 0;
+    op.slot = &slot;
+    op.data.reserve(op.head + _body_size);
+    op.data = slot;
+    op.data.resize(op.head + _body_size);
+    _filling[&slot] = id;
+    _body_fd = -1;
+    if (_uring) {
+        _uring->read(op.fd, &op.data[op.head], _body_size, 0, io_tag(IO_READ, id));
+        return;
+    }
+    // lo que ya está en la page cache se copia aquí (RWF_NOWAIT no espera
+    // al disco): un fichero caliente no hace cola tras los trabajos lentos
+    struct iovec iov;
+    iov.iov_base = &op.data[op.head];
+    iov.iov_len = _body_size;
+    ssize_t n = preadv2(op.fd, &iov, 1, 0, RWF_NOWAIT);
+    if (n == static_cast<ssize_t>(_body_size)) {
+        _on_file_read(id, n);
+        return;
+    }
+    IoJob *job = new IoJob();
+    job->kind = IoJob::READ;
+    job->id = id;
+    job->fd = op.fd;
+    job->buf = &op.data[op.head];
+    job->size = _body_size;
+    job->done = n > 0 ? n : 0;
+    _io_submit(job);
+}
+
+/**
+ * Fin de una lectura de disco: si se quedó corta se pide el resto. Si la
+ * respuesta sigue esperándola (la conexión no se cerró) se sustituye por
+ * la completa y se envía.
+ */
+void ServerManager::_on_file_read(unsigned long long id, long res) {
+    std::map<unsigned long long, FileRead>::iterator it = _file_reads.find(id);
+    if (it == _file_reads.end())
+        return;
+    FileRead &op = it->second;
+    size_t size = op.data.size() - op.head;
+    if (res > 0)
+        op.done += res;
+    if (_uring && ((res > 0 && op.done < size) || res == -EINTR || res == -EAGAIN)) {
+        _uring->read(op.fd, &op.data[op.head + op.done], size - op.done, op.done, io_tag(IO_READ, id));
+        return;
+    }
+    FileCache::release(op.fd);
+    int client = op.client;
+    std::map<const std::string*, unsigned long long>::iterator waiting = _filling.find(op.slot);
+    if (waiting == _filling.end() || waiting->second != id) {
+        _file_reads.erase(it);
+        return;
+    }
+    _filling.erase(waiting);
+    std::string *slot = const_cast<std::string*>(op.slot);
+    if (op.done == size) {
+        slot->swap(op.data);
+    } else {
+        logError("Reading response body for client %d failed: %s", client,
+                 res < 0 ? strerror(-res) : "file shrank while reading");
+        _fail_file_read(client, slot);
+    }
+    _file_reads.erase(it);
+    _want_write(client);
+}
+
+/**
+ * El cuerpo no se pudo leer: la respuesta pasa a ser un 500 que cierra la
+ * conexión y se descarta lo encolado detrás (aún no se había enviado nada).
+ */
+void ServerManager::_fail_file_read(int client_sock, std::string *slot) {
+    *slot = _close_with_error(client_sock, HttpStatusCode::InternalServerError);
+    std::deque<std::string> &queue = _write_queue[client_sock];
+    std::deque<std::string>::iterator it = queue.begin();
+    while (it != queue.end() && &*it != slot)
+        ++it;
+    if (it == queue.end())
+        return;
+    for (std::deque<std::string>::iterator rest = it + 1; rest != queue.end(); ++rest)
+        _filling.erase(&*rest);
+    queue.erase(it + 1, queue.end());
+}
+
+/**
+ * El eventfd de un IoPool está listo: se recogen los trabajos terminados.
+ * Con io_uring el poll es de un solo disparo y se vuelve a armar.
+ */
+void ServerManager::_on_io_complete(IoPool *pool) {
+    pool->ack();
+    if (_uring)
+        _uring->pollIn(pool->fd(), io_tag(IO_POLL, io_socket(0, pool->fd())));
+    IoJob *job;
+    while ((job = pool->completed()) != NULL)
+        _io_done(job);
+}
+
+/** Al IoPool que le toca; si su cola está llena el trabajo se hace aquí mismo, como sin pool. */
+void ServerManager::_io_submit(IoJob *job) {
+    IoPool *pool = (job->kind == IoJob::FASTCGI) ? _fcgi_pool : _io_pool;
+    if (pool->submit(job))
+        return;
+    IoPool::run(*job);
+    _io_done(job);
+}
+
+/**
+ * Un trabajo terminado: la lectura de un cuerpo sigue como con io_uring;
+ * un stat/open o un readdir se guarda en FileCache y las peticiones que lo
+ * esperaban se repiten, ya sin tocar el disco. Un intercambio FastCGI se
+ * queda en _fastcgi_done de su conexión, de donde lo recoge la petición
+ * al repetirse (ver prepare_response).
+ */
+void ServerManager::_io_done(IoJob *job) {
+    if (job->kind == IoJob::READ) {
+        _on_file_read(job->id, job->err ? -job->err : static_cast<long>(job->done));
+    } else if (job->kind == IoJob::FASTCGI) {
+        FastCgiPool::finish(*job);
+        std::string key = fastcgi_key(job);
+        std::map<std::string, std::vector<int> >::iterator it = _lookups.find(key);
+        int client = (it != _lookups.end() && !it->second.empty()) ? it->second[0] : -1;
+        std::map<int, std::string>::iterator parked = _parked.find(client);
+        if (parked != _parked.end() && parked->second == key) {
+            _fastcgi_done[client] = job;
+            _resume(key);
+            return;
+        }
+        if (it != _lookups.end())
+            _lookups.erase(it); // la conexión se cerró mientras esperaba
+    } else {
+        const struct stat *st = job->found ? &job->st : NULL;
+        if (job->kind == IoJob::LIST)
+            FileCache::primeListing(job->path, st, job->err ? NULL : &job->entries);
+        else
+            FileCache::prime(job->path, st, job->fd);
+        std::string key = (job->kind == IoJob::LIST ? "L" : "O") + job->path;
+        std::map<std::string, std::vector<int> >::iterator it = _lookups.find(key);
+        if (it != _lookups.end()) {
+            for (size_t i = 0; i < it->second.size(); ++i) {
+                FileCache::pin(job->path);
+                _pinned[it->second[i]].push_back(job->path);
+            }
+        }
+        _resume(key);
+    }
+    delete job;
+}
+
+/**
+ * La petición en curso necesita el disco (FileCache::wanted()): la conexión
+ * espera sin leer más peticiones hasta que un hilo del IoPool lo mire. Las
+ * que piden la misma ruta a la vez comparten un solo trabajo.
+ */
+void ServerManager::_park(int client_sock, const FileCache::Pending &pending) {
+    std::string key = (pending.listing ? "L" : "O") + pending.path;
+    _parked[client_sock] = key;
+    std::vector<int> &waiting = _lookups[key];
+    waiting.push_back(client_sock);
+    if (waiting.size() > 1)
+        return;
+    IoJob *job = new IoJob();
+    job->kind = pending.listing ? IoJob::LIST : IoJob::OPEN;
+    job->path = pending.path;
+    _io_submit(job);
+}
+
+/** Igual con un intercambio FastCGI: es de una sola petición, no se comparte. */
+void ServerManager::_park(int client_sock, const FastCgiPool::Pending &pending) {
+    std::string key = fastcgi_key(pending.job);
+    _parked[client_sock] = key;
+    _lookups[key].push_back(client_sock);
+    _io_submit(pending.job);
+}
+
+/** Repite las peticiones aparcadas en 'key' (las conexiones cerradas ya no están en _parked). */
+void ServerManager::_resume(const std::string &key) {
+    std::map<std::string, std::vector<int> >::iterator it = _lookups.find(key);
+    if (it == _lookups.end())
+        return;
+    std::vector<int> clients;
+    clients.swap(it->second);
+    _lookups.erase(it);
+    for (size_t i = 0; i < clients.size(); ++i) {
+        std::map<int, std::string>::iterator parked = _parked.find(clients[i]);
+        if (parked == _parked.end() || parked->second != key)
+            continue;
+        _parked.erase(parked);
+        if (_write_queue[clients[i]].empty())
+            _want_read(clients[i]); // con respuestas en cola lee al terminar de enviarlas
+        _process_requests(clients[i]);
+    }
+}
+
+/** La petición de la conexión ya tiene respuesta: suelta las entradas que esperaba. */
+void ServerManager::_unpin(int client_sock) {
+    std::map<int, std::vector<std::string> >::iterator it = _pinned.find(client_sock);
+    if (it == _pinned.end())
+        return;
+    for (size_t i = 0; i < it->second.size(); ++i)
+        FileCache::unpin(it->second[i]);
+    _pinned.erase(it);
+}
+
+/**
+ * Cancela lo que la conexión tenga en curso en io_uring. Si hay un writev
+ * en vuelo su cola se guarda hasta la CQE, porque el kernel aún puede
+ * estar leyéndola; las lecturas de disco tienen su propio buffer.
+ */
+void ServerManager::_uring_forget(int client_sock) {
+    std::map<int, UringState>::iterator st = _uring_state.find(client_sock);
+    if (st == _uring_state.end())
+        return;
+    unsigned long long sock = io_socket(st->second.serial, client_sock);
+    std::deque<std::string> &queue = _write_queue[client_sock];
+    if (st->second.recv_armed)
+        _uring->cancel(io_tag(st->second.polled ? IO_POLL : IO_RECV, sock), io_tag(IO_CANCEL, 0));
+    if (st->second.send_busy) {
+        _uring->cancel(io_tag(IO_SEND, sock), io_tag(IO_CANCEL, 0));
+        _orphaned_sends[st->second.serial].swap(queue);
+    }
+    _uring_state.erase(st);
+}
+
+void ServerManager::_watch_listener(int fd) {
+    FD_SET(fd, &_read_fds);
+    if (fd > _max_fd)
+        _max_fd = fd;
+    if (!_uring)
+        return;
+    UringState &st = _uring_state[fd];
+    st.serial = ++_io_serial;
+    _uring->accept(fd, io_tag(IO_ACCEPT, io_socket(st.serial, fd)));
+}
+
+/** Deja de aceptar en fd; con io_uring hay que cancelar el accept multishot, que retiene el socket. */
+void ServerManager::_unwatch_listener(int fd) {
+    FD_CLR(fd, &_read_fds);
+    if (!_uring)
+        return;
+    std::map<int, UringState>::iterator st = _uring_state.find(fd);
+    if (st == _uring_state.end())
+        return;
+    _uring->cancel(io_tag(IO_ACCEPT, io_socket(st->second.serial, fd)), io_tag(IO_CANCEL, 0));
+    _uring_state.erase(st);
+}
+
+/**
+ * La conexión espera peticiones; con io_uring el recv se arma antes del
+ * siguiente envío. Una aparcada no lee hasta que _resume la repite.
+ */
+void ServerManager::_want_read(int client_sock) {
+    FD_CLR(client_sock, &_write_fds);
+    if (_parked.count(client_sock))
+        return;
+    FD_SET(client_sock, &_read_fds);
+    if (_uring)
+        _rearm.insert(client_sock);
+}
+
+/** La conexión tiene respuestas que enviar. */
+void ServerManager::_want_write(int client_sock) {
+    FD_CLR(client_sock, &_read_fds);
+    FD_SET(client_sock, &_write_fds);
+    if (_uring)
+        _submit_send(client_sock);
+}
+
+/**
+ * Las señales solo marcan flags; el trabajo se hace aquí, fuera del
+ * manejador, entre dos vueltas del bucle.
+ */
+void ServerManager::_handle_pending_signals() {
+    if (_term_requested) {
+        _term_requested = 0;
+        if (!_draining) {
+            logInfo("SIGTERM received: draining %zu connection(s), %d s deadline",
+                    _client_server_map.size(), DRAIN_TIMEOUT);
+            _begin_drain();
+        }
+    }
+    if (_upgrade_pid > 0 && _upgrade_fd < 0 && waitpid(_upgrade_pid, NULL, WNOHANG) != 0)
+        _upgrade_pid = -1; // binario nuevo que falló al arrancar
+    if (_upgrade_requested) {
+        _upgrade_requested = 0;
+        _start_upgrade();
+    }
+    if (_reload_requested) {
+        _reload_requested = 0;
+        _reload();
+    }
+}
+
+/**
+ * Deja de aceptar (cierra los sockets de escucha: si hay un binario nuevo
+ * sigue teniendo su copia) y cierra las conexiones inactivas. Las que
+ * tienen una petición a medias o respuestas por enviar terminan con
+ * "Connection: close" (ver _keep_alive_allowed).
+ */
+void ServerManager::_begin_drain() {
+    _draining = true;
+    _drain_deadline = time(NULL) + DRAIN_TIMEOUT;
+
+    std::map<int, std::pair<in_addr_t, int> >::iterator ls;
+    for (ls = _listeners.begin(); ls != _listeners.end(); ++ls) {
+        _unwatch_listener(ls->first);
+        close(ls->first);
+    }
+    std::vector<int> clients;
+    std::map<int, int>::iterator it;
+    for (it = _client_server_map.begin(); it != _client_server_map.end(); ++it)
+        clients.push_back(it->first);
+    for (size_t i = 0; i < clients.size(); ++i)
+        _close_if_idle(clients[i]);
+}
+
+bool ServerManager::_drain_finished() {
+    if (_client_server_map.empty()) {
+        logInfo("All connections drained");
+        return true;
+    }
+    if (time(NULL) >= _drain_deadline) {
+        logError("Drain deadline reached: closing %zu connection(s)", _client_server_map.size());
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Durante el drenado, una conexión keep-alive sin nada pendiente (ni
+ * petición a medias ni respuestas en cola) se cierra en vez de esperar.
+ * Una recién aceptada que aún no envió nada no está inactiva: su primera
+ * petición puede estar en camino.
+ */
+bool ServerManager::_close_if_idle(int client_sock) {
+    if (!_draining || FD_ISSET(client_sock, &_write_fds) || _served[client_sock] == 0)
+        return false;
+    if (!_read_requests[client_sock].buffer.empty() || _uploads.count(client_sock)
+        || !_write_queue[client_sock].empty())
+        return false;
+    _cleanup_client(client_sock);
+    return true;
+}
+
+/**
+ * SIGUSR2: lanza el binario (ya sustituido en disco) con los sockets de
+ * escucha heredados. El proceso viejo sigue aceptando hasta que el nuevo
+ * escribe en el pipe ENV_READY_FD; entonces drena y sale. Si el nuevo
+ * falla al arrancar, el pipe se cierra sin datos y el viejo sigue sirviendo.
+ */
+void ServerManager::_start_upgrade() {
+    if (_draining || _upgrade_pid > 0) {
+        logError("SIGUSR2 ignored: upgrade or shutdown already in progress");
+        return;
+    }
+    if (_exe_path.empty()) {
+        logError("SIGUSR2 ignored: executable path unknown");
+        return;
+    }
+    int pipefd[2];
+    if (pipe(pipefd) < 0) {
+        logError("SIGUSR2: pipe failed: %s", strerror(errno));
+        return;
+    }
+    std::string fds;
+    std::map<int, std::pair<in_addr_t, int> >::iterator ls;
+    for (ls = _listeners.begin(); ls != _listeners.end(); ++ls) {
+        if (!fds.empty())
+            fds += ",";
+        fds += to_string(ls->first);
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        logError("SIGUSR2: fork failed: %s", strerror(errno));
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return;
+    }
+    if (pid == 0) {
+        // hijo: solo sobreviven los sockets de escucha y el pipe de aviso
+        for (int fd = 3; fd < FD_SETSIZE; ++fd) {
+            if (fd != pipefd[1] && !_listeners.count(fd))
+                close(fd);
+        }
+        for (ls = _listeners.begin(); ls != _listeners.end(); ++ls)
+            fcntl(ls->first, F_SETFD, 0);
+        setenv(ENV_LISTEN_FDS, fds.c_str(), 1);
+        setenv(ENV_READY_FD, to_string(pipefd[1]).c_str(), 1);
+        execvp(_exe_path.c_str(), _argv);
+        _exit(1);
+    }
+    close(pipefd[1]);
+    _upgrade_pid = pid;
+    _upgrade_fd = pipefd[0];
+    FD_SET(_upgrade_fd, &_read_fds);
+    if (_upgrade_fd > _max_fd)
+        _max_fd = _upgrade_fd;
+    if (_uring)
+        _uring->pollIn(_upgrade_fd, io_tag(IO_POLL, io_socket(0, _upgrade_fd)));
+    logInfo("SIGUSR2: started %s (pid %d) with listening fds %s", _exe_path.c_str(), pid, fds.c_str());
+}
+
+void ServerManager::_handle_upgrade_ready() {
+    char c;
+    ssize_t n = read(_upgrade_fd, &c, 1);
+    FD_CLR(_upgrade_fd, &_read_fds);
+    close(_upgrade_fd);
+    _upgrade_fd = -1;
+    if (n == 1) {
+        logInfo("New binary (pid %d) is accepting connections; draining old process", _upgrade_pid);
+        _upgrade_pid = -1;
+        _begin_drain();
+        return;
+    }
+    // se recoge en _handle_pending_signals cuando termine de salir
+    logError("New binary (pid %d) failed to start; still serving", _upgrade_pid);
+}
+
+/** Cierra todo al salir, también lo que no llegó a drenarse. */
+void ServerManager::_close_all() {
+    std::vector<int> clients;
+    std::map<int, int>::iterator it;
+    for (it = _client_server_map.begin(); it != _client_server_map.end(); ++it)
+        clients.push_back(it->first);
+    for (size_t i = 0; i < clients.size(); ++i)
+        _cleanup_client(clients[i]);
+    if (!_draining) {
+        std::map<int, std::pair<in_addr_t, int> >::iterator ls;
+        for (ls = _listeners.begin(); ls != _listeners.end(); ++ls) {
+            _unwatch_listener(ls->first);
+            close(ls->first);
+        }
+    }
+    if (_upgrade_fd >= 0)
+        close(_upgrade_fd);
+    if (_uring)
+        _uring->drain(io_tag(IO_CANCEL, 0));
+}
+
+/**
+ * Opciones del socket de escucha según el server que lo atiende (el último
+ * declarado, como en ConfigSnapshot): TCP_FASTOPEN y SO_RCVBUF, que heredan
+ * las conexiones aceptadas.
+ */
+void ServerManager::_apply_listener_options(int fd, const std::vector<ServerUnit> &servers) {
+    const SocketOptions *opts = NULL;
+    for (size_t i = 0; i < servers.size(); ++i) {
+        if (servers[i].getFd() == fd)
+            opts = &servers[i].getSocketOptions();
+    }
+    if (!opts)
+        return;
+    if (opts->fastopen && setsockopt(fd, IPPROTO_TCP, TCP_FASTOPEN, &opts->fastopen, sizeof(opts->fastopen)) < 0)
+        logError("TCP_FASTOPEN on %d failed: %s", fd, strerror(errno));
+    if (opts->rcvbuf && setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &opts->rcvbuf, sizeof(opts->rcvbuf)) < 0)
+        logError("SO_RCVBUF on %d failed: %s", fd, strerror(errno));
+}
+
+/** TCP_NODELAY y SO_SNDBUF de una conexión recién aceptada. */
+void ServerManager::_apply_client_options(int client_sock, const SocketOptions &opts) {
+    int on = opts.tcp_nodelay ? 1 : 0;
+    if (setsockopt(client_sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)) < 0)
+        logError("TCP_NODELAY on %d failed: %s", client_sock, strerror(errno));
+    if (opts.sndbuf && setsockopt(client_sock, SOL_SOCKET, SO_SNDBUF, &opts.sndbuf, sizeof(opts.sndbuf)) < 0)
+        logError("SO_SNDBUF on %d failed: %s", client_sock, strerror(errno));
+}
+
+/**
+ * Acepta todas las conexiones que haya en la cola hasta EAGAIN, no solo
+ * una por vuelta de select(): en una avalancha de conexiones la cola se
+ * vacía de golpe en vez de desbordarse. accept4() las deja ya no
+ * bloqueantes y con FD_CLOEXEC (los CGI no heredan sockets de clientes).
+ */
+void ServerManager::_handle_new_connection(int listening_socket) {
+    while (true) {
+        int client_sock = accept4(listening_socket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_sock < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue; // el cliente se fue antes del accept: seguir con la cola
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return;
+            Metrics::acceptFailed();
+            logError("Failed to accept new connection on socket %d: %s", listening_socket, strerror(errno));
+            return;
+        }
 
-    if (client_sock >= FD_SETSIZE) {
-        logError("Too many open files, cannot accept new connection on socket %d", listening_socket);
-        close(client_sock);
-        return;
+        if (client_sock >= FD_SETSIZE) {
+            logError("Too many open files, cannot accept new connection on socket %d", listening_socket);
+            Metrics::acceptFailed();
+            close(client_sock);
+            return; // el resto de la cola espera a que se libere algún fd
+        }
+        _register_client(client_sock, listening_socket);
     }
+}
 
-    set_nonblocking(client_sock);
-    FD_SET(client_sock, &_read_fds);
+void ServerManager::_register_client(int client_sock, int listening_socket) {
     if (client_sock > _max_fd) _max_fd = client_sock;
 
     _client_server_map[client_sock] = listening_socket; // Map client socket to server socket
     _read_requests[client_sock] = ClientRequest(); // Initialize Request object for the new client
-    _write_buffer[client_sock] = ""; // Initialize write buffer for the new client
+    _write_queue[client_sock].clear(); // Initialize response queue for the new client
     _bytes_sent[client_sock] = 0; // Initialize bytes sent for the new client
+    _served[client_sock] = 0;
+    _close_after[client_sock] = false;
+    _client_config[client_sock] = _config->retain();
+    const ServerUnit *server = _config->serverFor(listening_socket);
+    if (server)
+        _apply_client_options(client_sock, server->getSocketOptions());
+    if (!_arenas.count(client_sock))
+        _arenas[client_sock] = new Arena();
+    if (_uring)
+        _uring_state[client_sock].serial = ++_io_serial;
+    _want_read(client_sock);
+    Metrics::connectionOpened();
     logInfo("🐠 New connection accepted on socket %d. Listening socket: %d", client_sock, listening_socket);
 }
 
+/**
+ * Envía con un solo writev() todas las respuestas encoladas (hasta
+ * WRITEV_MAX_IOV), en el orden en que llegaron las peticiones.
+ */
 void ServerManager::_handle_write(int client_sock) {
+    struct iovec iov[WRITEV_MAX_IOV];
+    size_t total;
+    int count = _fill_iov(client_sock, iov, total);
+    if (count == 0) {
+        FD_CLR(client_sock, &_write_fds); // _on_file_read la vuelve a poner
+        return;
+    }
+    logInfo("🐠 Sending %d response(s) to client socket %d", count, client_sock);
+    bool more = _more_responses_pending(client_sock, count);
+    bool &corked = _corked[client_sock];
+    if (more && !corked)
+        corked = _set_cork(client_sock, true);
+    bool was_corked = corked;
+    ssize_t n = writev(client_sock, iov, count);
+    if (!more && corked)
+        corked = !_set_cork(client_sock, false); // vacía lo retenido junto con este lote
+    _on_written(client_sock, n, total, was_corked);
+}
 
-    std::string remaining_response = _write_buffer[client_sock].substr(_bytes_sent[client_sock]);
-    /*
-    // Be defensive: if for any reason _bytes_sent is larger than buffer size,
-    // clamp it to avoid std::out_of_range (which yields "basic_string" exceptions).
-    size_t offset = 0;
-    std::map<int, std::string>::iterator wb_it = _write_buffer.find(client_sock);
-    if (wb_it != _write_buffer.end()) {
-        size_t buf_size = wb_it->second.size();
-        size_t sent = 0;
-        std::map<int, size_t>::iterator bs_it = _bytes_sent.find(client_sock);
-        if (bs_it != _bytes_sent.end()) sent = bs_it->second;
-        offset = (sent > buf_size) ? buf_size : sent;
-    }
-    std::string remaining_response = _write_buffer[client_sock].substr(offset);
-    */
-    logInfo("🐠 Sending response to client socket %d", client_sock);
-    size_t n = send(client_sock, remaining_response.c_str(), remaining_response.size(), 0);
+/**
+ * Respuestas de la cola listas para writev(), desde lo que quede de la
+ * primera; se para en la primera cuyo cuerpo aún se lee de disco.
+ */
+int ServerManager::_fill_iov(int client_sock, struct iovec *iov, size_t &total) {
+    std::deque<std::string> &queue = _write_queue[client_sock];
+    int count = 0;
+    size_t offset = _bytes_sent[client_sock];
+    total = 0;
+    for (std::deque<std::string>::iterator it = queue.begin();
+         it != queue.end() && count < WRITEV_MAX_IOV && !_filling.count(&*it); ++it, ++count) {
+        iov[count].iov_base = const_cast<char*>(it->data()) + offset;
+        iov[count].iov_len = it->size() - offset;
+        total += iov[count].iov_len;
+        offset = 0;
+    }
+    return count;
+}
 
-    if (n <= 0) {
-        _cleanup_client(client_sock);
+/** Resultado de un writev (de select o de io_uring): avanza la cola y decide qué sigue. */
+void ServerManager::_on_written(int client_sock, ssize_t n, size_t total, bool was_corked) {
+    if (n < 0 || (n == 0 && total > 0)) {
         logError("Failed to send data to client socket %d: %s. Connection closed.", client_sock, strerror(errno));
+        _cleanup_client(client_sock);
         return;
     }
-    _bytes_sent[client_sock] += n;
-    if (_bytes_sent[client_sock] == _write_buffer[client_sock].size()) {
-       if (_should_close_connection(_read_requests[client_sock].buffer, _write_buffer[client_sock])) {
-            _cleanup_client(client_sock);
-        } else {
-            // Mantener la conexión: limpiar buffers y volver a modo lectura
-            _read_requests[client_sock] = ClientRequest(); // Reset the Request object
-            _write_buffer[client_sock].clear();
-            _bytes_sent[client_sock] = 0;
-            FD_CLR(client_sock, &_write_fds);
-            FD_SET(client_sock, &_read_fds);
-        }
+    Metrics::bytesOut(n);
+    Metrics::socketWrite(static_cast<size_t>(n) < total, was_corked);
+    // descartar las respuestas enviadas completas
+    std::deque<std::string> &queue = _write_queue[client_sock];
+    size_t sent = _bytes_sent[client_sock] + n;
+    while (!queue.empty() && sent >= queue.front().size()) {
+        sent -= queue.front().size();
+        queue.pop_front();
+    }
+    _bytes_sent[client_sock] = sent;
+    if (!queue.empty()) {
+        if (_uring)
+            _submit_send(client_sock); // con select, se espera a que haya sitio
+        return;
+    }
+
+    if (_close_after[client_sock]) {
+        logInfo("🐠 Closing connection %d after %zu request(s)", client_sock, _served[client_sock]);
+        _cleanup_client(client_sock);
+        return;
+    }
+    // Mantener la conexión: volver a modo lectura. Si ya había más
+    // peticiones completas en el buffer (pipelining), se atienden ahora.
+    _want_read(client_sock);
+    _process_requests(client_sock);
+}
+
+/**
+ * Con `tcp_cork on`, si tras este lote vendrán más respuestas (más de
+ * WRITEV_MAX_IOV en cola, o peticiones completas esperando en el buffer
+ * por el límite de MAX_PIPELINE) el socket se tapa con TCP_CORK y el final
+ * de este lote sale junto con el siguiente en segmentos llenos. Se destapa
+ * tras el último lote; el kernel no retiene nada más de 200 ms.
+ */
+bool ServerManager::_more_responses_pending(int client_sock, int batch) {
+    const ServerUnit *server = _server_for(client_sock);
+    if (!server || !server->getSocketOptions().tcp_cork)
+        return false;
+    if (_write_queue[client_sock].size() > static_cast<size_t>(batch))
+        return true;
+    if (_close_after[client_sock])
+        return false;
+    // ¿hay ya cabeceras completas de la siguiente petición? La búsqueda se
+    // retoma en scan_pos, la misma que usa parse_headers: cada byte se mira una vez
+    ClientRequest &cr = _read_requests[client_sock];
+    if (cr.headers_parsed)
+        return true;
+    return Scanner::findHeaderEnd(cr.buffer.data(), cr.buffer.size(), cr.scan_pos) != std::string::npos;
+}
+
+bool ServerManager::_set_cork(int client_sock, bool on) {
+    int value = on ? 1 : 0;
+    if (setsockopt(client_sock, IPPROTO_TCP, TCP_CORK, &value, sizeof(value)) < 0) {
+        logError("TCP_CORK on %d failed: %s", client_sock, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * "Connection: close" o "keep-alive" (lista separada por comas, sin
+ * distinguir mayúsculas). Lo que no reconocemos (p.ej. "Upgrade") se ignora.
+ */
+void ServerManager::_parse_connection_header(const StrRef &value, ClientRequest &cr) {
+    size_t start = 0;
+    while (start <= value.len) {
+        size_t end = value.find(',', start);
+        StrRef token = value.sub(start, end == std::string::npos ? std::string::npos : end - start).trim(' ');
+        if (token.iequals("close"))
+            cr.keep_alive = false;
+        else if (token.iequals("keep-alive"))
+            cr.keep_alive = true;
+        if (end == std::string::npos)
+            break;
+        start = end + 1;
     }
 }
-bool ServerManager::_should_close_connection(const std::string& request, const std::string& response) {
-    // Check if the request or response contains "Connection: close"
-    bool closing = false;
-    if (in_str(request, "Connection: close")){
-        logError("🐠 Closing connection (requested)");
-        closing = true;
-    } 
-    if (in_str(response, "Connection: close")) {
-        logError("🐠 Closing connection (response)");
-        closing = true;
+
+/**
+ * Valor de Content-Length: solo dígitos. Una lista ("5, 5") vale si todos
+ * sus valores coinciden (RFC 9110 8.6). -1 si no es válido.
+ */
+static long parse_content_length(const StrRef &val) {
+    long value = -1;
+    size_t pos = 0;
+    while (pos <= val.len) {
+        size_t comma = val.find(',', pos);
+        if (comma == std::string::npos)
+            comma = val.len;
+        StrRef item = val.sub(pos, comma - pos).trim(' ');
+        if (item.empty() || item.len > 18)
+            return -1;
+        long n = 0;
+        for (size_t i = 0; i < item.len; ++i) {
+            if (item.data[i] < '0' || item.data[i] > '9')
+                return -1;
+            n = n * 10 + (item.data[i] - '0');
+        }
+        if (value >= 0 && n != value)
+            return -1;
+        value = n;
+        pos = comma + 1;
     }
-    return closing;
+    return value;
+}
+
+/** La última codificación de Transfer-Encoding es chunked (solo así se sabe dónde acaba el cuerpo). */
+static bool ends_with_chunked(const StrRef &val) {
+    size_t start = 0;
+    for (size_t comma = val.find(','); comma != std::string::npos; comma = val.find(',', start))
+        start = comma + 1;
+    return val.sub(start).trim(' ').iequals("chunked");
 }
 
+/**
+ * Lee la línea de petición y las cabeceras que deciden cómo leer el
+ * cuerpo. Un Content-Length que no son solo dígitos, dos distintos, o
+ * Transfer-Encoding junto a Content-Length o sin acabar en chunked dejan
+ * bad_framing: un proxy delante podría partir las peticiones en otro
+ * sitio (request smuggling), así que se responde 400 y se cierra.
+ */
 bool ServerManager::parse_headers(int client_sock, ClientRequest &cr) {
-    // Extraer Path y Content-Length si existe
-    cr.header_end = cr.buffer.find("\r\n\r\n");
+    // Extraer Path y Content-Length si existe. La búsqueda se retoma donde
+    // lo dejó el recv() anterior: sin esto, cabeceras grandes son O(n^2).
+    const char *data = cr.buffer.data();
+    cr.header_end = Scanner::findHeaderEnd(data, cr.buffer.size(), cr.scan_pos);
     if (cr.header_end == std::string::npos) return false; // faltan headers
     cr.body_start = cr.header_end + 4;
 
     // Primera línea. Request line: "GET /path HTTP/1.1"
-    size_t line_end = cr.buffer.find("\r\n");
-    if (line_end == std::string::npos) return false; // faltan headers
-    std::string req_line = cr.buffer.substr(0, line_end);
+    StrRef head(data, cr.header_end + 2);
+    size_t line_end = Scanner::findCrlf(head.data, head.len);
+    StrRef req_line = head.sub(0, line_end);
     {
         // Método y path. 
         size_t sp1 = req_line.find(' ');
         size_t sp2 = (sp1 == std::string::npos) ? std::string::npos : req_line.find(' ', sp1 + 1);
         if (sp1 != std::string::npos && sp2 != std::string::npos) {
-            cr.method = req_line.substr(0, sp1);
-            cr.request_path = req_line.substr(sp1 + 1, sp2 - sp1 - 1);
+            cr.method.assign(req_line.data, sp1);
+            cr.request_path.assign(req_line.data + sp1 + 1, sp2 - sp1 - 1);
+            // HTTP/1.0 cierra por defecto; HTTP/1.1 mantiene la conexión
+            cr.keep_alive = !req_line.sub(sp2 + 1).trim(' ').iequals("HTTP/1.0");
         }
     }
     // Headers
     cr.content_length = -1;
+    cr.is_chunked = false;
+    cr.bad_framing = false;
+    bool has_te = false;
     size_t pos = line_end + 2;
     while (pos < cr.header_end) {
-        size_t next = cr.buffer.find("\r\n", pos);
-        if (next == std::string::npos || next > cr.header_end) break;
-        std::string line = cr.buffer.substr(pos, next - pos);
+        size_t next = pos + Scanner::findCrlf(head.data + pos, head.len - pos);
+        StrRef line = head.sub(pos, next - pos);
         size_t colon = line.find(':');
         if (colon != std::string::npos) {
-            std::string key = line.substr(0, colon);
-            std::string val = line.substr(colon + 1);
-            strip(key, ' ');
-            strip(val, ' ');
-            if (ci_equal(key, "Content-Length")) {
-                cr.content_length = strtol(val.c_str(), NULL, 10);
-                if (cr.content_length < 0) cr.content_length = -1;
+            StrRef key = line.sub(0, colon).trim(' ');
+            StrRef val = line.sub(colon + 1).trim(' ');
+            if (key.iequals("Content-Length")) {
+                long length = parse_content_length(val);
+                if (length < 0 || (cr.content_length >= 0 && length != cr.content_length))
+                    cr.bad_framing = true;
+                else
+                    cr.content_length = length;
             }
-            if (ci_equal(key, "Transfer-Encoding")) {
-                std::string lower = val;
-                to_lower(lower);
-                if (lower.find("chunked") != std::string::npos) {
-                    cr.is_chunked = true;
-                }
+            if (key.iequals("Content-Type"))
+                cr.content_type = val.str();
+            if (key.iequals("Connection"))
+                _parse_connection_header(val, cr);
+            if (key.iequals("Transfer-Encoding")) {
+                has_te = true;
+                cr.is_chunked = ends_with_chunked(val); // cuenta la última cabecera
             }
-            // Si quieres, aquí puedes detectar "Transfer-Encoding: chunked" y rechazarlo.
         }
         pos = next + 2;
     }
+    if (has_te && (cr.content_length >= 0 || !cr.is_chunked))
+        cr.bad_framing = true;
     // Determinar max_size (location > server)
-    int server_fd = _get_client_server_fd(client_sock);
-    if (server_fd < 0) {
+    const ServerUnit *server = _server_for(client_sock);
+    if (!server) {
         logError("Could not find server for client socket %d", client_sock);
         return false;
     }
-    ServerUnit &server = _servers_map[server_fd];
-    const Location* loc = _find_best_location(cr.request_path, server.getLocations());
+    const CompiledLocation *loc = _config_for(client_sock)->route(server, cr.request_path);
     if (loc)
-        cr.max_size = loc->getMaxBodySize();
+        cr.max_size = loc->max_body;
     else
-        cr.max_size = server.getClientMaxBodySize();
+        cr.max_size = server->getClientMaxBodySize();
 
     cr.headers_parsed = true;
 
@@ -278,107 +1503,408 @@ bool ServerManager::parse_headers(int client_sock, ClientRequest &cr) {
 void ServerManager::_handle_read(int client_sock) {
     char buffer[BUFFER_SIZE];
 
+    if (_cgi_bodies.count(client_sock)) {
+        _splice_cgi_body(client_sock);
+        return;
+    }
+
     logInfo("🐟 Client connected on socket %d", client_sock);
-    ClientRequest &cr = _read_requests[client_sock];
+    ssize_t n = recv(client_sock, buffer, sizeof(buffer), 0);
+    _on_received(client_sock, buffer, n);
+}
 
-    int n = recv(client_sock, buffer, sizeof(buffer), 0);
+/** Resultado de un recv (de select o de io_uring): n bytes en data, 0 si el cliente cerró, -1 si falló. */
+void ServerManager::_on_received(int client_sock, const char *buffer, ssize_t n) {
+    ClientRequest &cr = _read_requests[client_sock];
     if (n > 0) {
-        cr.append_to_buffer(std::string(buffer, n));
+        Metrics::bytesIn(n);
+        std::map<int, MultipartParser*>::iterator up = _uploads.find(client_sock);
+        if (up != _uploads.end()) {
+            // subida en streaming: el cuerpo va directo a disco, no al buffer.
+            // Lo que sobre tras Content-Length ya es la siguiente petición.
+            size_t body_bytes = cr.current_size - cr.body_start;
+            size_t take = std::min(static_cast<size_t>(n), static_cast<size_t>(cr.content_length) - body_bytes);
+            cr.current_size += take;
+            up->second->feed(buffer, take);
+            cr.buffer.append(buffer + take, n - take);
+        } else if (_cgi_bodies.count(client_sock)) {
+            // recv que ya estaba armado al empezar el splice: al temporal igual
+            size_t body_bytes = cr.current_size - cr.body_start;
+            size_t take = std::min(static_cast<size_t>(n), static_cast<size_t>(cr.content_length) - body_bytes);
+            if (!write_all(_cgi_bodies[client_sock], buffer, take)) {
+                logError("Writing CGI body for client %d failed: %s", client_sock, strerror(errno));
+                _drop_cgi_body(client_sock);
+                _queue_response(client_sock, _close_with_error(client_sock, HttpStatusCode::InternalServerError));
+                _want_write(client_sock);
+                return;
+            }
+            cr.current_size += take;
+            cr.buffer.append(buffer + take, n - take);
+        } else {
+            cr.append_to_buffer(std::string(buffer, n));
+        }
+        _process_requests(client_sock);
+        return;
+    }
+
+    if (n < 0) {
+        logError("Failed to receive data from client");
+        _cleanup_client(client_sock);
+        return;
+    }
+
+    // n == 0: el cliente cerró la conexión. Las peticiones completas ya se
+    // atendieron al llegar (salvo una aparcada, que aún se responde); lo que
+    // quede en el buffer está a medias.
+    if (_parked.count(client_sock)) {
+        FD_CLR(client_sock, &_read_fds);
+        return;
+    }
+    if (cr.buffer.empty() && !_uploads.count(client_sock)) {
+        // cierre normal de una conexión keep-alive inactiva
+        _cleanup_client(client_sock);
+        return;
+    }
+    if (cr.headers_parsed)
+        logError("Client disconnected before sending full body on socket %d. 400.", client_sock);
+    else
+        logError("Client disconnected before sending headers on socket %d. 400.", client_sock);
+    _drop_native_upload(client_sock);
+    _drop_cgi_body(client_sock);
+    _queue_response(client_sock, _close_with_error(client_sock, HttpStatusCode::BadRequest));
+    _want_write(client_sock);
+}
+
+/**
+ * Atiende en orden todas las peticiones completas que haya en el buffer de
+ * la conexión (HTTP/1.1 pipelining) y encola sus respuestas. Lo que sobra
+ * tras cada petición se conserva como inicio de la siguiente. Se para tras
+ * MAX_PIPELINE peticiones (el resto se atiende al vaciar la cola), tras
+ * una respuesta que cierra la conexión o al aparcar una petición que
+ * espera al disco o a un backend FastCGI (ver _park).
+ */
+void ServerManager::_process_requests(int client_sock) {
+    if (_parked.count(client_sock))
+        return; // _resume la repite
+    for (int depth = 0; depth < MAX_PIPELINE; ++depth) {
+        ClientRequest &cr = _read_requests[client_sock];
+        if (!cr.started && !cr.buffer.empty())
+            cr.started = Metrics::now();
 
         if (!cr.headers_parsed) {
-            if (!parse_headers(client_sock, cr)) {
-                return;
+            _refresh_config(client_sock);
+            if (!parse_headers(client_sock, cr))
+                break;
+            if (cr.bad_framing) {
+                logError("Client %d sent conflicting or invalid body framing. 400.", client_sock);
+                _queue_response(client_sock, _close_with_error(client_sock, HttpStatusCode::BadRequest));
+                break;
             }
             if (cr.max_size > 0 && cr.content_length >= 0
                 && (size_t)cr.content_length > cr.max_size) {
-                _write_buffer[client_sock] =
-                    "HTTP/1.1 413 Payload Too Large\r\n"
-                    "Content-Type: text/html\r\n"
-                    "Connection: close\r\n\r\n"
-                    "<h1>413 Payload Too Large</h1>";
-                _bytes_sent[client_sock] = 0;
-                FD_CLR(client_sock, &_read_fds);
-                FD_SET(client_sock, &_write_fds);
-                return;
+                _queue_response(client_sock, _close_with_error(client_sock, HttpStatusCode::PayloadTooLarge));
+                break;
             }
+            _start_native_upload(client_sock, cr);
+            _start_cgi_body(client_sock, cr);
         }
 
-        if (cr.headers_parsed) {
-            size_t body_bytes = (cr.current_size > cr.body_start)
-                                ? (cr.current_size - cr.body_start)
-                                : 0;
-
-            if (cr.max_size > 0 && body_bytes > cr.max_size) {
-                logError("Client %d exceeded max body size (body=%zu > %zu). 413.",
-                         client_sock, body_bytes, cr.max_size);
-                _write_buffer[client_sock] =
-                    "HTTP/1.1 413 Payload Too Large\r\n"
-                    "Content-Type: text/html\r\n"
-                    "Connection: close\r\n\r\n"
-                    "<h1>413 Payload Too Large</h1>";
-                _bytes_sent[client_sock] = 0;
-                FD_CLR(client_sock, &_read_fds);
-                FD_SET(client_sock, &_write_fds);
-                return;
+        // chunked: no hay petición completa (ni siguiente) hasta el chunk final
+        if (cr.is_chunked && cr.content_length < 0) {
+            int chunked = cr.dechunk_body();
+            if (chunked == -1) {
+                logError("Client %d sent a malformed chunked body. 400.", client_sock);
+                _queue_response(client_sock, _close_with_error(client_sock, HttpStatusCode::BadRequest));
+                break;
+            }
+            if (chunked == -2) {
+                logError("Client %d exceeded max body size (chunked > %zu). 413.", client_sock, cr.max_size);
+                _queue_response(client_sock, _close_with_error(client_sock, HttpStatusCode::PayloadTooLarge));
+                break;
             }
+            if (chunked == 0)
+                break; // falta cuerpo
+        }
 
-            bool complete = false;
-            if (cr.content_length < 0) {
-                complete = true;
-            } else {
-                complete = (body_bytes >= (size_t)cr.content_length);
+        size_t body_bytes = (cr.current_size > cr.body_start)
+                            ? (cr.current_size - cr.body_start)
+                            : 0;
+        if (cr.content_length >= 0)
+            body_bytes = std::min(body_bytes, static_cast<size_t>(cr.content_length));
+
+        if (cr.max_size > 0 && body_bytes > cr.max_size) {
+            logError("Client %d exceeded max body size (body=%zu > %zu). 413.",
+                     client_sock, body_bytes, cr.max_size);
+            _drop_native_upload(client_sock);
+            _drop_cgi_body(client_sock);
+            _queue_response(client_sock, _close_with_error(client_sock, HttpStatusCode::PayloadTooLarge));
+            break;
+        }
+        if (cr.content_length >= 0 && body_bytes < (size_t)cr.content_length)
+            break; // falta cuerpo
+
+        logInfo("🐠 Request complete from client socket %d", client_sock);
+        bool upload = _uploads.count(client_sock) > 0;
+        // en una subida o un cuerpo CGI con splice el cuerpo ya no está en el buffer
+        bool streamed = upload || _cgi_bodies.count(client_sock);
+        size_t request_end = streamed ? cr.body_start
+                                      : cr.body_start + (cr.content_length > 0 ? cr.content_length : 0);
+        request_end = std::min(request_end, cr.buffer.size());
+        std::string next = cr.buffer.substr(request_end);
+        cr.buffer.erase(request_end);
+
+        if (upload) {
+            _queue_response(client_sock, _finish_native_upload(client_sock));
+        } else {
+            std::string response;
+            try {
+                response = prepare_response(client_sock, cr.buffer);
+            } catch (const FastCgiPool::Pending &pending) {
+                _hold_request(client_sock, cr, next);
+                _park(client_sock, pending);
+                return;
             }
-            if (complete) {
-                logInfo("🐠 Request complete from client socket %d", client_sock);
-                _write_buffer[client_sock] = prepare_response(client_sock, cr.buffer);
-                _bytes_sent[client_sock] = 0;
-                FD_CLR(client_sock, &_read_fds);
-                FD_SET(client_sock, &_write_fds);
+            if (response.empty()) { // espera al disco
+                _hold_request(client_sock, cr, next);
+                _park(client_sock, FileCache::wanted());
                 return;
             }
+            _unpin(client_sock);
+            _drop_cgi_body(client_sock);
+            _queue_response(client_sock, response);
+            _read_body_async(client_sock);
         }
-        return;
+        _arenas[client_sock]->reset(); // libera de golpe todo lo de la petición
+
+        cr = ClientRequest();
+        if (_close_after[client_sock])
+            break; // nada se atiende tras una respuesta que cierra
+        if (next.empty())
+            break;
+        cr.append_to_buffer(next);
     }
+    if (!_write_queue[client_sock].empty())
+        _want_write(client_sock);
+    _close_if_idle(client_sock);
+}
 
-    if (n < 0) {
-        logError("Failed to receive data from client");
-        _cleanup_client(client_sock);
+/**
+ * La petición se aparca: queda en el buffer tal cual para repetirla,
+ * cabeceras ya leídas. Mientras tanto no se lee del socket (ni con splice):
+ * lo que llegue detrás espera en el kernel y un cierre del cliente se ve
+ * al volver a leer en _resume, en vez de despertar al bucle sin fin.
+ */
+void ServerManager::_hold_request(int client_sock, ClientRequest &cr, const std::string &next) {
+    cr.buffer.append(next);
+    _arenas[client_sock]->reset();
+    FD_CLR(client_sock, &_read_fds);
+    if (!_write_queue[client_sock].empty())
+        _want_write(client_sock);
+}
+
+void ServerManager::_queue_response(int client_sock, const std::string &response) {
+    _record_response(client_sock, response);
+    _write_queue[client_sock].push_back(response);
+    _served[client_sock]++;
+}
+
+/**
+ * Cuenta la respuesta en Metrics: método, código (leído de la línea de
+ * estado) y latencia desde el primer byte, en el histograma de su server.
+ */
+void ServerManager::_record_response(int client_sock, const std::string &response) {
+    const ClientRequest &cr = _read_requests[client_sock];
+    int status = response.size() > 12 ? atoi(response.c_str() + 9) : 0;
+    unsigned long long usec = cr.started ? Metrics::now() - cr.started : 0;
+    const ServerUnit *server = _server_for(client_sock);
+    std::string label = server ? server->getServerName() + ":" + to_string(server->getPort()) : "unknown";
+    Metrics::request(label, cr.method, status, usec);
+}
+
+/**
+ * Si la petición es un POST multipart/form-data a UPLOADS_URI, el cuerpo se
+ * procesa en streaming con MultipartParser y cada parte con fichero se
+ * escribe directamente en UPLOADS_DIR, sin acumularse en `cr.buffer`.
+ */
+void ServerManager::_start_native_upload(int client_sock, ClientRequest &cr) {
+    if (cr.method != "POST" || cr.is_chunked || cr.content_length <= 0)
+        return;
+    std::string boundary = MultipartParser::boundaryFromContentType(cr.content_type);
+    if (boundary.empty())
+        return;
+
+    const ServerUnit *server = _server_for(client_sock);
+    if (!server)
+        return;
+    std::string path(cr.request_path, 0, cr.request_path.find('?'));
+    ssize_t len = normalize_uri(path.data(), path.size(), &path[0]);
+    if (len < 0)
+        return; // prepare_response responde 400
+    path.resize(len);
+    const CompiledLocation *loc = _config_for(client_sock)->route(server, path);
+    if (loc && (!loc->allows(M_POST) || !loc->alias.empty()
+                || loc->fastcgi || !loc->cgiHandler(getFileExtension(path)).empty()))
+        return; // el camino normal se encarga (405, alias, CGI...)
+    std::string root = loc ? loc->root.str() : server->getRoot();
+    if (path_normalization(root + path) != UPLOADS_URI)
         return;
+
+    MultipartParser *parser = new MultipartParser(boundary, UPLOADS_DIR);
+    _uploads[client_sock] = parser;
+    logDebug("📦 Streaming multipart upload on socket %d", client_sock);
+
+    // bytes de cuerpo que llegaron junto con las cabeceras; lo que pase de
+    // Content-Length es la siguiente petición y se queda en el buffer
+    size_t body = std::min(cr.buffer.size() - cr.body_start, static_cast<size_t>(cr.content_length));
+    parser->feed(cr.buffer.data() + cr.body_start, body);
+    cr.buffer.erase(cr.body_start, body);
+    cr.current_size = cr.body_start + body;
+}
+
+std::string ServerManager::_finish_native_upload(int client_sock) {
+    MultipartParser *parser = _uploads[client_sock];
+    bool ok = parser->finished() && !parser->savedFiles().empty();
+    _drop_native_upload(client_sock);
+    if (!ok) {
+        logError("📦 Upload on socket %d failed or had no file", client_sock);
+        return _close_with_error(client_sock, HttpStatusCode::BadRequest);
     }
+    bool keep = _keep_alive_allowed(client_sock);
+    _close_after[client_sock] = !keep;
+    return keep ? "HTTP/1.1 201 Created\r\n"
+                  "Content-Type: text/html\r\n"
+                  "Content-Length: 0\r\n"
+                  "Connection: keep-alive\r\n\r\n"
+                : "HTTP/1.1 201 Created\r\n"
+                  "Content-Type: text/html\r\n"
+                  "Content-Length: 0\r\n"
+                  "Connection: close\r\n\r\n";
+}
 
-    if (n == 0) {
-        // el cliente cerró la conexión.
-        // Cierre del peer: decide con lo que tengas
-        if (cr.headers_parsed) {
-            size_t body_bytes = (cr.current_size > cr.body_start)
-                                ? (cr.current_size - cr.body_start)
-                                : 0;
-            if (cr.content_length < 0 || body_bytes >= (size_t)cr.content_length) {
-                logDebug("content_length: %ld, body_bytes: %zu", cr.content_length, body_bytes);
-                logInfo("🐠 Request complete from client socket %d (on close)", client_sock);
-                // last opportunity to respond
-                _write_buffer[client_sock] = prepare_response(client_sock, cr.buffer);
-            } else {
-                logError("Client disconnected before sending full body on socket %d. 400.", client_sock);
-                _write_buffer[client_sock] =
-                    "HTTP/1.1 400 Bad Request\r\n"
-                    "Content-Type: text/html\r\n"
-                    "Connection: close\r\n\r\n"
-                    "<h1>400 Bad Request</h1>";
-            }
-        } else {
-            logError("Client disconnected before sending headers on socket %d. 400.", client_sock);
-            _write_buffer[client_sock] =
-                "HTTP/1.1 400 Bad Request\r\n"
-                "Content-Type: text/html\r\n"
-                "Connection: close\r\n\r\n"
-                "<h1>400 Bad Request</h1>";
-        }
-        _bytes_sent[client_sock] = 0;
-        FD_CLR(client_sock, &_read_fds);
-        FD_SET(client_sock, &_write_fds);
+void ServerManager::_drop_native_upload(int client_sock) {
+    std::map<int, MultipartParser*>::iterator it = _uploads.find(client_sock);
+    if (it == _uploads.end())
+        return;
+    delete it->second; // borra el temporal si la parte quedó a medias
+    _uploads.erase(it);
+}
+
+/**
+ * POST con Content-Length a una location con CGI para la extensión, cuyo
+ * cuerpo aún no ha llegado entero: lo que falta va del socket a un
+ * temporal con splice() a través de _splice_pipe, sin pasar por memoria
+ * del proceso, y Cgi lo usa tal cual como stdin. Lo que ya estaba en el
+ * buffer se escribe primero.
+ */
+void ServerManager::_start_cgi_body(int client_sock, ClientRequest &cr) {
+    if (_uploads.count(client_sock) || cr.method != "POST" || cr.is_chunked || cr.content_length <= 0
+        || cr.buffer.size() - cr.body_start >= static_cast<size_t>(cr.content_length))
+        return;
+    const ServerUnit *server = _server_for(client_sock);
+    if (!server)
+        return;
+    std::string path(cr.request_path, 0, cr.request_path.find('?'));
+    ssize_t len = normalize_uri(path.data(), path.size(), &path[0]);
+    if (len < 0)
+        return; // prepare_response responde 400
+    path.resize(len);
+    const CompiledLocation *loc = _config_for(client_sock)->route(server, path);
+    if (!loc || !loc->allows(M_POST) || loc->fastcgi || loc->cgiHandler(getFileExtension(path)).empty())
+        return;
+
+    if (_splice_pipe[0] < 0) {
+        if (pipe2(_splice_pipe, O_NONBLOCK | O_CLOEXEC) < 0) {
+            logError("CGI body pipe failed: %s", strerror(errno));
+            _splice_pipe[0] = _splice_pipe[1] = -1;
+            return;
+        }
+        fcntl(_splice_pipe[1], F_SETPIPE_SZ, SPLICE_CHUNK); // si no se puede, se queda en 64 KiB
+    }
+    char name[] = "/tmp/webserv_cgi_bodyXXXXXX";
+    int fd = mkostemp(name, O_CLOEXEC);
+    if (fd < 0) {
+        logError("CGI body temp file failed: %s", strerror(errno));
+        return;
+    }
+    unlink(name); // se borra solo al cerrarlo
+    size_t body = std::min(cr.buffer.size() - cr.body_start, static_cast<size_t>(cr.content_length));
+    if (!write_all(fd, cr.buffer.data() + cr.body_start, body)) {
+        close(fd);
         return;
     }
+    cr.buffer.erase(cr.body_start, body);
+    cr.current_size = cr.body_start + body;
+    _cgi_bodies[client_sock] = fd;
+    logDebug("🧪 CGI body for socket %d goes to a temp file with splice()", client_sock);
+}
+
+/**
+ * El socket es legible: socket -> pipe -> temporal con splice(), hasta
+ * SPLICE_CHUNK por llamada para no acaparar el bucle. Cuando el cuerpo
+ * está completo, _process_requests atiende la petición.
+ */
+void ServerManager::_splice_cgi_body(int client_sock) {
+    ClientRequest &cr = _read_requests[client_sock];
+    int fd = _cgi_bodies[client_sock];
+    size_t moved = 0;
+    while (moved < SPLICE_CHUNK) {
+        size_t left = static_cast<size_t>(cr.content_length) - (cr.current_size - cr.body_start);
+        if (left == 0) {
+            // cuerpo completo: lo que venga detrás (o un cierre) se lee
+            // tras responder, no aquí con splice() de 0 bytes en bucle
+            FD_CLR(client_sock, &_read_fds);
+            break;
+        }
+        ssize_t n = splice(client_sock, NULL, _splice_pipe[1], NULL, std::min(left, static_cast<size_t>(SPLICE_CHUNK)),
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN)
+            break;
+        if (n <= 0) {
+            _on_received(client_sock, NULL, n < 0 ? -1 : 0); // cerró o falló a mitad de cuerpo
+            return;
+        }
+        Metrics::bytesIn(n);
+        if (!_flush_splice_pipe(fd, n)) {
+            logError("Writing CGI body for client %d failed: %s", client_sock, strerror(errno));
+            _drop_cgi_body(client_sock);
+            _queue_response(client_sock, _close_with_error(client_sock, HttpStatusCode::InternalServerError));
+            _want_write(client_sock);
+            return;
+        }
+        cr.current_size += n;
+        moved += n;
+    }
+    if (moved > 0)
+        _process_requests(client_sock);
+}
+
+/** Vacía en fd los len bytes del pipe. Si falla, el pipe (con restos) se descarta. */
+bool ServerManager::_flush_splice_pipe(int fd, size_t len) {
+    while (len > 0) {
+        ssize_t n = splice(_splice_pipe[0], NULL, fd, NULL, len, SPLICE_F_MOVE);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            int saved = errno;
+            close(_splice_pipe[0]);
+            close(_splice_pipe[1]);
+            _splice_pipe[0] = _splice_pipe[1] = -1;
+            errno = n < 0 ? saved : ENOSPC;
+            return false;
+        }
+        len -= n;
+    }
+    return true;
+}
+
+void ServerManager::_drop_cgi_body(int client_sock) {
+    std::map<int, int>::iterator it = _cgi_bodies.find(client_sock);
+    if (it == _cgi_bodies.end())
+        return;
+    close(it->second);
+    _cgi_bodies.erase(it);
 }
 
 bool ServerManager::_request_complete(const ClientRequest& clrequest) {
@@ -417,108 +1943,105 @@ bool ServerManager::_try_drain_and_adjust_response(int client_socket, std::strin
     return false;
 }
 
-const Location* ServerManager::_find_best_location(const std::string& request_path, const std::vector<Location> &locations) const{
-    const Location* best_match = NULL;
-    size_t best_len = 0;
-
-    for (size_t i = 0; i < locations.size(); ++i) {
-        const Location& loc = locations[i];
-
-        std::string loc_path = loc.getPathLocation();
-        if (path_matches(loc_path, request_path)) {
-            // Preferimos el que tenga el prefix MÁS LARGO
-            if (loc_path.size() > best_len) {
-                best_match = &loc;
-                best_len = loc_path.size();
-            }
-        }
-    }
-    return best_match; // puede ser NULL si ninguno matchea
-}
-void ServerManager::_apply_location_config(
-    const Location *loc,
+/**
+ * Los pasos de la resolución devuelven false cuando la petición ya tiene
+ * respuesta (3xx/4xx en route.status y route.target), sin lanzar nada.
+ */
+bool ServerManager::_apply_location_config(
+    const CompiledLocation *loc,
     std::string &root,
     std::string &index,
     bool &autoindex,
     std::string &full_path,
     const std::string &request_path,
     const std::string &request_method,
-    bool &used_alias
+    bool &used_alias,
+    ResolvedRoute &route
 ) {
     if (!loc)
-        return;
+        return true;
 
-    logDebug("🍍 Location matched: %s", loc->getPathLocation().c_str());
+    logDebug("🍍 Location matched: %.*s", static_cast<int>(loc->path.len), loc->path.data);
 
-    // Verificar métodos permitidos
-    if (!loc->getMethods()[method_toEnum(request_method)]) {
-        std::string methods = loc->getPrintMethods();
-        throw HttpExceptionNotAllowed(methods);
+    // Verificar métodos permitidos (un método desconocido tampoco lo está)
+    if (!loc->allows(method_id(request_method))) {
+        route.status = HttpStatusCode::MethodNotAllowed;
+        route.target = loc->allow.str();
+        return false;
     }
-    
-    // Root
-    if (!loc->getRootLocation().empty())
-        root = loc->getRootLocation();
+
+    // Root e index: los de la location o, si no tiene, los del server (ya resueltos al compilar)
+    root.assign(loc->root.data, loc->root.len);
+    index.assign(loc->index.data, loc->index.len);
 
     // Alias
-    if (!loc->getAlias().empty()) { // ONLY ABSOLUTE ALIAS SUPPORTED
-        full_path = loc->getAlias() + request_path.substr(loc->getPathLocation().size());
+    if (!loc->alias.empty()) { // ONLY ABSOLUTE ALIAS SUPPORTED
+        full_path.assign(loc->alias.data, loc->alias.len);
+        if (request_path.size() > loc->path.len)
+            full_path.append(request_path, loc->path.len, std::string::npos);
         used_alias = true;
         logDebug("🍍 Using alias: %s -> %s", request_path.c_str(), full_path.c_str());
     }
 
-    // Index
-    if (!loc->getIndexLocation().empty())
-        index = loc->getIndexLocation();
-
     // Autoindex
-    if (loc->getAutoindex() != autoindex)
-        autoindex = loc->getAutoindex();
+    autoindex = loc->autoindex;
+    return true;
 }
 
-void ServerManager::_handle_directory_case(
+bool ServerManager::_handle_directory_case(
     std::string &full_path,
     const std::string &request_path,
     const std::string &index,
     bool autoindex,
-    Request &request
+    ResolvedRoute &route
 ) {
-    if (ConfigFile::getTypePath(full_path) != F_DIRECTORY)
-        return;
+    int type = FileCache::type(full_path);
+    if (type == F_PENDING) {
+        route.pending = true;
+        return false;
+    }
+    if (type != F_DIRECTORY)
+        return true;
     logDebug("🍍 Handling directory case for path: %s", full_path.c_str());
 
     // without trailing slash -> redirect
     if (!request_path.empty() && request_path[request_path.size() - 1] != '/') {
-        std::string new_location = request_path + "/";
-        throw HttpExceptionRedirect(HttpStatusCode::MovedPermanently, new_location);
+        route.status = HttpStatusCode::MovedPermanently;
+        route.target = request_path + "/";
+        return false;
     }
 
     // index defined and exists -> use it
     if (!index.empty()) { // index defined
         std::string index_path = full_path + index;
-        if (ConfigFile::getTypePath(index_path) == F_REGULAR_FILE) { 
+        int index_type = FileCache::type(index_path);
+        if (index_type == F_PENDING) {
+            route.pending = true;
+            return false;
+        }
+        if (index_type == F_REGULAR_FILE) {
             full_path = index_path;
             logDebug("🍍 Directory index found: %s", index_path.c_str());
-            return;
+            return true;
         }
     }
     // no index defined or not found
     if (autoindex) {
         // autoindex ON
         logDebug("🍍 Autoindex enabled for directory %s", full_path.c_str());
-        request.setAutoindex(true);
-    }
-    else {
-        // No hay index y autoindex está deshabilitado → 404
-        throw HttpException(HttpStatusCode::NotFound);
+        route.autoindex = true;
+        return true;
     }
-    
+    // No hay index y autoindex está deshabilitado → 404
+    route.status = HttpStatusCode::NotFound;
+    return false;
 }
 
-void ServerManager::_apply_redirection(const Location *loc) {
-    if (loc && !loc->getReturn().empty()) {
-        std::string new_location = loc->getReturn();
-        throw HttpExceptionRedirect(HttpStatusCode::MovedPermanently, new_location);
+bool ServerManager::_apply_redirection(const CompiledLocation *loc, ResolvedRoute &route) {
+    if (loc && !loc->redirect.empty()) {
+        route.status = HttpStatusCode::MovedPermanently;
+        route.target = loc->redirect.str();
+        return false;
     }
     // else if (server.hasReturn()) {...}
 
@@ -535,81 +2058,191 @@ void ServerManager::_apply_redirection(const Location *loc) {
     --> o sea, con codigo de redireccion 
     ademas!! acepta return en server block y nosotros no.
     */
+    return true;
 }
 
 /**
  * Resolve the request path based on server configuration.
  * index, root, alias, return, etc.
+ * Las rutas ya resueltas salen de la RouteCache de la configuración. Si
+ * route.status no es 0 la petición no llega a un fichero y hay que
+ * responder con ese código (ver _route_response). NULL si para decidirlo
+ * hay que mirar el disco (FileCache::wanted()); esa ruta no se cachea.
  */
-void ServerManager::resolve_path(Request &request, int client_socket) {
-    int server_fd = _get_client_server_fd(client_socket);
-    if (server_fd == -1) {
+const ResolvedRoute *ServerManager::resolve_path(Request &request, int client_socket) {
+    const ServerUnit *srv = _server_for(client_socket);
+    if (!srv) {
         logError("resolve_path: client_socket %d not found in _client_server_map!", client_socket);
         throw HttpException(HttpStatusCode::InternalServerError);
     }
 
-    ServerUnit &server = _servers_map[server_fd];
-    std::string path = request.getPath();
-    path = path_normalization(clean_path(path));
-    
+    const ConfigSnapshot *config = _config_for(client_socket);
+    RouteCache &cache = config->routeCache();
+    int method = method_id(request.getMethod());
+    const ResolvedRoute *route = cache.find(srv, method, request.getPath());
+    if (!route) {
+        ResolvedRoute resolved;
+        _resolve_route(config, srv, request.getPath(), request.getMethod(), resolved);
+        if (resolved.pending)
+            return NULL;
+        route = &cache.store(srv, method, request.getPath(), resolved);
+    }
+    if (route->status)
+        return route;
+    request.setMatchedLocation(route->location);
+    request.setRoot(route->root);
+    if (route->autoindex)
+        request.setAutoindex(true);
+    request.setPath(route->path);
+    return route;
+}
+
+/** Resuelve la ruta sin tocar la petición, para poder cachear el resultado. */
+void ServerManager::_resolve_route(const ConfigSnapshot *config, const ServerUnit *srv,
+                                   const std::string &request_path, const std::string &method,
+                                   ResolvedRoute &route) {
+    const ServerUnit &server = *srv;
+    std::string path(request_path);
+    ssize_t len = path.empty() ? -1 : normalize_uri(path.data(), path.size(), &path[0]);
+    if (len < 0) {
+        route.status = HttpStatusCode::BadRequest;
+        return;
+    }
+    path.resize(len);
+
     // server block config
     std::string root = server.getRoot();
     std::string index = server.getIndex();
     bool autoindex = server.getAutoindex();
     bool used_alias = false;
     std::string full_path;
-    
+
     // 1. search best location and apply
-    const Location *loc = _find_best_location(path, server.getLocations());
-    _apply_redirection(loc);
-    _apply_location_config(loc, root, index, autoindex, full_path, path, request.getMethod(), used_alias);
-    request.setMatchedLocation(loc);
+    const CompiledLocation *loc = config->route(srv, path);
+    if (!_apply_redirection(loc, route)
+        || !_apply_location_config(loc, root, index, autoindex, full_path, path, method, used_alias, route))
+        return;
+    route.location = loc;
 
     if (!used_alias)
-        full_path = root + path;
+        full_path = path_normalization(root + path);
+    route.root = used_alias ? loc->alias.str() : root;
 
     // 4. Gestionar directorios, autoindex e index
-    _handle_directory_case(full_path, path, index, autoindex, request);
+    if (!_handle_directory_case(full_path, path, index, autoindex, route))
+        return;
 
     // checking the file existence is done by the methods resolver.
-    
-    // finally, set the resolved path
-    request.setPath(full_path);
+    route.path = full_path;
+}
+
+/** Respuesta de una ruta que no llega a un fichero: 3xx, 405 u otro error. */
+std::string ServerManager::_route_response(int client_socket, const ResolvedRoute &route) {
+    if (route.status == HttpStatusCode::MethodNotAllowed)
+        return _not_allowed_response(client_socket, route.target);
+    if (route.status >= 300 && route.status < 400)
+        return _redirect_response(client_socket, route.status, route.target);
+    return prepare_error_response(client_socket, route.status);
+}
+
+std::string ServerManager::_redirect_response(int client_socket, int code, const std::string &location) {
+    logInfo("🍊 Acción: Redirigir con código %d a %s", code, location.c_str());
+    const CannedResponse *canned = _config_for(client_socket)->redirect(location);
+    std::string response_str;
+    if (canned && canned->getCode() == code)
+        response_str = _finalize_canned(client_socket, *canned);
+    else // la de un directorio sin '/' final depende de la petición
+        response_str = _finalize_canned(client_socket, CannedResponse::redirect(code, location));
+    logInfo("response_str redirect ok");
+    return response_str;
+}
+
+/**
+ * Respuesta de una petición FastCGI cuyo intercambio ya terminó en un hilo.
+ * Se construye con el resultado sin volver a resolver la ruta: así la
+ * repetición no puede aparcarse otra vez en el disco ni mandar la
+ * petición (un POST, quizá) al backend una segunda vez.
+ */
+std::string ServerManager::_fastcgi_response(int client_socket, IoJob *job) {
+    std::string output;
+    output.swap(job->output);
+    bool ok = job->found;
+    delete job;
+    if (!ok)
+        return prepare_error_response(client_socket, HttpStatusCode::BadGateway);
+    HttpResponse response(HttpStatusCode::OK);
+    response.reset_all();
+    response.set_cgi_response(output);
+    return _finalize_response(client_socket, response);
+}
+
+std::string ServerManager::_not_allowed_response(int client_socket, const std::string &methods) {
+    logInfo("🍊 Acción: Método no permitido. Allowed: %s", methods.c_str());
+    HttpResponse response(HttpStatusCode::MethodNotAllowed);
+    response.set_allow_methods(methods);
+    std::string response_str = _finalize_response(client_socket, response);
+    logInfo("response_str not allowed ok");
+    logDebug("response:\n%s\n-----", response_str.c_str());
+    // encapsulate drain-and-adjust logic in helper
+    _try_drain_and_adjust_response(client_socket, response_str);
+    return response_str;
 }
 
+/**
+ * Las respuestas previsibles (redirecciones, 404, 405...) llegan como
+ * resultado de resolve_path() o HttpResponse::getError(), sin lanzar
+ * excepciones; los catch quedan para los fallos de verdad. Tampoco se
+ * lanza nada cuando la ruta o el fichero están por mirar en disco: se
+ * devuelve una cadena vacía y _process_requests aparca la petición con
+ * FileCache::wanted().
+ */
 std::string ServerManager::prepare_response(int client_socket, const std::string &request_str) {
     std::string response_str;
 
     try {
+        std::map<int, IoJob*>::iterator fastcgi = _fastcgi_done.find(client_socket);
+        if (fastcgi != _fastcgi_done.end()) {
+            IoJob *job = fastcgi->second;
+            _fastcgi_done.erase(fastcgi);
+            response_str = _fastcgi_response(client_socket, job);
+            logInfo("Done\n----------");
+            return response_str;
+        }
         logDebug("\n----------\n⛺️Parsing request:\n%s", request_str.c_str());
-        Request request(request_str);
-        if (request.getRet() != 200) 
-            throw HttpException(request.getRet());
+        std::map<int, Arena*>::iterator ar = _arenas.find(client_socket);
+        Request request(request_str, ar != _arenas.end() ? ar->second : NULL);
+        std::map<int, int>::iterator body = _cgi_bodies.find(client_socket);
+        if (body != _cgi_bodies.end())
+            request.setBodyFile(body->second);
+        if (request.getRet() != 200) {
+            response_str = prepare_error_response(client_socket, request.getRet());
+            logInfo("Done\n----------");
+            return response_str;
+        }
         logDebug("🍅 Request parsed. Query: [%s:%s]",request.getMethod().c_str(),request.getPath().c_str());
-        resolve_path(request, client_socket);
-        logDebug("🍅 preparing response. client socket: %i. Query: %s %s",
-            client_socket, request.getMethod().c_str(), request.getPath().c_str());
-        HttpResponse response(&request);
-        response_str = response.getResponse();
-        logInfo("response_str ok");
+        const ResolvedRoute *route = resolve_path(request, client_socket);
+        if (!route)
+            return "";
+        if (route->status) {
+            response_str = _route_response(client_socket, *route);
+        } else {
+            logDebug("🍅 preparing response. client socket: %i. Query: %s %s",
+                client_socket, request.getMethod().c_str(), request.getPath().c_str());
+            HttpResponse response(&request);
+            if (response.waiting())
+                return "";
+            if (response.getError()) {
+                response_str = prepare_error_response(client_socket, response.getError());
+                logInfo("response_str error ok");
+            } else {
+                response_str = _finalize_response(client_socket, response);
+                logInfo("response_str ok");
+            }
+        }
     } catch (const HttpExceptionRedirect &e) {
-        int code = e.getStatusCode();
-        std::string location = e.getLocation();
-        logInfo("🍊 Acción: Redirigir con código %d a %s", code, location.c_str());
-        HttpResponse response(code, location);
-        response_str = response.getResponse();
-        logInfo("response_str redirect ok");
+        response_str = _redirect_response(client_socket, e.getStatusCode(), e.getLocation());
     } catch (const HttpExceptionNotAllowed &e) {
-        int code = e.getStatusCode();
-        std::string methods = e.getAllowedMethods();
-        logInfo("🍊 Acción: Método no permitido. Allowed: %s", methods.c_str());
-        HttpResponse response(code);
-        response.set_allow_methods(methods);
-        response_str = response.getResponse();
-        logInfo("response_str not allowed ok");
-        logDebug("response:\n%s\n-----", response_str.c_str());
-        // encapsulate drain-and-adjust logic in helper
-        _try_drain_and_adjust_response(client_socket, response_str);
+        response_str = _not_allowed_response(client_socket, e.getAllowedMethods());
     } catch (const HttpException &e) {
         int code = e.getStatusCode();
         logError("HTTP Exception caught: %s, code %d", e.what(), code);
@@ -628,22 +2261,17 @@ std::string ServerManager::prepare_response(int client_socket, const std::string
 
 std::string ServerManager::prepare_error_response(int client_socket, int code) {
     logInfo("Prep error: client socket %i. error %d", client_socket, code);
-    std::string response_str;
     // first: try error page in config
-    int server_fd = _get_client_server_fd(client_socket);
-    if (server_fd == -1) {
+    const ServerUnit *server = _server_for(client_socket);
+    if (!server) {
         // no deberia pasar
         logError("prep error: client_socket %d not found in _client_server_map!", client_socket);
-        HttpResponse response(HttpStatusCode::InternalServerError);
-        return response.getResponse();
+        return _finalize_canned(client_socket, CannedResponse::defaultError(HttpStatusCode::InternalServerError));
     }
-    ServerUnit &server = _servers_map[server_fd];
-    std::string err_page_path = server.getPathErrorPage(code);
-    if (!err_page_path.empty()) {
-        logInfo("🍊 Acción: Mostrar página de error %d desde %s", code, err_page_path.c_str());
-        HttpResponse response(code, WWW_ROOT + err_page_path);
-        response_str = response.getResponse();
-        return response_str;
+    const CannedResponse *page = _config_for(client_socket)->errorPage(server, code);
+    if (page) {
+        logInfo("🍊 Acción: Mostrar página de error %d desde %s", code, server->getPathErrorPage(code).c_str());
+        return _finalize_canned(client_socket, *page);
     }
     logDebug("prep error: error page for code %d not found in server config", code);
     // if not found, treat web server error
@@ -652,52 +2280,117 @@ std::string ServerManager::prepare_error_response(int client_socket, int code) {
         case HttpStatusCode::NotFound:
         case HttpStatusCode::Forbidden:
         case HttpStatusCode::MethodNotAllowed:
-            {
-                // show error page
-                logError("🍊 Acción: Mostrar página de error %d.", code);
-                HttpResponse response(code);
-                response_str = response.getResponse();
-            }
+            logError("🍊 Acción: Mostrar página de error %d.", code);
             break;
         case HttpStatusCode::InternalServerError:
             logError("Error. %s. Acción: Revisar los registros del servidor.", message.c_str());
-            {
-                HttpResponse response(code);
-                response_str = response.getResponse();
-            }
             break;
         case HttpStatusCode::BadRequest:
-            response_str =
-                    "HTTP/1.1 400 Bad Request\r\n"
-                    "Content-Type: text/html\r\n"
-                    "Connection: close\r\n\r\n"
-                    "<h1>400 Bad Request</h1>";
-            break;
+            return _close_with_error(client_socket, code);
         default:
-            {
-                logError("Error no gestionado: %s. hacer algo!.", message.c_str());
-                // show error page
-                logError("🍊 Acción: Mostrar página de error %d.", code);
-                HttpResponse response(code);
-                response_str = response.getResponse();
-            }
+            logError("Error no gestionado: %s. hacer algo!.", message.c_str());
+            // show error page
+            logError("🍊 Acción: Mostrar página de error %d.", code);
             break;
     }
-    return response_str;
+    return _finalize_canned(client_socket, CannedResponse::defaultError(code));
+}
+
+/**
+ * Último paso de toda respuesta generada con HttpResponse: aplica la
+ * decisión de keep-alive de la conexión y la recuerda para _handle_write,
+ * que ya no necesita buscar "Connection: close" en los buffers.
+ */
+std::string ServerManager::_finalize_response(int client_socket, HttpResponse &response) {
+    if (!_keep_alive_allowed(client_socket))
+        response.set_keep_alive(false);
+    _close_after[client_socket] = !response.keep_alive();
+    _body_fd = response.releaseBodyFile(_body_size);
+    return response.getResponse();
+}
+
+/** Igual que _finalize_response para una respuesta ya renderizada (CannedResponse). */
+std::string ServerManager::_finalize_canned(int client_socket, const CannedResponse &response) {
+    bool keep = !response.closes() && _keep_alive_allowed(client_socket);
+    _close_after[client_socket] = !keep;
+    return response.render(keep);
+}
+
+/** Respuesta de error tras la que siempre se cierra (413, 400...). */
+std::string ServerManager::_close_with_error(int client_socket, int code) {
+    _close_after[client_socket] = true;
+    return CannedResponse::defaultError(code).render(false);
+}
+
+/**
+ * Se puede mantener la conexión si el cliente no pidió cerrarla (o es
+ * HTTP/1.0 sin "Connection: keep-alive") y no se alcanza keepalive_requests.
+ */
+bool ServerManager::_keep_alive_allowed(int client_socket) {
+    std::map<int, ClientRequest>::iterator cr = _read_requests.find(client_socket);
+    if (_draining || cr == _read_requests.end() || !cr->second.keep_alive)
+        return false;
+    const ServerUnit *server = _server_for(client_socket);
+    if (!server)
+        return false;
+    return _served[client_socket] + 1 < server->getKeepaliveRequests();
 }
 
 void ServerManager::_cleanup_client(int client_sock) {
     FD_CLR(client_sock, &_read_fds);
     FD_CLR(client_sock, &_write_fds);
-    close(client_sock);
-    _client_server_map.erase(client_sock);
+    // sus lecturas de disco en curso terminarán sin respuesta que completar
+    std::deque<std::string> &queue = _write_queue[client_sock];
+    for (std::deque<std::string>::iterator it = queue.begin(); it != queue.end(); ++it)
+        _filling.erase(&*it);
+    _parked.erase(client_sock);
+    _unpin(client_sock);
+    std::map<int, IoJob*>::iterator fastcgi = _fastcgi_done.find(client_sock);
+    if (fastcgi != _fastcgi_done.end()) {
+        delete fastcgi->second;
+        _fastcgi_done.erase(fastcgi);
+    }
+    if (_uring)
+        _uring_forget(client_sock);
+    if (_client_server_map.erase(client_sock)) {
+        Metrics::connectionClosed();
+        struct tcp_info info;
+        socklen_t len = sizeof(info);
+        if (getsockopt(client_sock, IPPROTO_TCP, TCP_INFO, &info, &len) == 0)
+            Metrics::tcpInfo(info.tcpi_rtt, info.tcpi_total_retrans, info.tcpi_options & TCPI_OPT_SYN_DATA);
+    }
+    if (_uring)
+        _uring->close(client_sock, io_tag(IO_CLOSE, 0)); // sale con el resto de la vuelta
+    else
+        close(client_sock);
     _read_requests.erase(client_sock);
-    _write_buffer.erase(client_sock);
+    _write_queue.erase(client_sock);
     _bytes_sent.erase(client_sock);
+    _served.erase(client_sock);
+    _close_after.erase(client_sock);
+    _corked.erase(client_sock);
+    _drop_native_upload(client_sock);
+    _drop_cgi_body(client_sock);
+    std::map<int, ConfigSnapshot*>::iterator cfg = _client_config.find(client_sock);
+    if (cfg != _client_config.end()) {
+        cfg->second->release();
+        _client_config.erase(cfg);
+    }
+    std::map<int, Arena*>::iterator ar = _arenas.find(client_sock);
+    if (ar != _arenas.end()) {
+        delete ar->second;
+        _arenas.erase(ar);
+    }
     logInfo("🐟 Client socket %d cleaned up", client_sock);
 }
 
 void ServerManager::_handle_signal(int signal) {
-	(void)signal;
-    ServerManager::_running = false;
+    if (signal == SIGTERM)
+        ServerManager::_term_requested = 1;
+    else if (signal == SIGHUP)
+        ServerManager::_reload_requested = 1;
+    else if (signal == SIGUSR2)
+        ServerManager::_upgrade_requested = 1;
+    else
+        ServerManager::_running = 0;
 }
\ No newline at end of file
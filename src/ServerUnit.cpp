@@ -1,6 +1,9 @@
 #include "../include/WebServ.hpp"
 #include <limits.h>
 
+SocketOptions::SocketOptions()
+    : tcp_nodelay(true), tcp_cork(false), sndbuf(0), rcvbuf(0), fastopen(0) {}
+
 ServerUnit::ServerUnit() // Check
 {
     this->_port = 0;
@@ -8,6 +11,9 @@ ServerUnit::ServerUnit() // Check
     this->_server_name = "";
     this->_root = "";
     this->_client_max_body_size = MAX_CONTENT_LENGTH;
+    this->_keepalive_requests = DEFAULT_KEEPALIVE_REQUESTS;
+    this->_backlog = BACKLOG_SIZE;
+    this->_defer_accept = 0;
     this->_index = "";
     this->_autoindex = false;
     this->initErrorPages();
@@ -25,6 +31,10 @@ ServerUnit::ServerUnit(const ServerUnit &other) // Check
         this->_host = other._host;
         this->_port = other._port;
         this->_client_max_body_size = other._client_max_body_size;
+        this->_keepalive_requests = other._keepalive_requests;
+        this->_backlog = other._backlog;
+        this->_defer_accept = other._defer_accept;
+        this->_socket_options = other._socket_options;
         this->_index = other._index;
         this->_error_list = other._error_list;
         this->_locations = other._locations;
@@ -44,6 +54,10 @@ ServerUnit &ServerUnit::operator=(const ServerUnit & rhs) // Check
         this->_port = rhs._port;
         this->_host = rhs._host;
         this->_client_max_body_size = rhs._client_max_body_size;
+        this->_keepalive_requests = rhs._keepalive_requests;
+        this->_backlog = rhs._backlog;
+        this->_defer_accept = rhs._defer_accept;
+        this->_socket_options = rhs._socket_options;
         this->_index = rhs._index;
         this->_error_list = rhs._error_list;
         this->_locations = rhs._locations;
@@ -147,6 +161,112 @@ void ServerUnit::setClientMaxBodySize(std::string token) // Check
     this->_client_max_body_size = body_size;
 }
 
+/**
+ * keepalive_requests <n>; número máximo de peticiones servidas por una
+ * misma conexión antes de responder con "Connection: close" (como Nginx).
+ */
+void ServerUnit::setKeepaliveRequests(std::string token)
+{
+    checkSemicolon(token);
+    for (size_t i = 0; i < token.length(); i++)
+    {
+        if (token[i] < '0' || token[i] > '9')
+            throw ErrorException(SYNTAX_ERR_KEEPALIVE);
+    }
+    if (token.empty() || !ft_stoi(token))
+        throw ErrorException(SYNTAX_ERR_KEEPALIVE);
+    this->_keepalive_requests = ft_stoi(token);
+}
+
+/**
+ * backlog <n>; longitud de la cola de conexiones completadas que esperan
+ * a accept(). El kernel la recorta a net.core.somaxconn.
+ */
+void ServerUnit::setBacklog(std::string token)
+{
+    checkSemicolon(token);
+    if (token.empty() || token.length() > 9)
+        throw ErrorException(SYNTAX_ERR_BACKLOG);
+    for (size_t i = 0; i < token.length(); i++)
+    {
+        if (token[i] < '0' || token[i] > '9')
+            throw ErrorException(SYNTAX_ERR_BACKLOG);
+    }
+    if (!ft_stoi(token))
+        throw ErrorException(SYNTAX_ERR_BACKLOG);
+    this->_backlog = ft_stoi(token);
+}
+
+/**
+ * defer_accept <segundos>; con TCP_DEFER_ACCEPT el kernel no entrega la
+ * conexión hasta que llegan datos (o pasan esos segundos), así accept()
+ * no despierta al servidor por conexiones que aún no enviaron la petición.
+ * 0 lo desactiva.
+ */
+void ServerUnit::setDeferAccept(std::string token)
+{
+    checkSemicolon(token);
+    if (token.empty() || token.length() > 5)
+        throw ErrorException(SYNTAX_ERR_DEFER_ACCEPT);
+    for (size_t i = 0; i < token.length(); i++)
+    {
+        if (token[i] < '0' || token[i] > '9')
+            throw ErrorException(SYNTAX_ERR_DEFER_ACCEPT);
+    }
+    this->_defer_accept = ft_stoi(token);
+}
+
+bool ServerUnit::isSocketOption(const std::string &directive)
+{
+    return directive == TCP_NODELAY_DIRECTIVE || directive == TCP_CORK_DIRECTIVE
+        || directive == SNDBUF || directive == RCVBUF || directive == FASTOPEN;
+}
+
+/** Número positivo con sufijo opcional k/m (sndbuf 256k;). */
+static int parse_socket_size(const std::string &directive, const std::string &token, bool suffix)
+{
+    size_t digits = 0;
+    while (digits < token.length() && token[digits] >= '0' && token[digits] <= '9')
+        digits++;
+    int shift = 0;
+    if (suffix && digits + 1 == token.length() && (token[digits] == 'k' || token[digits] == 'K'))
+        shift = 10;
+    else if (suffix && digits + 1 == token.length() && (token[digits] == 'm' || token[digits] == 'M'))
+        shift = 20;
+    else if (digits != token.length())
+        throw ServerUnit::ErrorException(SYNTAX_ERR_SOCKET_OPT + directive);
+    if (digits == 0 || digits > 9)
+        throw ServerUnit::ErrorException(SYNTAX_ERR_SOCKET_OPT + directive);
+    long value = static_cast<long>(ft_stoi(token.substr(0, digits))) << shift;
+    if (value <= 0 || value > INT_MAX)
+        throw ServerUnit::ErrorException(SYNTAX_ERR_SOCKET_OPT + directive);
+    return static_cast<int>(value);
+}
+
+/**
+ * tcp_nodelay on|off; (por defecto on), tcp_cork on|off; (off),
+ * sndbuf <n>; rcvbuf <n>; (bytes, admiten k/m) y fastopen <cola>;
+ */
+void ServerUnit::setSocketOption(const std::string &directive, std::string token)
+{
+    checkSemicolon(token);
+    if (directive == TCP_NODELAY_DIRECTIVE || directive == TCP_CORK_DIRECTIVE)
+    {
+        if (token != "on" && token != "off")
+            throw ErrorException(SYNTAX_ERR_SOCKET_OPT + directive + ": must be 'on' or 'off'");
+        if (directive == TCP_NODELAY_DIRECTIVE)
+            this->_socket_options.tcp_nodelay = (token == "on");
+        else
+            this->_socket_options.tcp_cork = (token == "on");
+    }
+    else if (directive == SNDBUF)
+        this->_socket_options.sndbuf = parse_socket_size(directive, token, true);
+    else if (directive == RCVBUF)
+        this->_socket_options.rcvbuf = parse_socket_size(directive, token, true);
+    else if (directive == FASTOPEN)
+        this->_socket_options.fastopen = parse_socket_size(directive, token, false);
+}
+
 void ServerUnit::setIndex(std::string index) //Check
 {
     checkSemicolon(index);
@@ -213,6 +333,9 @@ void ServerUnit::setLocation(std::string path, std::vector<std::string> tokens)
     bool flag_methods = false;
     bool flag_autoindex = false;
     bool flag_max_size = false;
+    bool flag_fastcgi_pool = false;
+    bool flag_fastcgi_queue = false;
+    bool flag_status = false;
     int valid;
 
     new_location.setPathLocation(path);
@@ -323,6 +446,55 @@ void ServerUnit::setLocation(std::string path, std::vector<std::string> tokens)
             new_location.addCgiHandler(extension, cgi_path);
             i += 2; // skip the processed tokens
         }
+        else if (tokens[i] == FASTCGI_PASS && (i + 1) < tokens.size())
+        {
+            if (!new_location.getFastCgiPass().empty())
+                throw ErrorException(FASTCGI_DUP_ERR);
+            checkSemicolon(tokens[++i]);
+            new_location.setFastCgiPass(tokens[i]);
+        }
+        else if (tokens[i] == FASTCGI_POOL && (i + 1) < tokens.size())
+        {
+            if (flag_fastcgi_pool)
+                throw ErrorException(FASTCGI_DUP_ERR);
+            checkSemicolon(tokens[++i]);
+            new_location.setFastCgiPool(tokens[i]);
+            flag_fastcgi_pool = true;
+        }
+        else if (tokens[i] == FASTCGI_QUEUE && (i + 1) < tokens.size())
+        {
+            if (flag_fastcgi_queue)
+                throw ErrorException(FASTCGI_DUP_ERR);
+            checkSemicolon(tokens[++i]);
+            new_location.setFastCgiQueue(tokens[i]);
+            flag_fastcgi_queue = true;
+        }
+        else if (tokens[i] == FASTCGI_SPAWN)
+        {
+            // expected: fastcgi_spawn ./exec <workers> ;
+            if (i + 2 >= tokens.size())
+                throw ErrorException(TOKEN_ERR ": incomplete fastcgi_spawn directive");
+            if (!new_location.getFastCgiSpawn().empty())
+                throw ErrorException(FASTCGI_DUP_ERR);
+            std::string exec = tokens[i + 1];
+            std::string workers = tokens[i + 2];
+            checkSemicolon(workers);
+            if (exec.size() < 3 || exec[0] != '.' || exec[1] != '/')
+                throw ErrorException(SYNTAX_ERR_CGI_PATH);
+            exec = exec.substr(2);
+            if (!ConfigFile::isFileExistAndExecutable("./", exec))
+                throw ErrorException(CGI_ERR_VALIDATION ": fastcgi_spawn path does not exist or is not executable");
+            new_location.setFastCgiSpawn(exec, workers);
+            i += 2;
+        }
+        else if (tokens[i] == STATUS && (i + 1) < tokens.size())
+        {
+            if (flag_status)
+                throw ErrorException(STATUS_DUP_ERR);
+            checkSemicolon(tokens[++i]);
+            new_location.setStatus(tokens[i]);
+            flag_status = true;
+        }
         else if (tokens[i] == CMBS && (i + 1) < tokens.size())
         {
             if (flag_max_size)
@@ -338,6 +510,8 @@ void ServerUnit::setLocation(std::string path, std::vector<std::string> tokens)
     //     new_location.setIndexLocation(this->_index);
     if (!flag_max_size)
         new_location.setMaxBodySize(this->_client_max_body_size);
+    if (!new_location.getFastCgiSpawn().empty() && new_location.getFastCgiPass().empty())
+        throw ErrorException(FASTCGI_SPAWN_ERR);
     valid = isValidLocation(new_location);
     if (valid == ER_VAL_CGI)
         throw ErrorException(CGI_ERR_VALIDATION);
@@ -452,17 +626,17 @@ bool ServerUnit::isValidErrorPages() // Check
     return (true);
 }
 
-const std::string &ServerUnit::getServerName() //Check
+const std::string &ServerUnit::getServerName() const //Check
 {
     return (this->_server_name);
 }
 
-const std::string &ServerUnit::getRoot() //Check
+const std::string &ServerUnit::getRoot() const //Check
 {
     return (this->_root);
 }
 
-const bool &ServerUnit::getAutoindex() //Check
+const bool &ServerUnit::getAutoindex() const //Check
 {
     return (this->_autoindex);
 }
@@ -471,22 +645,42 @@ const in_addr_t &ServerUnit::getHost() const { return this->_host; }
 
 const uint16_t &ServerUnit::getPort() const  { return this->_port; }
 
-const size_t &ServerUnit::getClientMaxBodySize() //Check
+const size_t &ServerUnit::getClientMaxBodySize() const //Check
 {
     return (this->_client_max_body_size);
 }
 
-const std::vector<Location> &ServerUnit::getLocations() //Check
+size_t ServerUnit::getKeepaliveRequests() const
+{
+    return (this->_keepalive_requests);
+}
+
+int ServerUnit::getBacklog() const
+{
+    return (this->_backlog);
+}
+
+int ServerUnit::getDeferAccept() const
+{
+    return (this->_defer_accept);
+}
+
+const SocketOptions &ServerUnit::getSocketOptions() const
+{
+    return (this->_socket_options);
+}
+
+const std::vector<Location> &ServerUnit::getLocations() const //Check
 {
     return (this->_locations);
 }
 
-const std::map<short, std::string> &ServerUnit::getErrorPages() //Check
+const std::map<short, std::string> &ServerUnit::getErrorPages() const //Check
 {
     return (this->_error_list);
 }
 
-const std::string &ServerUnit::getIndex() //Check
+const std::string &ServerUnit::getIndex() const //Check
 {
     return (this->_index);
 }
@@ -497,9 +691,9 @@ int ServerUnit::getFd() const { return this->_listen_fd; }
  * Returns the path of the error page for a given HTTP status code.
  * If no custom error page is set for the given code, an empty string is returned.
  */
-const std::string &ServerUnit::getPathErrorPage(short key) // Check
+const std::string &ServerUnit::getPathErrorPage(short key) const // Check
 {
-    std::map<short, std::string>::iterator it = this->_error_list.find(key);
+    std::map<short, std::string>::const_iterator it = this->_error_list.find(key);
     if (it == this->_error_list.end())
     {
         static const std::string empty = ""; // no se destruirá cuando acabe la función
@@ -533,15 +727,11 @@ void ServerUnit::checkSemicolon(std::string &token) // Check
 
 bool ServerUnit::checkLocations() const // Check
 {
-    if (this->_locations.size() < 2)
-        return (false);
-    std::vector<Location>::const_iterator it1;
-    std::vector<Location>::const_iterator it2;
-    for (it1 = this->_locations.begin(); it1 != this->_locations.end() - 1; it1++) {
-        for (it2 = it1 + 1; it2 != this->_locations.end(); it2++) {
-            if (it1->getPathLocation() == it2->getPathLocation())
-                return (true);
-        }
+    std::set<std::string> paths;
+    std::vector<Location>::const_iterator it;
+    for (it = this->_locations.begin(); it != this->_locations.end(); it++) {
+        if (!paths.insert(it->getPathLocation()).second)
+            return (true);
     }
     return (false);
 }
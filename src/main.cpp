@@ -40,6 +40,8 @@ int main(int argc, char **argv)
         logDebug("🍉 All servers validated successfully");
         serverGroup = config_reader.getServers();
         logDebug("🍉 Config file %s parsed successfully", config_path.c_str());
+        serverManager.setCommandLine(argv);
+        serverManager.setConfigPath(config_path);
         serverManager.setup(serverGroup);
         serverManager.init();
 
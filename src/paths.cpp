@@ -1,44 +1,165 @@
 #include "../include/WebServ.hpp"
+#include <limits.h>
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ * Una sola pasada de izquierda a derecha: decodifica %XX (si 'decode'),
+ * une barras repetidas y quita los segmentos "." y ".." (RFC 3986 5.2.4;
+ * un ".." que saldría de la raíz se descarta). Los segmentos se comprueban
+ * ya decodificados, así que "%2e%2e" también cuenta como "..".
+ *
+ * La salida nunca es más larga que la entrada ni adelanta a la lectura:
+ * 'out' necesita 'len' bytes y puede ser el propio 'in'. Devuelve la
+ * longitud escrita o -1 si hay un %XX mal formado, un NUL o una barra
+ * codificada (%2F, %5C), que no se pueden representar en una ruta; sin
+ * 'decode' nunca falla.
+ */
+static ssize_t normalize(const char *in, size_t len, char *out, bool decode) {
+    size_t o = 0;
+    size_t seg = 0; // inicio del segmento actual en 'out'
+    bool absolute = len > 0 && in[0] == '/';
+
+    for (size_t i = 0; i <= len; ) {
+        bool end = (i == len);
+        char c = end ? '/' : in[i];
+        if (decode && c == '\0' && !end)
+            return -1;
+        if (decode && c == '%') {
+            int hi, lo;
+            if (i + 2 >= len || (hi = hex_value(in[i + 1])) < 0 || (lo = hex_value(in[i + 2])) < 0)
+                return -1;
+            c = static_cast<char>(hi << 4 | lo);
+            if (c == '\0' || c == '/' || c == '\\')
+                return -1;
+            out[o++] = c;
+            i += 3;
+            continue;
+        }
+        if (c != '/') {
+            out[o++] = c;
+            ++i;
+            continue;
+        }
+
+        size_t n = o - seg;
+        if (n == 1 && out[seg] == '.') {
+            o = seg;
+        } else if (n == 2 && out[seg] == '.' && out[seg + 1] == '.') {
+            o = seg;
+            if (o > 0 && !(absolute && o == 1)) {
+                --o; // barra que cierra el segmento anterior
+                while (o > 0 && out[o - 1] != '/')
+                    --o;
+            }
+        } else if (!end && (n > 0 || i == 0)) {
+            out[o++] = '/';
+        }
+        seg = o;
+        ++i;
+    }
+    return static_cast<ssize_t>(o);
+}
+
+/**
+ * Normaliza el destino de una petición (sin la query) en 'out', que debe
+ * tener al menos 'len' bytes: decodificación completa de %XX, barras
+ * repetidas y segmentos "."/"..", en O(n) y sin reservar memoria.
+ * -1 si debe rechazarse con 400.
+ */
+ssize_t normalize_uri(const char *target, size_t len, char *out) {
+    return normalize(target, len, out, true);
+}
 
 /**
- * Clean the path by replacing URL-encoded characters.
- * Currently replaces %20 with space.
+ * Decodifica los %XX de 'path' (un parámetro de la query, por ejemplo).
+ * Las secuencias mal formadas se dejan tal cual.
  */
 std::string clean_path(const std::string& path) {
-    std::string cleaned = path;
-    // Replace %20 with space
-    cleaned = replace_all(cleaned, "%20", " ");
-    // Add more replacements if needed
+    std::string cleaned(path);
+    size_t o = 0;
+    for (size_t i = 0; i < path.size(); ++i) {
+        int hi, lo;
+        if (path[i] == '%' && i + 2 < path.size()
+            && (hi = hex_value(path[i + 1])) >= 0 && (lo = hex_value(path[i + 2])) >= 0) {
+            cleaned[o++] = static_cast<char>(hi << 4 | lo);
+            i += 2;
+        } else
+            cleaned[o++] = path[i];
+    }
+    cleaned.resize(o);
     return cleaned;
 }
 
 /**
  * Normalize the path by resolving ., .. and redundant slashes.
- * To prevent directory traversal attacks.
+ * To prevent directory traversal attacks. Same single pass as
+ * normalize_uri, without percent-decoding (filesystem paths).
  */
 std::string path_normalization(const std::string& path) {
-    std::string normalized = path;
-    // Replace multiple slashes with a single slash
-    size_t pos;
-    while ((pos = normalized.find("//")) != std::string::npos) {
-        normalized.replace(pos, 2, "/");
-    }
-    // Remove occurrences of "/./"
-    while ((pos = normalized.find("/./")) != std::string::npos) {
-        normalized.replace(pos, 3, "/");
-    }
-    // Handle "/../" by removing the preceding directory
-    while ((pos = normalized.find("/../")) != std::string::npos) {
-        if (pos == 0) {
-            normalized.erase(0, 3); // Remove leading "/.."
-        } else {
-            size_t prev_slash = normalized.rfind('/', pos - 1);
-            if (prev_slash == std::string::npos) {
-                normalized.erase(0, pos + 4); // Remove everything before "/../"
-            } else {
-                normalized.erase(prev_slash, pos + 3 - prev_slash);
-            }
-        }
-    }
+    std::string normalized(path);
+    if (normalized.empty())
+        return normalized;
+    normalized.resize(normalize(path.data(), path.size(), &normalized[0], false));
     return normalized;
+}
+
+/**
+ * check if 'path' is 'base' or lies inside it, once both are resolved
+ * with realpath (symlinks and .. included). 'path' itself may not exist:
+ * its parent directory is resolved instead.
+ */
+bool path_is_confined(const std::string& base, const std::string& path) {
+    char resolved[PATH_MAX];
+
+    if (!realpath(base.c_str(), resolved))
+        return false;
+    std::string real_base = resolved;
+
+    std::string dir = ".";
+    std::string name = path;
+    size_t slash = path.find_last_of('/');
+    if (slash != std::string::npos) {
+        dir = (slash == 0) ? "/" : path.substr(0, slash);
+        name = path.substr(slash + 1);
+    }
+    if (name == "." || name == "..")
+        return false;
+    if (!realpath(dir.c_str(), resolved))
+        return false;
+    std::string real_dir = resolved;
+
+    if (real_dir == real_base)
+        return true;
+    if (real_base == "/")
+        return true;
+    return real_dir.compare(0, real_base.size(), real_base) == 0
+        && real_dir[real_base.size()] == '/';
+}
+
+static std::vector<t_invalidation_hook> &invalidation_hooks() {
+    static std::vector<t_invalidation_hook> hooks;
+    return hooks;
+}
+
+void add_invalidation_hook(t_invalidation_hook hook) {
+    invalidation_hooks().push_back(hook);
+}
+
+/**
+ * Notify every registered cache that 'path' changed on disk
+ * (deleted, uploaded or overwritten).
+ */
+void invalidate_path(const std::string& path) {
+    std::vector<t_invalidation_hook> &hooks = invalidation_hooks();
+    for (size_t i = 0; i < hooks.size(); ++i)
+        hooks[i](path);
 }
\ No newline at end of file
@@ -80,11 +80,10 @@ std::string&	strip(std::string& str, char c)
 
 std::string	to_string(size_t n)
 {
-	std::stringstream tmp;
+	char	buf[24];
+	int		len = snprintf(buf, sizeof(buf), "%zu", n);
 
-	tmp << n;
-
-	return tmp.str();
+	return std::string(buf, len);
 }
 
 std::string	readValue(const std::string& line)
@@ -192,6 +191,20 @@ std::string read_file_text(const std::string &file_path) {
 	return buffer.str();
 }
 
+/** write() hasta escribir len bytes (reintenta EINTR y escrituras cortas). */
+bool write_all(int fd, const char *data, size_t len) {
+	while (len > 0) {
+		ssize_t n = write(fd, data, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return false;
+		data += n;
+		len -= n;
+	}
+	return true;
+}
+
 std::string replace_all(const std::string& str, const std::string& from, const std::string& to) {
     std::string result = str;
     size_t start_pos = 0;
@@ -211,21 +224,42 @@ std::string replace_all(const std::string& str, const std::string& from, const s
  * path /images/pic.jpg matches prefix /images/
  */
 bool path_matches(const std::string& prefix, const std::string& path) {
-    // Normaliza: quita barra final de prefix y path si la tienen (excepto si son solo "/")
-    std::string norm_prefix = prefix;
-    std::string norm_path = path;
+    // Ignora la barra final de prefix y path si la tienen (excepto si son solo "/"),
+    // comparando en sitio para no copiar ninguna de las dos cadenas
 	if (prefix == "/") return true; // root matches everything
-    if (norm_prefix.length() > 1 && norm_prefix[norm_prefix.length() - 1] == '/')
-        norm_prefix.erase(norm_prefix.length() - 1);
-    if (norm_path.length() > 1 && norm_path[norm_path.length() - 1] == '/')
-        norm_path.erase(norm_path.length() - 1);
-    // Coincidencia exacta
-    if (norm_path == norm_prefix)
-        return true;
-    // path es subdirectorio o archivo dentro de prefix
-    if (norm_path.size() > norm_prefix.size() && norm_path.compare(0, norm_prefix.size(), norm_prefix) == 0 && norm_path[norm_prefix.size()] == '/')
-        return true;
-    return false;
+    size_t plen = prefix.length();
+    size_t len = path.length();
+    if (plen > 1 && prefix[plen - 1] == '/')
+        plen--;
+    if (len > 1 && path[len - 1] == '/')
+        len--;
+    if (len < plen || path.compare(0, plen, prefix, 0, plen) != 0)
+        return false;
+    // Coincidencia exacta, o path es subdirectorio o archivo dentro de prefix
+    return len == plen || path[plen] == '/';
+}
+
+/**
+ * Location cuyo prefijo coincide con request_path y es el más largo.
+ * NULL si ninguna coincide.
+ */
+const Location* find_best_location(const std::string& request_path, const std::vector<Location> &locations) {
+    const Location* best_match = NULL;
+    size_t best_len = 0;
+
+    for (size_t i = 0; i < locations.size(); ++i) {
+        const Location& loc = locations[i];
+
+        const std::string &loc_path = loc.getPathLocation();
+        if (path_matches(loc_path, request_path)) {
+            // Preferimos el que tenga el prefix MÁS LARGO
+            if (loc_path.size() > best_len) {
+                best_match = &loc;
+                best_len = loc_path.size();
+            }
+        }
+    }
+    return best_match; // puede ser NULL si ninguno matchea
 }
 
 std::string method_toString(int method) {
@@ -243,15 +277,31 @@ std::string method_toString(int method) {
 }
 
 short method_toEnum(const std::string& method) {
-	if (method == "GET") return M_GET;
-	else if (method == "POST") return M_POST;
-	else if (method == "DELETE") return M_DELETE;
-	else if (method == "PUT") return M_PUT;
-	else if (method == "HEAD") return M_HEAD;
-	else {
+	int id = method_id(method);
+	if (id < 0)
 		throw std::runtime_error("Invalid method string: " + method);
-		return -1; // never reached
+	return id;
+}
+
+/**
+ * e_methods de 'method', o -1 si no es uno de los que se configuran.
+ * Decide por la longitud y compara una sola vez.
+ */
+int method_id(const std::string& method) {
+	switch (method.size()) {
+		case 3:
+			if (method == "GET") return M_GET;
+			if (method == "PUT") return M_PUT;
+			break;
+		case 4:
+			if (method == "POST") return M_POST;
+			if (method == "HEAD") return M_HEAD;
+			break;
+		case 6:
+			if (method == "DELETE") return M_DELETE;
+			break;
 	}
+	return -1;
 }
 
 bool ci_equal(const std::string& a, const std::string& b) {
@@ -271,4 +321,22 @@ std::string getFileExtension(const std::string &path) {
     if (pos == std::string::npos)
         return "";
     return path.substr(pos);
+}
+
+/**
+ * Get the value of 'key' in a query string.
+ * Ex: get_query_param("img=a.jpg&x=1", "img") -> "a.jpg"
+ */
+std::string get_query_param(const std::string &query, const std::string &key) {
+	size_t pos = 0;
+	while (pos <= query.size()) {
+		size_t end = query.find('&', pos);
+		if (end == std::string::npos)
+			end = query.size();
+		size_t eq = query.find('=', pos);
+		if (eq != std::string::npos && eq < end && query.compare(pos, eq - pos, key) == 0)
+			return query.substr(eq + 1, end - eq - 1);
+		pos = end + 1;
+	}
+	return "";
 }
\ No newline at end of file
@@ -0,0 +1,152 @@
+#include "../include/WebServ.hpp"
+
+/*
+ * Pruebas de la normalización de rutas (src/paths.cpp): decodificación de
+ * %XX, segmentos "." y "..", rechazo de escapes mal formados y de barras
+ * codificadas, y path_is_confined() con ".." y enlaces simbólicos.
+ *
+ * Uso: make test
+ */
+
+static int g_failed = 0;
+static int g_checks = 0;
+
+static void check(bool ok, const std::string &what) {
+    ++g_checks;
+    if (ok)
+        return;
+    ++g_failed;
+    printf("FAIL %s\n", what.c_str());
+}
+
+/** normalize_uri() de 'in'; "<400>" si la rechaza. */
+static std::string uri(const std::string &in) {
+    std::vector<char> out(in.size() + 1);
+    ssize_t n = normalize_uri(in.data(), in.size(), &out[0]);
+    if (n < 0)
+        return "<400>";
+    return std::string(&out[0], n);
+}
+
+static void expect_uri(const std::string &in, const std::string &want) {
+    std::string got = uri(in);
+    check(got == want, "normalize_uri(\"" + in + "\") = \"" + got + "\", expected \"" + want + "\"");
+}
+
+static void expect_path(const std::string &in, const std::string &want) {
+    std::string got = path_normalization(in);
+    check(got == want, "path_normalization(\"" + in + "\") = \"" + got + "\", expected \"" + want + "\"");
+}
+
+static void expect_clean(const std::string &in, const std::string &want) {
+    std::string got = clean_path(in);
+    check(got == want, "clean_path(\"" + in + "\") = \"" + got + "\", expected \"" + want + "\"");
+}
+
+static void expect_confined(const std::string &base, const std::string &path, bool want) {
+    check(path_is_confined(base, path) == want,
+          "path_is_confined(\"" + base + "\", \"" + path + "\") should be " + (want ? "true" : "false"));
+}
+
+/** Segmentos "." y ".."; un ".." nunca sale de la raíz. */
+static void test_dot_segments() {
+    expect_uri("/a/b/../c", "/a/c");
+    expect_uri("/a/./b//c", "/a/b/c");
+    expect_uri("/a/b/", "/a/b/");
+    expect_uri("/a/..", "/");
+    expect_uri("/..", "/");
+    expect_uri("/../../etc/passwd", "/etc/passwd");
+    expect_uri("/a/../../../b", "/b");
+    expect_uri("a/../../b", "b");
+    expect_uri("/...", "/...");
+    expect_uri("/a/..b", "/a/..b");
+    expect_uri("/", "/");
+    expect_uri("", "");
+}
+
+/** Los segmentos se comprueban ya decodificados. */
+static void test_decoding() {
+    expect_uri("/a%20b", "/a b");
+    expect_uri("/%41%62c", "/Abc");
+    expect_uri("/%2e%2e/x", "/x");
+    expect_uri("/a/%2E%2E/b", "/b");
+    expect_uri("/a/.%2e/b", "/b");
+    expect_uri("/a/%2e/b", "/a/b");
+    expect_uri("/%2e%2e/%2e%2e/etc/passwd", "/etc/passwd");
+}
+
+/** Barras y NUL codificados y %XX mal formados: 400. */
+static void test_rejected() {
+    expect_uri("/a%2Fb", "<400>");
+    expect_uri("/a%2fb", "<400>");
+    expect_uri("/..%2Fetc/passwd", "<400>");
+    expect_uri("/%2e%2e%2fetc", "<400>");
+    expect_uri("/a%5Cb", "<400>");
+    expect_uri("/a%00b", "<400>");
+    expect_uri(std::string("/a\0b", 4), "<400>");
+    expect_uri("/%zz", "<400>");
+    expect_uri("/%4", "<400>");
+    expect_uri("/%", "<400>");
+    expect_uri("/a%g1", "<400>");
+}
+
+/** Rutas del sistema de ficheros: sin decodificar. */
+static void test_path_normalization() {
+    expect_path("www/a/../b", "www/b");
+    expect_path("www//a/./b", "www/a/b");
+    expect_path("/../x", "/x");
+    expect_path("www/%2e%2e/b", "www/%2e%2e/b");
+}
+
+/** Parámetros de la query: decodifica todo, deja los %XX mal formados. */
+static void test_clean_path() {
+    expect_clean("a%20b.jpg", "a b.jpg");
+    expect_clean("..%2Findex.html", "../index.html");
+    expect_clean("%2E%2E%2F", "../");
+    expect_clean("100%", "100%");
+    expect_clean("%zz%4", "%zz%4");
+}
+
+/** Confinamiento real en disco: ".." y un enlace que sale de la base. */
+static void test_confined() {
+    char tmpl[] = "/tmp/webserv_test_pathsXXXXXX";
+    if (!mkdtemp(tmpl)) {
+        check(false, std::string("mkdtemp: ") + strerror(errno));
+        return;
+    }
+    std::string root = tmpl;
+    std::string base = root + "/base";
+    std::string outside = root + "/outside";
+    mkdir(base.c_str(), 0755);
+    mkdir((base + "/sub").c_str(), 0755);
+    mkdir(outside.c_str(), 0755);
+    int linked = symlink(outside.c_str(), (base + "/link").c_str());
+
+    expect_confined(base, base + "/file", true);
+    expect_confined(base, base + "/sub/file", true);
+    expect_confined(base, base + "/missing/file", false);
+    expect_confined(base, base + "/../outside/file", false);
+    expect_confined(base, base + "/sub/../../outside/file", false);
+    expect_confined(base, base + "/sub/..", false);
+    expect_confined(base + "/", base + "/file", true);
+    expect_confined(base, root + "/base2/file", false);
+    if (linked == 0)
+        expect_confined(base, base + "/link/file", false);
+
+    unlink((base + "/link").c_str());
+    rmdir((base + "/sub").c_str());
+    rmdir(base.c_str());
+    rmdir(outside.c_str());
+    rmdir(root.c_str());
+}
+
+int main() {
+    test_dot_segments();
+    test_decoding();
+    test_rejected();
+    test_path_normalization();
+    test_clean_path();
+    test_confined();
+    printf("test_paths: %d/%d checks passed\n", g_checks - g_failed, g_checks);
+    return g_failed ? 1 : 0;
+}